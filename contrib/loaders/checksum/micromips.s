@@ -0,0 +1,59 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+	.global main
+	.text
+	.set noreorder
+	.set micromips
+
+/* params:
+ * $a0 address in
+ * $a1 byte count
+ * $a2 address of the 256 entry crc table (poly 0x04c11db7, msb first)
+ * vars
+ * $a0 crc - result
+ * $t0 address
+ * $t1 end address
+ * temps:
+ * $t2 $t3
+ */
+
+.ent main
+main:
+	addu	$t1, $a0, $a1		/* end address */
+	addiu	$t0, $a0, 0		/* address in */
+
+	beq		$t0, $t1, done
+	addiu	$a0, $zero, -1 /* a0 crc - result */
+
+nbyte:
+	lbu		$t2, ($t0)		/* load byte from source address */
+	srl		$t3, $a0, 24
+	xor		$t3, $t3, $t2		/* table index: (crc >> 24) ^ byte */
+	sll		$t3, $t3, 2
+	addu	$t3, $t3, $a2
+	lw		$t3, ($t3)		/* table entry */
+	addiu	$t0, $t0, 1		/* inc address */
+	sll		$a0, $a0, 8
+	bne		$t0, $t1, nbyte	/* all bytes processed */
+	xor		$a0, $a0, $t3		/* crc = (crc << 8) ^ table entry */
+
+done:
+	sdbbp
+
+.end main
@@ -25,48 +25,36 @@
 /* params:
  * $a0 address in
  * $a1 byte count
+ * $a2 address of the 256 entry crc table (poly 0x04c11db7, msb first)
  * vars
- * $a0 crc
- * $a1 crc data byte
+ * $a0 crc - result
+ * $t0 address
+ * $t1 end address
  * temps:
- * t3 v0 a3 a2 t0 v1
+ * $t2 $t3
  */
 
 .ent main
 main:
-	addiu	$t4, $a0, 0		/* address in */
-	addiu	$t2, $a1, 0		/* count */
+	addu	$t1, $a0, $a1		/* end address */
+	addiu	$t0, $a0, 0		/* address in */
 
-	addiu	$a0, $zero, 0xffffffff /* a0 crc - result */
-
-	beq		$zero, $zero, ncomp
-	addiu	$t3, $zero, 0	/* clear bytes read */
+	beq		$t0, $t1, done
+	addiu	$a0, $zero, -1 /* a0 crc - result */
 
 nbyte:
-	lb		$a1, ($t4)		/* load byte from source address */
-	addi	$t4, $t4, 1		/* inc byte count */
-
-crc:
-	sll		$a1, $a1, 24
-	lui		$v0, 0x04c1
-	xor		$a0, $a0, $a1
-	ori		$a3, $v0, 0x1db7
-	addu	$a2, $zero, $zero /* clear bit count */
-loop:
-	sll		$t0, $a0, 1
-	addiu	$a2, $a2, 1		/* inc bit count */
-	slti	$a0, $a0, 0
-	xor		$t1, $t0, $a3
-	movn	$t0, $t1, $a0
-	slti	$v1, $a2, 8		/* 8bits processed */
-	bne		$v1, $zero, loop
-	addu	$a0, $t0, $zero
-
-ncomp:
-	bne		$t2, $t3, nbyte	/* all bytes processed */
-	addiu	$t3, $t3, 1
-
-wait:
+	lbu		$t2, ($t0)		/* load byte from source address */
+	srl		$t3, $a0, 24
+	xor		$t3, $t3, $t2		/* table index: (crc >> 24) ^ byte */
+	sll		$t3, $t3, 2
+	addu	$t3, $t3, $a2
+	lw		$t3, ($t3)		/* table entry */
+	addiu	$t0, $t0, 1		/* inc address */
+	sll		$a0, $a0, 8
+	bne		$t0, $t1, nbyte	/* all bytes processed */
+	xor		$a0, $a0, $t3		/* crc = (crc << 8) ^ table entry */
+
+done:
 	sdbbp
 
 .end main
@@ -0,0 +1,84 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+	.global main
+	.text
+	.set noreorder
+	.set micromips
+
+/* params:
+ * $a0 address in
+ * $a1 byte count
+ * $a2 mask - result out, 0xff on entry
+ * vars
+ * $t0 end address
+ * $t1 and of all aligned words
+ * $t3 end of the aligned words
+ * temps:
+ * $t2
+ */
+
+.ent main
+main:
+	addu	$t0, $a0, $a1		/* end address */
+	addiu	$t1, $zero, -1
+
+	/* bytes up to the first word boundary */
+head:
+	beq		$a0, $t0, fold
+	andi	$t2, $a0, 3
+	beq		$t2, $zero, words
+	nop
+	lbu		$t2, ($a0)
+	addiu	$a0, $a0, 1
+	b		head
+	and		$a2, $a2, $t2
+
+	/* whole words */
+words:
+	subu	$t3, $t0, $a0
+	srl		$t3, $t3, 2
+	sll		$t3, $t3, 2
+	beq		$t3, $zero, tail
+	addu	$t3, $t3, $a0
+wloop:
+	lw		$t2, ($a0)
+	addiu	$a0, $a0, 4
+	bne		$a0, $t3, wloop
+	and		$t1, $t1, $t2
+
+	/* remaining bytes */
+tail:
+	beq		$a0, $t0, fold
+	nop
+	lbu		$t2, ($a0)
+	addiu	$a0, $a0, 1
+	b		tail
+	and		$a2, $a2, $t2
+
+	/* fold the word result into the byte mask */
+fold:
+	srl		$t2, $t1, 16
+	and		$t1, $t1, $t2
+	srl		$t2, $t1, 8
+	and		$t1, $t1, $t2
+	and		$a2, $a2, $t1
+
+	sdbbp
+
+.end main
@@ -42,6 +42,10 @@
 /* defines internal maximum size for code fragment in cfi_intel_write_block() */
 #define CFI_MAX_INTEL_CODESIZE 256
 
+/* largest block cfi_spansion_write_block_mips() programs in one algorithm
+ * run, keeps a run well inside its 10s timeout */
+#define CFI_MIPS_MAX_BUFFER_SIZE	(64 * 1024)
+
 /* some id-types with specific handling */
 #define AT49BV6416      0x00d6
 #define AT49BV6416T     0x00d2
@@ -884,6 +888,38 @@ static int cfi_intel_erase(struct flash_bank *bank, int first, int last)
 	return cfi_send_command(bank, 0xff, flash_address(bank, 0, 0x0));
 }
 
+static int cfi_spansion_chip_erase(struct flash_bank *bank)
+{
+	int retval;
+	struct cfi_flash_bank *cfi_info = bank->driver_priv;
+	struct cfi_spansion_pri_ext *pri_ext = cfi_info->pri_ext;
+	int i;
+
+	LOG_DEBUG("Erasing entire flash bank at base 0x%" PRIx32, bank->base);
+
+	static const uint8_t chip_erase_seq[] = { 0xaa, 0x55, 0x80, 0xaa, 0x55, 0x10 };
+	for (i = 0; i < (int)ARRAY_SIZE(chip_erase_seq); i++) {
+		uint32_t unlock = (i == 1 || i == 4) ? pri_ext->_unlock2 : pri_ext->_unlock1;
+		retval = cfi_send_command(bank, chip_erase_seq[i], flash_address(bank, 0, unlock));
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (cfi_spansion_wait_status_busy(bank, cfi_info->chip_erase_timeout) != ERROR_OK) {
+		retval = cfi_send_command(bank, 0xf0, flash_address(bank, 0, 0x0));
+		if (retval != ERROR_OK)
+			return retval;
+
+		LOG_ERROR("couldn't erase flash bank at base 0x%" PRIx32, bank->base);
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	for (i = 0; i < bank->num_sectors; i++)
+		bank->sectors[i].is_erased = 1;
+
+	return cfi_send_command(bank, 0xf0, flash_address(bank, 0, 0x0));
+}
+
 static int cfi_spansion_erase(struct flash_bank *bank, int first, int last)
 {
 	int retval;
@@ -891,6 +927,19 @@ static int cfi_spansion_erase(struct flash_bank *bank, int first, int last)
 	struct cfi_spansion_pri_ext *pri_ext = cfi_info->pri_ext;
 	int i;
 
+	/* Erasing the whole device: let the chip erase every sector in one
+	 * internal operation instead of waiting on each sector in turn.
+	 * Protected sectors would be skipped silently, so only do this when
+	 * every sector is known to be unprotected. */
+	if (first == 0 && last == bank->num_sectors - 1 && cfi_info->chip_erase_timeout_typ) {
+		for (i = first; i <= last; i++) {
+			if (bank->sectors[i].is_protected != 0)
+				break;
+		}
+		if (i > last)
+			return cfi_spansion_chip_erase(bank);
+	}
+
 	for (i = first; i <= last; i++) {
 		retval = cfi_send_command(bank, 0xaa, flash_address(bank, 0, pri_ext->_unlock1));
 		if (retval != ERROR_OK)
@@ -1389,7 +1438,7 @@ static int cfi_spansion_write_block_mips(struct flash_bank *bank, const uint8_t
 	struct mips32_algorithm mips32_info;
 	struct working_area *write_algorithm;
 	struct working_area *source;
-	uint32_t buffer_size = 32768;
+	uint32_t buffer_size;
 	uint32_t status;
 	int retval = ERROR_OK;
 
@@ -1515,19 +1564,25 @@ static int cfi_spansion_write_block_mips(struct flash_bank *bank, const uint8_t
 
 	/* the following code still assumes target code is fixed 24*4 bytes */
 
-	while (target_alloc_working_area_try(target, buffer_size, &source) != ERROR_OK) {
-		buffer_size /= 2;
-		if (buffer_size <= 256) {
-			/* we already allocated the writing code, but failed to get a
-			 * buffer, free the algorithm */
-			target_free_working_area(target, write_algorithm);
-
-			LOG_WARNING(
-				"not enough working area available, can't do block memory writes");
-			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-		}
+	/* the core has to be halted to refill the buffer, so use as much of
+	 * the working area as we can to save resume/halt round trips */
+	buffer_size = target_get_working_area_avail(target);
+	if (buffer_size > CFI_MIPS_MAX_BUFFER_SIZE)
+		buffer_size = CFI_MIPS_MAX_BUFFER_SIZE;
+	buffer_size &= ~(uint32_t)(256 - 1);
+	/* but no more than the write needs, a backed up working area is
+	 * saved and restored in full */
+	buffer_size = MIN(buffer_size, (count + 256 - 1) & ~(uint32_t)(256 - 1));
+	if (buffer_size < 256
+			|| target_alloc_working_area(target, buffer_size, &source) != ERROR_OK) {
+		/* we already allocated the writing code, but failed to get a
+		 * buffer, free the algorithm */
+		target_free_working_area(target, write_algorithm);
+
+		LOG_WARNING(
+			"not enough working area available, can't do block memory writes");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
-	;
 
 	init_reg_param(&reg_params[0], "a0", 32, PARAM_OUT);
 	init_reg_param(&reg_params[1], "a1", 32, PARAM_OUT);
@@ -28,6 +28,7 @@
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
 #include <target/image.h>
+#include <jtag/jtag.h>
 
 /**
  * @file
@@ -38,10 +39,175 @@
 
 static struct flash_bank *flash_banks;
 
+/**
+ * The checksum cache remembers the CRC of every whole sector OpenOCD
+ * programmed, keyed by the IDCODE of the target's TAP and the sector's
+ * address and size.  Erases and writes through the flash drivers drop
+ * the entries they touch.  Entries are only hints: they tell the delta
+ * writer which sectors are probably unchanged, which it then confirms
+ * with one on-target checksum per span instead of one per sector.
+ * The cache is enabled, and kept in a file, by "flash crc_cache".
+ */
+struct flash_crc_entry {
+	uint32_t idcode;
+	uint32_t address;
+	uint32_t size;
+	uint32_t crc;
+	struct flash_crc_entry *next;
+};
+
+static struct flash_crc_entry *flash_crc_entries;
+static char *flash_crc_cache_file;
+
+static uint32_t flash_crc_cache_idcode(struct flash_bank *bank)
+{
+	return bank->target->tap ? bank->target->tap->idcode : 0;
+}
+
+static void flash_crc_cache_save(void)
+{
+	FILE *f = fopen(flash_crc_cache_file, "w");
+	if (f == NULL) {
+		LOG_WARNING("couldn't write flash checksum cache '%s'", flash_crc_cache_file);
+		return;
+	}
+
+	for (struct flash_crc_entry *e = flash_crc_entries; e; e = e->next)
+		fprintf(f, "0x%8.8" PRIx32 " 0x%8.8" PRIx32 " 0x%8.8" PRIx32 " 0x%8.8" PRIx32 "\n",
+			e->idcode, e->address, e->size, e->crc);
+
+	fclose(f);
+}
+
+static void flash_crc_cache_clear(void)
+{
+	while (flash_crc_entries) {
+		struct flash_crc_entry *next = flash_crc_entries->next;
+		free(flash_crc_entries);
+		flash_crc_entries = next;
+	}
+}
+
+/* drop every entry overlapping address..address + size - 1 */
+static void flash_crc_cache_forget(struct flash_bank *bank,
+	uint32_t address, uint32_t size)
+{
+	uint32_t idcode = flash_crc_cache_idcode(bank);
+	struct flash_crc_entry **p = &flash_crc_entries;
+	bool changed = false;
+
+	while (*p) {
+		struct flash_crc_entry *e = *p;
+		if (e->idcode == idcode && e->address < address + size
+				&& address < e->address + e->size) {
+			*p = e->next;
+			free(e);
+			changed = true;
+		} else
+			p = &e->next;
+	}
+
+	if (changed)
+		flash_crc_cache_save();
+}
+
+/* record the checksums of all whole sectors covered by a write */
+static void flash_crc_cache_record(struct flash_bank *bank,
+	const uint8_t *buffer, uint32_t offset, uint32_t count)
+{
+	uint32_t idcode = flash_crc_cache_idcode(bank);
+	bool changed = false;
+
+	for (int i = 0; i < bank->num_sectors; i++) {
+		struct flash_sector *f = &bank->sectors[i];
+		if (f->offset < offset || f->offset + f->size > offset + count)
+			continue;
+
+		struct flash_crc_entry *e = malloc(sizeof(*e));
+		if (e == NULL)
+			break;
+		if (image_calculate_checksum(buffer + (f->offset - offset),
+				f->size, &e->crc) != ERROR_OK) {
+			free(e);
+			break;
+		}
+		e->idcode = idcode;
+		e->address = bank->base + f->offset;
+		e->size = f->size;
+		e->next = flash_crc_entries;
+		flash_crc_entries = e;
+		changed = true;
+	}
+
+	if (changed)
+		flash_crc_cache_save();
+}
+
+static bool flash_crc_cache_lookup(struct flash_bank *bank,
+	uint32_t address, uint32_t size, uint32_t *crc)
+{
+	uint32_t idcode = flash_crc_cache_idcode(bank);
+
+	for (struct flash_crc_entry *e = flash_crc_entries; e; e = e->next) {
+		if (e->idcode == idcode && e->address == address && e->size == size) {
+			*crc = e->crc;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int flash_crc_cache_open(const char *filename)
+{
+	flash_crc_cache_clear();
+	free(flash_crc_cache_file);
+	flash_crc_cache_file = NULL;
+
+	if (filename == NULL)
+		return ERROR_OK;
+
+	flash_crc_cache_file = strdup(filename);
+	if (flash_crc_cache_file == NULL)
+		return ERROR_FAIL;
+
+	/* a missing file just means an empty cache */
+	FILE *f = fopen(filename, "r");
+	if (f == NULL)
+		return ERROR_OK;
+
+	uint32_t idcode, address, size, crc;
+	while (fscanf(f, "%" SCNx32 " %" SCNx32 " %" SCNx32 " %" SCNx32,
+			&idcode, &address, &size, &crc) == 4) {
+		struct flash_crc_entry *e = malloc(sizeof(*e));
+		if (e == NULL)
+			break;
+		e->idcode = idcode;
+		e->address = address;
+		e->size = size;
+		e->crc = crc;
+		e->next = flash_crc_entries;
+		flash_crc_entries = e;
+	}
+
+	fclose(f);
+	return ERROR_OK;
+}
+
+const char *flash_crc_cache_filename(void)
+{
+	return flash_crc_cache_file;
+}
+
 int flash_driver_erase(struct flash_bank *bank, int first, int last)
 {
 	int retval;
 
+	if (flash_crc_cache_file && first >= 0 && first <= last && last < bank->num_sectors)
+		flash_crc_cache_forget(bank, bank->base + bank->sectors[first].offset,
+			bank->sectors[last].offset + bank->sectors[last].size
+			- bank->sectors[first].offset);
+
 	retval = bank->driver->erase(bank, first, last);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed erasing sectors %d to %d", first, last);
@@ -85,13 +251,17 @@ int flash_driver_write(struct flash_bank *bank,
 {
 	int retval;
 
+	if (flash_crc_cache_file)
+		flash_crc_cache_forget(bank, bank->base + offset, count);
+
 	retval = bank->driver->write(bank, buffer, offset, count);
 	if (retval != ERROR_OK) {
 		LOG_ERROR(
 			"error writing to flash at address 0x%08" PRIx32 " at offset 0x%8.8" PRIx32,
 			bank->base,
 			offset);
-	}
+	} else if (flash_crc_cache_file)
+		flash_crc_cache_record(bank, buffer, offset, count);
 
 	return retval;
 }
@@ -278,8 +448,8 @@ static int default_flash_mem_blank_check(struct flash_bank *bank)
 		for (j = 0; j < bank->sectors[i].size; j += buffer_size) {
 			uint32_t chunk;
 			chunk = buffer_size;
-			if (chunk > (j - bank->sectors[i].size))
-				chunk = (j - bank->sectors[i].size);
+			if (chunk > (bank->sectors[i].size - j))
+				chunk = (bank->sectors[i].size - j);
 
 			retval = target_read_memory(target,
 					bank->base + bank->sectors[i].offset + j,
@@ -304,36 +474,65 @@ done:
 	return retval;
 }
 
-int default_flash_blank_check(struct flash_bank *bank)
+/* Blank check sectors first..last with as few algorithm runs as possible.
+ * A freshly erased bank is settled by a single run over all of it; if
+ * that finds data, each sector gets a run of its own.  Splitting the span
+ * further would only pay off on mostly blank banks, the loaders read a
+ * span to its end, so on programmed flash it would rescan the data over
+ * and over. */
+static int flash_blank_check_span(struct flash_bank *bank, int first, int last)
 {
-	struct target *target = bank->target;
+	struct flash_sector *f = bank->sectors;
+	uint32_t blank;
+	int retval;
 	int i;
+
+	/* only contiguous spans can be checked in one run */
+	for (i = first; i < last; i++) {
+		if (f[i].offset + f[i].size != f[i + 1].offset)
+			break;
+	}
+
+	if (first < last && i == last) {
+		retval = target_blank_check_memory(bank->target,
+				bank->base + f[first].offset,
+				f[last].offset + f[last].size - f[first].offset, &blank);
+		if (retval != ERROR_OK)
+			return retval;
+
+		if (blank == 0xFF) {
+			for (i = first; i <= last; i++)
+				f[i].is_erased = 1;
+			return ERROR_OK;
+		}
+	}
+
+	for (i = first; i <= last; i++) {
+		retval = target_blank_check_memory(bank->target,
+				bank->base + f[i].offset, f[i].size, &blank);
+		if (retval != ERROR_OK)
+			return retval;
+
+		f[i].is_erased = (blank == 0xFF);
+	}
+
+	return ERROR_OK;
+}
+
+int default_flash_blank_check(struct flash_bank *bank)
+{
 	int retval;
-	int fast_check = 0;
-	uint32_t blank;
 
 	if (bank->target->state != TARGET_HALTED) {
 		LOG_ERROR("Target not halted");
 		return ERROR_TARGET_NOT_HALTED;
 	}
 
-	for (i = 0; i < bank->num_sectors; i++) {
-		uint32_t address = bank->base + bank->sectors[i].offset;
-		uint32_t size = bank->sectors[i].size;
-
-		retval = target_blank_check_memory(target, address, size, &blank);
-		if (retval != ERROR_OK) {
-			fast_check = 0;
-			break;
-		}
-		if (blank == 0xFF)
-			bank->sectors[i].is_erased = 1;
-		else
-			bank->sectors[i].is_erased = 0;
-		fast_check = 1;
-	}
+	if (bank->num_sectors == 0)
+		return ERROR_OK;
 
-	if (!fast_check) {
+	retval = flash_blank_check_span(bank, 0, bank->num_sectors - 1);
+	if (retval != ERROR_OK) {
 		LOG_USER("Running slow fallback erase check - add working memory");
 		return default_flash_mem_blank_check(bank);
 	}
@@ -540,8 +739,163 @@ static int compare_section(const void *a, const void *b)
 		return -1;
 }
 
+/* unlock, erase and program one run of a bank as requested */
+static int flash_write_run(struct target *target, struct flash_bank *c,
+	uint8_t *buffer, uint32_t run_address, uint32_t run_size,
+	int erase, bool unlock)
+{
+	int retval = ERROR_OK;
+
+	if (unlock)
+		retval = flash_unlock_address_range(target, run_address, run_size);
+	if (retval == ERROR_OK) {
+		if (erase) {
+			/* calculate and erase sectors */
+			retval = flash_erase_address_range(target,
+					true, run_address, run_size);
+		}
+	}
+
+	if (retval == ERROR_OK) {
+		/* write flash sectors */
+		retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+	}
+
+	return retval;
+}
+
+/**
+ * Returns the end of the span of whole sectors, starting with sector
+ * @a first, that the checksum cache says already hold the image data.
+ * Returns the start of sector @a first when there is no such span.
+ */
+static uint32_t flash_crc_cache_span(struct flash_bank *c, int first,
+	uint8_t *buffer, uint32_t run_address, uint32_t run_end)
+{
+	uint32_t span_end = c->base + c->sectors[first].offset;
+
+	for (int i = first; i < c->num_sectors; i++) {
+		uint32_t start = c->base + c->sectors[i].offset;
+		uint32_t size = c->sectors[i].size;
+		uint32_t cached_crc, image_crc;
+
+		if (start != span_end || start < run_address || start + size > run_end)
+			break;
+		if (!flash_crc_cache_lookup(c, start, size, &cached_crc))
+			break;
+		if (image_calculate_checksum(buffer + (start - run_address),
+				size, &image_crc) != ERROR_OK || image_crc != cached_crc)
+			break;
+		span_end = start + size;
+	}
+
+	return span_end;
+}
+
+/**
+ * Program only those sectors of a run whose contents differ from the
+ * image.  The checksum of every sector the run covers is computed on the
+ * target and compared with the one of the image data; consecutive
+ * sectors that differ are erased and written together.  Spans of
+ * sectors the checksum cache vouches for are confirmed with a single
+ * checksum first.
+ */
+static int flash_write_run_delta(struct target *target, struct flash_bank *c,
+	uint8_t *buffer, uint32_t run_address, uint32_t run_size,
+	bool unlock, uint32_t *written, uint32_t *skipped)
+{
+	uint32_t run_end = run_address + run_size;
+	uint32_t dirty_start = 0, dirty_end = 0;
+	uint32_t span_end = run_address, unchanged_end = run_address;
+	bool dirty = false;
+	int retval;
+	int i;
+
+	for (i = 0; i <= c->num_sectors; i++) {
+		uint32_t start, end;
+		bool differs = false;
+
+		if (i < c->num_sectors) {
+			start = c->base + c->sectors[i].offset;
+			end = start + c->sectors[i].size;
+			if (end <= run_address || start >= run_end)
+				continue;
+			start = MAX(start, run_address);
+			end = MIN(end, run_end);
+
+			uint32_t image_crc, target_crc;
+			if (flash_crc_cache_file && start >= span_end) {
+				span_end = flash_crc_cache_span(c, i, buffer, run_address, run_end);
+				if (span_end > end) {
+					retval = image_calculate_checksum(buffer + (start - run_address),
+							span_end - start, &image_crc);
+					if (retval != ERROR_OK)
+						return retval;
+					if (target_checksum_memory(target, start, span_end - start,
+							&target_crc) == ERROR_OK && target_crc == image_crc)
+						unchanged_end = span_end;
+				}
+			}
+
+			if (end > unchanged_end) {
+				retval = image_calculate_checksum(buffer + (start - run_address),
+						end - start, &image_crc);
+				if (retval != ERROR_OK)
+					return retval;
+				retval = target_checksum_memory(target, start, end - start, &target_crc);
+				if (retval != ERROR_OK) {
+					LOG_DEBUG("no checksum for 0x%8.8" PRIx32 ", writing sector %d", start, i);
+					differs = true;
+				} else
+					differs = image_crc != target_crc;
+			}
+
+			if (differs) {
+				if (!dirty)
+					dirty_start = start;
+				dirty_end = end;
+				dirty = true;
+				continue;
+			}
+
+			if (skipped)
+				*skipped += end - start;
+		}
+
+		/* write out the sectors collected so far */
+		if (dirty) {
+			retval = flash_write_run(target, c,
+					buffer + (dirty_start - run_address),
+					dirty_start, dirty_end - dirty_start, 1, unlock);
+			if (retval != ERROR_OK)
+				return retval;
+			if (written)
+				*written += dirty_end - dirty_start;
+			dirty = false;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 int flash_write_unlock(struct target *target, struct image *image,
 	uint32_t *written, int erase, bool unlock)
+{
+	return flash_write_unlock_delta(target, image, written, NULL,
+			erase, unlock, false);
+}
+
+/* called for each run of an image, owns (must free) @a buffer */
+typedef int (*flash_run_handler_t)(struct target *target, struct flash_bank *c,
+	uint8_t *buffer, uint32_t run_address, uint32_t run_size, void *priv);
+
+/**
+ * Split an image into runs of consecutive sections, one flash bank at
+ * a time, and hand each run to @a handler.  With @a pad_to_sectors the
+ * runs are padded to the end of their last sector.
+ */
+static int flash_image_runs(struct target *target, struct image *image,
+	bool pad_to_sectors, flash_run_handler_t handler, void *priv)
 {
 	int retval = ERROR_OK;
 
@@ -553,16 +907,6 @@ int flash_write_unlock(struct target *target, struct image *image,
 	section = 0;
 	section_offset = 0;
 
-	if (written)
-		*written = 0;
-
-	if (erase) {
-		/* assume all sectors need erasing - stops any problems
-		 * when flash_write is called multiple times */
-
-		flash_set_dirty();
-	}
-
 	/* allocate padding array */
 	padding = calloc(image->num_sections, sizeof(*padding));
 
@@ -657,7 +1001,7 @@ int flash_write_unlock(struct target *target, struct image *image,
 		/* If we're applying any sector automagic, then pad this
 		 * (maybe-combined) segment to the end of its last sector.
 		 */
-		if (unlock || erase) {
+		if (pad_to_sectors) {
 			int sector;
 			uint32_t offset_start = run_address - c->base;
 			uint32_t offset_end = offset_start + run_size;
@@ -724,32 +1068,11 @@ int flash_write_unlock(struct target *target, struct image *image,
 			}
 		}
 
-		retval = ERROR_OK;
-
-		if (unlock)
-			retval = flash_unlock_address_range(target, run_address, run_size);
-		if (retval == ERROR_OK) {
-			if (erase) {
-				/* calculate and erase sectors */
-				retval = flash_erase_address_range(target,
-						true, run_address, run_size);
-			}
-		}
-
-		if (retval == ERROR_OK) {
-			/* write flash sectors */
-			retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
-		}
-
-		free(buffer);
-
+		retval = handler(target, c, buffer, run_address, run_size, priv);
 		if (retval != ERROR_OK) {
 			/* abort operation */
 			goto done;
 		}
-
-		if (written != NULL)
-			*written += run_size;	/* add run size to total written counter */
 	}
 
 done:
@@ -759,6 +1082,274 @@ done:
 	return retval;
 }
 
+struct flash_write_options {
+	int erase;
+	bool unlock;
+	bool skip_unchanged;
+	uint32_t *written;
+	uint32_t *skipped;
+};
+
+static int flash_write_image_run(struct target *target, struct flash_bank *c,
+	uint8_t *buffer, uint32_t run_address, uint32_t run_size, void *priv)
+{
+	struct flash_write_options *opt = priv;
+	int retval;
+
+	if (opt->skip_unchanged)
+		retval = flash_write_run_delta(target, c, buffer,
+				run_address, run_size, opt->unlock, opt->written, opt->skipped);
+	else
+		retval = flash_write_run(target, c, buffer,
+				run_address, run_size, opt->erase, opt->unlock);
+
+	free(buffer);
+
+	if (retval == ERROR_OK && opt->written != NULL && !opt->skip_unchanged)
+		*opt->written += run_size;	/* add run size to total written counter */
+
+	return retval;
+}
+
+int flash_write_unlock_delta(struct target *target, struct image *image,
+	uint32_t *written, uint32_t *skipped, int erase, bool unlock, bool skip_unchanged)
+{
+	struct flash_write_options opt = {
+		.erase = erase,
+		.unlock = unlock,
+		.skip_unchanged = skip_unchanged,
+		.written = written,
+		.skipped = skipped,
+	};
+
+	if (written)
+		*written = 0;
+	if (skipped)
+		*skipped = 0;
+
+	if (erase || skip_unchanged) {
+		/* assume all sectors need erasing - stops any problems
+		 * when flash_write is called multiple times */
+
+		flash_set_dirty();
+	}
+
+	return flash_image_runs(target, image, unlock || erase || skip_unchanged,
+			flash_write_image_run, &opt);
+}
+
+/* one run of the image, waiting to be erased and written on a target */
+struct flash_gang_run {
+	struct flash_bank *bank;
+	uint8_t *buffer;
+	uint32_t address;
+	uint32_t size;
+	struct flash_gang_run *next;
+};
+
+struct flash_gang_target {
+	struct target *target;
+	bool unlock;
+	struct flash_gang_run *runs, **tail;
+	struct flash_gang_run *run;		/* run being erased or written */
+	bool erasing;
+	void *job;						/* driver job running on the target */
+	int retval;
+	uint32_t written;
+};
+
+/* unlock a run right away, keep it for the erase and write passes */
+static int flash_gang_add_run(struct target *target, struct flash_bank *c,
+	uint8_t *buffer, uint32_t run_address, uint32_t run_size, void *priv)
+{
+	struct flash_gang_target *t = priv;
+	struct flash_gang_run *run;
+	int retval = ERROR_OK;
+
+	if (t->unlock)
+		retval = flash_unlock_address_range(target, run_address, run_size);
+	if (retval != ERROR_OK) {
+		free(buffer);
+		return retval;
+	}
+
+	run = malloc(sizeof(*run));
+	if (run == NULL) {
+		LOG_ERROR("Out of memory for flash bank buffer");
+		free(buffer);
+		return ERROR_FAIL;
+	}
+	run->bank = c;
+	run->buffer = buffer;
+	run->address = run_address;
+	run->size = run_size;
+	run->next = NULL;
+	*t->tail = run;
+	t->tail = &run->next;
+
+	return ERROR_OK;
+}
+
+/* start erasing or writing the current run; drivers without
+ * erase_start/write_start do the whole operation here and leave no job */
+static int flash_gang_start(struct flash_gang_target *t)
+{
+	struct flash_gang_run *run = t->run;
+	struct flash_bank *c = run->bank;
+	uint32_t offset = run->address - c->base;
+	int retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	t->job = NULL;
+
+	if (t->erasing) {
+		int first, last;
+
+		/* the sectors the (sector padded) run covers */
+		for (first = 0; first < c->num_sectors - 1; first++)
+			if (offset < c->sectors[first].offset + c->sectors[first].size)
+				break;
+		for (last = first; last < c->num_sectors - 1; last++)
+			if (offset + run->size <= c->sectors[last].offset + c->sectors[last].size)
+				break;
+
+		if (c->driver->erase_start && c->driver->job_wait) {
+			if (flash_crc_cache_file)
+				flash_crc_cache_forget(c, c->base + c->sectors[first].offset,
+					c->sectors[last].offset + c->sectors[last].size
+					- c->sectors[first].offset);
+			retval = c->driver->erase_start(c, first, last, &t->job);
+			if (retval != ERROR_OK && retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+				LOG_ERROR("failed erasing sectors %d to %d", first, last);
+		}
+		if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
+			t->job = NULL;
+			retval = flash_driver_erase(c, first, last);
+		}
+	} else {
+		if (c->driver->write_start && c->driver->job_wait) {
+			if (flash_crc_cache_file)
+				flash_crc_cache_forget(c, run->address, run->size);
+			retval = c->driver->write_start(c, run->buffer, offset, run->size, &t->job);
+			if (retval != ERROR_OK && retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+				LOG_ERROR("error writing to flash at address 0x%08" PRIx32
+					" at offset 0x%8.8" PRIx32, c->base, offset);
+		}
+		if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
+			t->job = NULL;
+			retval = flash_driver_write(c, run->buffer, offset, run->size);
+		}
+	}
+
+	return retval;
+}
+
+/* the current operation finished, move on to the next one */
+static void flash_gang_next(struct flash_gang_target *t, int erase)
+{
+	if (t->erasing) {
+		t->erasing = false;
+		return;
+	}
+
+	t->written += t->run->size;
+	t->run = t->run->next;
+	t->erasing = erase && t->run;
+}
+
+int flash_gang_write(struct target **targets, int num_targets, struct image *image,
+	int erase, bool unlock, int *retvals, uint32_t *written)
+{
+	struct flash_gang_target *gang;
+	int busy = 0;
+	int i;
+
+	gang = calloc(num_targets, sizeof(*gang));
+	if (gang == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	if (erase)
+		flash_set_dirty();
+
+	for (i = 0; i < num_targets; i++) {
+		struct flash_gang_target *t = &gang[i];
+
+		t->target = targets[i];
+		t->unlock = unlock;
+		t->tail = &t->runs;
+		t->retval = flash_image_runs(t->target, image, unlock || erase,
+				flash_gang_add_run, t);
+		t->run = t->runs;
+		t->erasing = erase && t->run;
+		if (t->retval == ERROR_OK && t->run)
+			busy++;
+	}
+
+	/* Each pass waits for the job of one target and immediately starts
+	 * its next one before going on to the next target, so the erase and
+	 * write algorithms of all targets run at the same time.  Operations
+	 * of a single target stay in order. */
+	while (busy > 0) {
+		for (i = 0; i < num_targets; i++) {
+			struct flash_gang_target *t = &gang[i];
+
+			if (t->retval != ERROR_OK || t->run == NULL)
+				continue;
+
+			if (t->job) {
+				struct flash_bank *c = t->run->bank;
+				bool done = false;
+
+				t->retval = c->driver->job_wait(c, t->job, &done);
+				if (done)
+					t->job = NULL;
+				if (t->retval != ERROR_OK) {
+					if (!t->erasing)
+						LOG_ERROR("error writing to flash at address 0x%08" PRIx32
+							" at offset 0x%8.8" PRIx32, c->base, t->run->address - c->base);
+					busy--;
+					continue;
+				}
+				if (!done)
+					continue;
+				if (!t->erasing && flash_crc_cache_file)
+					flash_crc_cache_record(c, t->run->buffer,
+						t->run->address - c->base, t->run->size);
+				flash_gang_next(t, erase);
+			}
+
+			/* drivers without jobs complete the operation right here,
+			 * one per pass so the other targets are refilled meanwhile */
+			if (t->run) {
+				t->retval = flash_gang_start(t);
+				if (t->retval == ERROR_OK && !t->job)
+					flash_gang_next(t, erase);
+			}
+
+			if (t->retval != ERROR_OK || t->run == NULL)
+				busy--;
+		}
+	}
+
+	for (i = 0; i < num_targets; i++) {
+		struct flash_gang_run *run = gang[i].runs;
+
+		while (run) {
+			struct flash_gang_run *next = run->next;
+			free(run->buffer);
+			free(run);
+			run = next;
+		}
+		retvals[i] = gang[i].retval;
+		written[i] = gang[i].written;
+	}
+
+	free(gang);
+
+	return ERROR_OK;
+}
+
 int flash_write(struct target *target, struct image *image,
 	uint32_t *written, int erase)
 {
@@ -139,6 +139,52 @@ struct flash_driver {
 	int (*write)(struct flash_bank *bank,
 			const uint8_t *buffer, uint32_t offset, uint32_t count);
 
+	/**
+	 * Optional: start erasing sectors like flash_driver_s::erase,
+	 * but return as soon as the target works on its own, so that
+	 * other targets can be served meanwhile.  The erase is carried
+	 * on by flash_driver_s::job_wait.
+	 *
+	 * @param bank The bank of flash to be erased.
+	 * @param first The number of the first sector to erase.
+	 * @param last The number of the last sector to erase.
+	 * @param job Set to the driver's job state.
+	 * @returns ERROR_OK if the erase was started;
+	 * ERROR_TARGET_RESOURCE_NOT_AVAILABLE to have the caller use
+	 * flash_driver_s::erase instead; otherwise, an error code.
+	 */
+	int (*erase_start)(struct flash_bank *bank, int first, int last, void **job);
+
+	/**
+	 * Optional: start programming data like flash_driver_s::write,
+	 * returning while the target's algorithm runs.  The buffer must
+	 * stay valid until the job is done.
+	 *
+	 * @param bank The bank to program
+	 * @param buffer The data bytes to write.
+	 * @param offset The offset into the chip to program.
+	 * @param count The number of bytes to write.
+	 * @param job Set to the driver's job state.
+	 * @returns ERROR_OK if the write was started;
+	 * ERROR_TARGET_RESOURCE_NOT_AVAILABLE to have the caller use
+	 * flash_driver_s::write instead; otherwise, an error code.
+	 */
+	int (*write_start)(struct flash_bank *bank,
+			const uint8_t *buffer, uint32_t offset, uint32_t count, void **job);
+
+	/**
+	 * Wait for the part of a job started by flash_driver_s::erase_start
+	 * or flash_driver_s::write_start that runs on the target, then
+	 * start its next part.  Once the job is done or failed, it is
+	 * freed and @a done is set.
+	 *
+	 * @param bank The bank the job works on.
+	 * @param job The driver's job state.
+	 * @param done Set once the job is finished.
+	 * @returns ERROR_OK if successful; otherwise, an error code.
+	 */
+	int (*job_wait)(struct flash_bank *bank, void *job, bool *done);
+
 	/**
 	 * Read data from the flash. Note CPU address will be
 	 * "bank->base + offset", while the physical address is
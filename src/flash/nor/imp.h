@@ -44,8 +44,26 @@ int flash_driver_write(struct flash_bank *bank,
 int flash_driver_read(struct flash_bank *bank,
 		uint8_t *buffer, uint32_t offset, uint32_t count);
 
+/* enable the sector checksum cache, kept in @a filename; NULL disables it */
+int flash_crc_cache_open(const char *filename);
+/* @returns the file the checksum cache is kept in, or NULL if disabled */
+const char *flash_crc_cache_filename(void);
+
 /* write (optional verify) an image to flash memory of the given target */
 int flash_write_unlock(struct target *target, struct image *image,
 		uint32_t *written, int erase, bool unlock);
 
+/* like flash_write_unlock(), but with @a skip_unchanged set only sectors whose
+ * on-target checksum differs from the image are erased and written;
+ * @a skipped returns the number of bytes left alone */
+int flash_write_unlock_delta(struct target *target, struct image *image,
+		uint32_t *written, uint32_t *skipped, int erase, bool unlock, bool skip_unchanged);
+
+/* write an image to the flash of several targets at once, overlapping the
+ * targets' erase and write algorithms where the drivers allow it; the
+ * outcome and byte count of each target are returned in @a retvals and
+ * @a written */
+int flash_gang_write(struct target **targets, int num_targets, struct image *image,
+		int erase, bool unlock, int *retvals, uint32_t *written);
+
 #endif /* FLASH_NOR_IMP_H */
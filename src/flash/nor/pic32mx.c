@@ -95,6 +95,10 @@
 
 #define MX_1_2			1	/* PIC32mx1xx/2xx */
 
+/* largest block handed to the write algorithm in one run, keeps a run
+ * (about 2ms per 512 byte row) well inside its timeout */
+#define PIC32MX_MAX_BUFFER_SIZE	(64 * 1024)
+
 struct pic32mx_flash_bank {
 	int probed;
 	int dev_type;		/* Default 0. 1 for Pic32MX1XX/2XX variant */
@@ -223,10 +227,11 @@ static uint32_t pic32mx_wait_status_busy(struct flash_bank *bank, int timeout)
 	return status;
 }
 
-static int pic32mx_nvm_exec(struct flash_bank *bank, uint32_t op, uint32_t timeout)
+/* start an NVM operation, leaves the flash registers unlocked until
+ * pic32mx_nvm_finish() */
+static void pic32mx_nvm_start(struct flash_bank *bank, uint32_t op)
 {
 	struct target *target = bank->target;
-	uint32_t status;
 
 	target_write_u32(target, PIC32MX_NVMCON, NVMCON_NVMWREN | op);
 
@@ -236,15 +241,27 @@ static int pic32mx_nvm_exec(struct flash_bank *bank, uint32_t op, uint32_t timeo
 
 	/* start operation */
 	target_write_u32(target, PIC32MX_NVMCONSET, NVMCON_NVMWR);
+}
+
+static uint32_t pic32mx_nvm_finish(struct flash_bank *bank, uint32_t timeout)
+{
+	uint32_t status;
 
 	status = pic32mx_wait_status_busy(bank, timeout);
 
 	/* lock flash registers */
-	target_write_u32(target, PIC32MX_NVMCONCLR, NVMCON_NVMWREN);
+	target_write_u32(bank->target, PIC32MX_NVMCONCLR, NVMCON_NVMWREN);
 
 	return status;
 }
 
+static int pic32mx_nvm_exec(struct flash_bank *bank, uint32_t op, uint32_t timeout)
+{
+	pic32mx_nvm_start(bank, op);
+
+	return pic32mx_nvm_finish(bank, timeout);
+}
+
 static int pic32mx_protect_check(struct flash_bank *bank)
 {
 	struct target *target = bank->target;
@@ -410,27 +427,35 @@ static uint32_t pic32mx_flash_write_code[] = {
 	0x00000000		/* nop */
 };
 
-static int pic32mx_write_block(struct flash_bank *bank, const uint8_t *buffer,
-		uint32_t offset, uint32_t count)
-{
-	struct target *target = bank->target;
-	uint32_t buffer_size = 16384;
+/* state of a block write, refilled and restarted one buffer at a time */
+struct pic32mx_write_job {
 	struct working_area *write_algorithm;
 	struct working_area *source;
-	uint32_t address = bank->base + offset;
 	struct reg_param reg_params[3];
-	uint32_t row_size;
-	int retval = ERROR_OK;
-
-	struct pic32mx_flash_bank *pic32mx_info = bank->driver_priv;
 	struct mips32_algorithm mips32_info;
+	const uint8_t *buffer;
+	uint8_t *new_buffer;
+	uint32_t buffer_size;
+	uint32_t address;
+	uint32_t count;			/* words left to write */
+	uint32_t row_offset;
+	uint32_t thisrun_count;	/* words handed to the running algorithm */
+};
 
-	/* flash write code */
-	if (target_alloc_working_area(target, sizeof(pic32mx_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
-		LOG_WARNING("no working area available, can't do block memory writes");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	};
+/* a job started by pic32mx_erase_start() or pic32mx_write_start() */
+struct pic32mx_job {
+	bool erase;
+	int sector;				/* sector being erased, -1 for the whole PFM */
+	int last;
+	struct pic32mx_write_job write;
+};
+
+static int pic32mx_write_block_init(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count, struct pic32mx_write_job *job)
+{
+	struct target *target = bank->target;
+	struct pic32mx_flash_bank *pic32mx_info = bank->driver_priv;
+	uint32_t row_size;
 
 	/* Change values for counters and row size, depending on variant */
 	if (pic32mx_info->dev_type == MX_1_2) {
@@ -452,112 +477,179 @@ static int pic32mx_write_block(struct flash_bank *bank, const uint8_t *buffer,
 	uint8_t code[sizeof(pic32mx_flash_write_code)];
 	target_buffer_set_u32_array(target, code, ARRAY_SIZE(pic32mx_flash_write_code),
 			pic32mx_flash_write_code);
-	retval = target_write_buffer(target, write_algorithm->address, sizeof(code), code);
-	if (retval != ERROR_OK)
-		return retval;
 
-	/* memory buffer */
-	while (target_alloc_working_area_try(target, buffer_size, &source) != ERROR_OK) {
-		buffer_size /= 2;
-		if (buffer_size <= 256) {
-			/* we already allocated the writing code, but failed to get a
-			 * buffer, free the algorithm */
-			target_free_working_area(target, write_algorithm);
+	/* flash write code, stays resident across calls */
+	if (target_alloc_working_area_code(target, code, sizeof(code),
+			&job->write_algorithm) != ERROR_OK) {
+		LOG_WARNING("no working area available, can't do block memory writes");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	};
 
-			LOG_WARNING("no large enough working area available, can't do block memory writes");
-			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-		}
+	/* memory buffer, as many whole rows as the working area holds: the
+	 * core must be halted to refill it, so every algorithm run costs a
+	 * full resume/halt round trip */
+	job->buffer_size = target_get_working_area_avail(target);
+	if (job->buffer_size > PIC32MX_MAX_BUFFER_SIZE)
+		job->buffer_size = PIC32MX_MAX_BUFFER_SIZE;
+	/* but no more than the rows written, a backed up working area is
+	 * saved and restored in full */
+	job->buffer_size = MIN(job->buffer_size,
+			(offset % row_size + count * 4 + row_size - 1) & ~(row_size - 1));
+	job->buffer_size &= ~(row_size - 1);
+	if (job->buffer_size < row_size
+			|| target_alloc_working_area(target, job->buffer_size,
+				&job->source) != ERROR_OK) {
+		/* we already allocated the writing code, but failed to get a
+		 * buffer, free the algorithm */
+		target_free_working_area(target, job->write_algorithm);
+
+		LOG_WARNING("no large enough working area available, can't do block memory writes");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
-	mips32_info.common_magic = MIPS32_COMMON_MAGIC;
-	mips32_info.isa_mode = MIPS32_ISA_MIPS32;
-
-	init_reg_param(&reg_params[0], "a0", 32, PARAM_IN_OUT);
-	init_reg_param(&reg_params[1], "a1", 32, PARAM_OUT);
-	init_reg_param(&reg_params[2], "a2", 32, PARAM_OUT);
-
-	int row_offset = offset % row_size;
-	uint8_t *new_buffer = NULL;
-	if (row_offset && (count >= (row_size / 4))) {
-		new_buffer = malloc(buffer_size);
-		if (new_buffer == NULL) {
+	job->mips32_info.common_magic = MIPS32_COMMON_MAGIC;
+	job->mips32_info.isa_mode = MIPS32_ISA_MIPS32;
+
+	job->buffer = buffer;
+	job->address = bank->base + offset;
+	job->count = count;
+	job->row_offset = offset % row_size;
+	job->new_buffer = NULL;
+	if (job->row_offset && (count >= (row_size / 4))) {
+		job->new_buffer = malloc(job->buffer_size);
+		if (job->new_buffer == NULL) {
 			LOG_ERROR("Out of memory");
+			target_free_working_area(target, job->source);
+			target_free_working_area(target, job->write_algorithm);
 			return ERROR_FAIL;
 		}
-		memset(new_buffer,  0xff, row_offset);
-		address -= row_offset;
+		memset(job->new_buffer,  0xff, job->row_offset);
+		job->address -= job->row_offset;
 	} else
-		row_offset = 0;
+		job->row_offset = 0;
 
-	while (count > 0) {
-		uint32_t status;
-		uint32_t thisrun_count;
+	init_reg_param(&job->reg_params[0], "a0", 32, PARAM_IN_OUT);
+	init_reg_param(&job->reg_params[1], "a1", 32, PARAM_OUT);
+	init_reg_param(&job->reg_params[2], "a2", 32, PARAM_OUT);
 
-		if (row_offset) {
-			thisrun_count = (count > ((buffer_size - row_offset) / 4)) ?
-				((buffer_size - row_offset) / 4) : count;
+	return ERROR_OK;
+}
 
-			memcpy(new_buffer + row_offset, buffer, thisrun_count * 4);
+/* fill the buffer with the next rows and start the algorithm on them */
+static int pic32mx_write_block_start(struct flash_bank *bank, struct pic32mx_write_job *job)
+{
+	struct target *target = bank->target;
+	struct working_area *source = job->source;
+	uint32_t buffer_size = job->buffer_size;
+	uint32_t row_offset = job->row_offset;
+	uint32_t count = job->count;
+	uint32_t thisrun_count;
+	int retval;
 
-			retval = target_write_buffer(target, source->address,
-				row_offset + thisrun_count * 4, new_buffer);
-			if (retval != ERROR_OK)
-				break;
-		} else {
-			thisrun_count = (count > (buffer_size / 4)) ?
-					(buffer_size / 4) : count;
+	if (row_offset) {
+		thisrun_count = (count > ((buffer_size - row_offset) / 4)) ?
+			((buffer_size - row_offset) / 4) : count;
 
-			retval = target_write_buffer(target, source->address,
-					thisrun_count * 4, buffer);
-			if (retval != ERROR_OK)
-				break;
-		}
+		memcpy(job->new_buffer + row_offset, job->buffer, thisrun_count * 4);
 
-		buf_set_u32(reg_params[0].value, 0, 32, Virt2Phys(source->address));
-		buf_set_u32(reg_params[1].value, 0, 32, Virt2Phys(address));
-		buf_set_u32(reg_params[2].value, 0, 32, thisrun_count + row_offset / 4);
+		retval = target_write_buffer(target, source->address,
+			row_offset + thisrun_count * 4, job->new_buffer);
+		if (retval != ERROR_OK)
+			return retval;
+	} else {
+		thisrun_count = (count > (buffer_size / 4)) ?
+				(buffer_size / 4) : count;
 
-		retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
-				write_algorithm->address,
-				0, 10000, &mips32_info);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("error executing pic32mx flash write algorithm");
-			retval = ERROR_FLASH_OPERATION_FAILED;
-			break;
-		}
+		retval = target_write_buffer(target, source->address,
+				thisrun_count * 4, job->buffer);
+		if (retval != ERROR_OK)
+			return retval;
+	}
 
-		status = buf_get_u32(reg_params[0].value, 0, 32);
+	buf_set_u32(job->reg_params[0].value, 0, 32, Virt2Phys(source->address));
+	buf_set_u32(job->reg_params[1].value, 0, 32, Virt2Phys(job->address));
+	buf_set_u32(job->reg_params[2].value, 0, 32, thisrun_count + row_offset / 4);
+	job->thisrun_count = thisrun_count;
 
-		if (status & NVMCON_NVMERR) {
-			LOG_ERROR("Flash write error NVMERR (status = 0x%08" PRIx32 ")", status);
-			retval = ERROR_FLASH_OPERATION_FAILED;
-			break;
-		}
+	retval = target_start_algorithm(target, 0, NULL, 3, job->reg_params,
+			job->write_algorithm->address, 0, &job->mips32_info);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("error executing pic32mx flash write algorithm");
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
 
-		if (status & NVMCON_LVDERR) {
-			LOG_ERROR("Flash write error LVDERR (status = 0x%08" PRIx32 ")", status);
-			retval = ERROR_FLASH_OPERATION_FAILED;
-			break;
-		}
+	return ERROR_OK;
+}
 
-		buffer += thisrun_count * 4;
-		address += thisrun_count * 4;
-		count -= thisrun_count;
-		if (row_offset) {
-			address += row_offset;
-			row_offset = 0;
-		}
+/* wait for the rows started by pic32mx_write_block_start() */
+static int pic32mx_write_block_wait(struct flash_bank *bank, struct pic32mx_write_job *job)
+{
+	uint32_t status;
+	int retval;
+
+	retval = target_wait_algorithm(bank->target, 0, NULL, 3, job->reg_params,
+			0, 10000, &job->mips32_info);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("error executing pic32mx flash write algorithm");
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
+
+	status = buf_get_u32(job->reg_params[0].value, 0, 32);
+
+	if (status & NVMCON_NVMERR) {
+		LOG_ERROR("Flash write error NVMERR (status = 0x%08" PRIx32 ")", status);
+		return ERROR_FLASH_OPERATION_FAILED;
 	}
 
-	target_free_working_area(target, source);
-	target_free_working_area(target, write_algorithm);
+	if (status & NVMCON_LVDERR) {
+		LOG_ERROR("Flash write error LVDERR (status = 0x%08" PRIx32 ")", status);
+		return ERROR_FLASH_OPERATION_FAILED;
+	}
 
-	destroy_reg_param(&reg_params[0]);
-	destroy_reg_param(&reg_params[1]);
-	destroy_reg_param(&reg_params[2]);
+	job->buffer += job->thisrun_count * 4;
+	job->address += job->thisrun_count * 4;
+	job->count -= job->thisrun_count;
+	if (job->row_offset) {
+		job->address += job->row_offset;
+		job->row_offset = 0;
+	}
+
+	return ERROR_OK;
+}
+
+static void pic32mx_write_block_free(struct flash_bank *bank, struct pic32mx_write_job *job)
+{
+	target_free_working_area(bank->target, job->source);
+	target_free_working_area(bank->target, job->write_algorithm);
+
+	destroy_reg_param(&job->reg_params[0]);
+	destroy_reg_param(&job->reg_params[1]);
+	destroy_reg_param(&job->reg_params[2]);
+
+	free(job->new_buffer);
+}
+
+static int pic32mx_write_block(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count)
+{
+	struct pic32mx_write_job job;
+	int retval;
+
+	retval = pic32mx_write_block_init(bank, buffer, offset, count, &job);
+	if (retval != ERROR_OK)
+		return retval;
+
+	while (job.count > 0) {
+		retval = pic32mx_write_block_start(bank, &job);
+		if (retval != ERROR_OK)
+			break;
+		retval = pic32mx_write_block_wait(bank, &job);
+		if (retval != ERROR_OK)
+			break;
+	}
+
+	pic32mx_write_block_free(bank, &job);
 
-	if (new_buffer != NULL)
-		free(new_buffer);
 	return retval;
 }
 
@@ -654,6 +746,125 @@ static int pic32mx_write(struct flash_bank *bank, const uint8_t *buffer, uint32_
 	return ERROR_OK;
 }
 
+/* erase one page, or the whole PFM for sector -1, without waiting */
+static void pic32mx_erase_job_start(struct flash_bank *bank, struct pic32mx_job *job)
+{
+	if (job->sector < 0) {
+		LOG_DEBUG("Erasing entire program flash");
+		pic32mx_nvm_start(bank, NVMCON_OP_PFM_ERASE);
+		return;
+	}
+
+	target_write_u32(bank->target, PIC32MX_NVMADDR,
+			Virt2Phys(bank->base + bank->sectors[job->sector].offset));
+	pic32mx_nvm_start(bank, NVMCON_OP_PAGE_ERASE);
+}
+
+static int pic32mx_erase_start(struct flash_bank *bank, int first, int last, void **job_p)
+{
+	struct pic32mx_job *job;
+
+	if (bank->target->state != TARGET_HALTED) {
+		LOG_ERROR("Target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	job = calloc(1, sizeof(*job));
+	if (job == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	job->erase = true;
+	job->sector = first;
+	job->last = last;
+	if ((first == 0) && (last == (bank->num_sectors - 1))
+		&& (Virt2Phys(bank->base) == PIC32MX_PHYS_PGM_FLASH))
+		job->sector = -1;
+
+	pic32mx_erase_job_start(bank, job);
+
+	*job_p = job;
+	return ERROR_OK;
+}
+
+static int pic32mx_write_start(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count, void **job_p)
+{
+	struct pic32mx_job *job;
+	int retval;
+
+	if (bank->target->state != TARGET_HALTED) {
+		LOG_ERROR("Target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	if (offset & 0x3) {
+		LOG_WARNING("offset 0x%" PRIx32 "breaks required 4-byte alignment", offset);
+		return ERROR_FLASH_DST_BREAKS_ALIGNMENT;
+	}
+
+	/* trailing bytes are programmed word by word, leave them to
+	 * pic32mx_write() */
+	if (count < 4 || (count & 0x3))
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	job = calloc(1, sizeof(*job));
+	if (job == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	retval = pic32mx_write_block_init(bank, buffer, offset, count / 4, &job->write);
+	if (retval != ERROR_OK) {
+		free(job);
+		return retval;
+	}
+
+	retval = pic32mx_write_block_start(bank, &job->write);
+	if (retval != ERROR_OK) {
+		pic32mx_write_block_free(bank, &job->write);
+		free(job);
+		return retval;
+	}
+
+	*job_p = job;
+	return ERROR_OK;
+}
+
+static int pic32mx_job_wait(struct flash_bank *bank, void *job_p, bool *done)
+{
+	struct pic32mx_job *job = job_p;
+	int retval = ERROR_OK;
+
+	*done = false;
+
+	if (job->erase) {
+		uint32_t status = pic32mx_nvm_finish(bank, job->sector < 0 ? 50 : 10);
+
+		if (status & (NVMCON_NVMERR | NVMCON_LVDERR))
+			retval = ERROR_FLASH_OPERATION_FAILED;
+		else if (job->sector >= 0 && job->sector < job->last) {
+			bank->sectors[job->sector++].is_erased = 1;
+			pic32mx_erase_job_start(bank, job);
+			return ERROR_OK;
+		} else if (job->sector >= 0)
+			bank->sectors[job->sector].is_erased = 1;
+	} else {
+		retval = pic32mx_write_block_wait(bank, &job->write);
+		if (retval == ERROR_OK && job->write.count > 0) {
+			retval = pic32mx_write_block_start(bank, &job->write);
+			if (retval == ERROR_OK)
+				return ERROR_OK;
+		}
+		pic32mx_write_block_free(bank, &job->write);
+	}
+
+	free(job);
+	*done = true;
+	return retval;
+}
+
 static int pic32mx_probe(struct flash_bank *bank)
 {
 	struct target *target = bank->target;
@@ -927,6 +1138,9 @@ struct flash_driver pic32mx_flash = {
 	.erase = pic32mx_erase,
 	.protect = pic32mx_protect,
 	.write = pic32mx_write,
+	.erase_start = pic32mx_erase_start,
+	.write_start = pic32mx_write_start,
+	.job_wait = pic32mx_job_wait,
 	.read = default_flash_read,
 	.probe = pic32mx_probe,
 	.auto_probe = pic32mx_auto_probe,
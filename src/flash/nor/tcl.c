@@ -340,30 +340,31 @@ COMMAND_HANDLER(handle_flash_protect_command)
 	return retval;
 }
 
-COMMAND_HANDLER(handle_flash_write_image_command)
+/* parse the leading [erase] [unlock] [delta] options of write_image */
+static COMMAND_HELPER(flash_write_image_options, int *auto_erase,
+	bool *auto_unlock, bool *delta)
 {
-	struct target *target = get_current_target(CMD_CTX);
-
-	struct image image;
-	uint32_t written;
-
-	int retval;
-
 	/* flash auto-erase is disabled by default*/
-	int auto_erase = 0;
-	bool auto_unlock = false;
+	*auto_erase = 0;
+	*auto_unlock = false;
+	*delta = false;
 
 	while (CMD_ARGC) {
 		if (strcmp(CMD_ARGV[0], "erase") == 0) {
-			auto_erase = 1;
+			*auto_erase = 1;
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD_CTX, "auto erase enabled");
 		} else if (strcmp(CMD_ARGV[0], "unlock") == 0) {
-			auto_unlock = true;
+			*auto_unlock = true;
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD_CTX, "auto unlock enabled");
+		} else if (strcmp(CMD_ARGV[0], "delta") == 0) {
+			*delta = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD_CTX, "delta mode enabled");
 		} else
 			break;
 	}
@@ -371,6 +372,44 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	if (CMD_ARGC < 1)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	return ERROR_OK;
+}
+
+/* open the image named by the "filename [offset [file_type]]" arguments */
+static COMMAND_HELPER(flash_write_image_open, struct image *image)
+{
+	if (CMD_ARGC >= 2) {
+		image->base_address_set = 1;
+		COMMAND_PARSE_NUMBER(llong, CMD_ARGV[1], image->base_address);
+	} else {
+		image->base_address_set = 0;
+		image->base_address = 0x0;
+	}
+
+	image->start_address_set = 0;
+
+	return image_open(image, CMD_ARGV[0], (CMD_ARGC == 3) ? CMD_ARGV[2] : NULL);
+}
+
+COMMAND_HANDLER(handle_flash_write_image_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	struct image image;
+	uint32_t written;
+	uint32_t skipped;
+
+	int retval;
+
+	int auto_erase;
+	bool auto_unlock;
+	bool delta;
+
+	retval = CALL_COMMAND_HANDLER(flash_write_image_options,
+			&auto_erase, &auto_unlock, &delta);
+	if (retval != ERROR_OK)
+		return retval;
+
 	if (!target) {
 		LOG_ERROR("no target selected");
 		return ERROR_FAIL;
@@ -379,21 +418,12 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	struct duration bench;
 	duration_start(&bench);
 
-	if (CMD_ARGC >= 2) {
-		image.base_address_set = 1;
-		COMMAND_PARSE_NUMBER(llong, CMD_ARGV[1], image.base_address);
-	} else {
-		image.base_address_set = 0;
-		image.base_address = 0x0;
-	}
-
-	image.start_address_set = 0;
-
-	retval = image_open(&image, CMD_ARGV[0], (CMD_ARGC == 3) ? CMD_ARGV[2] : NULL);
+	retval = CALL_COMMAND_HANDLER(flash_write_image_open, &image);
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = flash_write_unlock(target, &image, &written, auto_erase, auto_unlock);
+	retval = flash_write_unlock_delta(target, &image, &written, &skipped,
+			auto_erase, auto_unlock, delta);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -403,6 +433,9 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 		command_print(CMD_CTX, "wrote %" PRIu32 " bytes from file %s "
 			"in %fs (%0.3f KiB/s)", written, CMD_ARGV[0],
 			duration_elapsed(&bench), duration_kbps(&bench, written));
+		if (delta)
+			command_print(CMD_CTX, "skipped %" PRIu32 " bytes of unchanged "
+				"sectors", skipped);
 	}
 
 	image_close(&image);
@@ -410,6 +443,121 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	return retval;
 }
 
+/* Write one image to the flash of several targets.  The image is only
+ * opened and decoded once; flash_gang_write() then runs the erase and
+ * write algorithms of all targets at the same time.  Delta writes
+ * checksum the sectors first and are done one target after the other.
+ * A failing target doesn't stop the others. */
+COMMAND_HANDLER(handle_flash_gang_write_image_command)
+{
+	struct image image;
+	uint32_t total_written = 0;
+	int failed = 0;
+	int retval;
+
+	int auto_erase;
+	bool auto_unlock;
+	bool delta;
+
+	if (CMD_ARGC < 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	const char *target_list = CMD_ARGV[0];
+	CMD_ARGV++;
+	CMD_ARGC--;
+
+	retval = CALL_COMMAND_HANDLER(flash_write_image_options,
+			&auto_erase, &auto_unlock, &delta);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* look up all targets before touching any of them */
+	char *names = strdup(target_list);
+	struct target **targets = calloc(strlen(target_list) / 2 + 1, sizeof(*targets));
+	if (names == NULL || targets == NULL) {
+		LOG_ERROR("Out of memory");
+		free(targets);
+		free(names);
+		return ERROR_FAIL;
+	}
+	int i, num_targets = 0;
+	char *name;
+	for (name = strtok(names, " \t,"); name; name = strtok(NULL, " \t,")) {
+		targets[num_targets] = get_target(name);
+		if (targets[num_targets] == NULL) {
+			LOG_ERROR("target '%s' not defined", name);
+			free(targets);
+			free(names);
+			return ERROR_FAIL;
+		}
+		num_targets++;
+	}
+	free(names);
+
+	struct duration bench;
+	duration_start(&bench);
+
+	retval = CALL_COMMAND_HANDLER(flash_write_image_open, &image);
+	if (retval != ERROR_OK) {
+		free(targets);
+		return retval;
+	}
+
+	int *retvals = calloc(num_targets, sizeof(*retvals));
+	uint32_t *written = calloc(num_targets, sizeof(*written));
+	uint32_t *skipped = calloc(num_targets, sizeof(*skipped));
+	if (retvals == NULL || written == NULL || skipped == NULL) {
+		LOG_ERROR("Out of memory");
+		retval = ERROR_FAIL;
+	} else if (delta) {
+		for (i = 0; i < num_targets; i++)
+			retvals[i] = flash_write_unlock_delta(targets[i], &image,
+					&written[i], &skipped[i], auto_erase, auto_unlock, delta);
+	} else
+		retval = flash_gang_write(targets, num_targets, &image,
+				auto_erase, auto_unlock, retvals, written);
+
+	for (i = 0; retval == ERROR_OK && i < num_targets; i++) {
+		const char *target_id = target_name(targets[i]);
+
+		if (retvals[i] != ERROR_OK) {
+			command_print(CMD_CTX, "%s: programming failed", target_id);
+			failed++;
+			continue;
+		}
+
+		if (delta)
+			command_print(CMD_CTX, "%s: wrote %" PRIu32 " bytes, skipped %"
+				PRIu32 " bytes of unchanged sectors", target_id, written[i], skipped[i]);
+		else
+			command_print(CMD_CTX, "%s: wrote %" PRIu32 " bytes", target_id, written[i]);
+		total_written += written[i];
+	}
+
+	free(skipped);
+	free(written);
+	free(retvals);
+
+	if (retval == ERROR_OK && duration_measure(&bench) == ERROR_OK) {
+		command_print(CMD_CTX, "wrote %" PRIu32 " bytes from file %s "
+			"in %fs (%0.3f KiB/s)", total_written, CMD_ARGV[0],
+			duration_elapsed(&bench), duration_kbps(&bench, total_written));
+	}
+
+	free(targets);
+	image_close(&image);
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (failed) {
+		LOG_ERROR("programming failed on %d target(s)", failed);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_flash_fill_command)
 {
 	int err = ERROR_OK;
@@ -701,11 +849,21 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.name = "write_image",
 		.handler = handle_flash_write_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "[erase] [unlock] filename [offset [file_type]]",
+		.usage = "[erase] [unlock] [delta] filename [offset [file_type]]",
 		.help = "Write an image to flash.  Optionally first unprotect "
-			"and/or erase the region to be used.  Allow optional "
+			"and/or erase the region to be used, or only erase and "
+			"write the sectors whose contents differ.  Allow optional "
 			"offset from beginning of bank (defaults to zero)",
 	},
+	{
+		.name = "gang_write_image",
+		.handler = handle_flash_gang_write_image_command,
+		.mode = COMMAND_EXEC,
+		.usage = "target_list [erase] [unlock] [delta] filename "
+			"[offset [file_type]]",
+		.help = "Write an image to the flash of each of the listed "
+			"targets, decoding it only once.",
+	},
 	{
 		.name = "protect",
 		.handler = handle_flash_protect_command,
@@ -871,6 +1029,29 @@ COMMAND_HANDLER(handle_flash_init_command)
 	return flash_init_drivers(CMD_CTX);
 }
 
+COMMAND_HANDLER(handle_flash_crc_cache_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		const char *filename = CMD_ARGV[0];
+		if (strcmp(filename, "off") == 0)
+			filename = NULL;
+		int retval = flash_crc_cache_open(filename);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	const char *filename = flash_crc_cache_filename();
+	if (filename)
+		command_print(CMD_CTX, "flash checksum cache: %s", filename);
+	else
+		command_print(CMD_CTX, "flash checksum cache: off");
+
+	return ERROR_OK;
+}
+
 static const struct command_registration flash_config_command_handlers[] = {
 	{
 		.name = "bank",
@@ -900,6 +1081,15 @@ static const struct command_registration flash_config_command_handlers[] = {
 		.jim_handler = jim_flash_list,
 		.help = "Returns a list of details about the flash banks.",
 	},
+	{
+		.name = "crc_cache",
+		.mode = COMMAND_ANY,
+		.handler = handle_flash_crc_cache_command,
+		.usage = "[filename|'off']",
+		.help = "Remember the checksums of programmed sectors in a "
+			"file, so delta writes can confirm unchanged sectors "
+			"in bulk.",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 static const struct command_registration flash_command_handlers[] = {
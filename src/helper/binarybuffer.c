@@ -371,14 +371,33 @@ void bit_copy_discard(struct bit_copy_queue *q)
 	}
 }
 
+/* value of a hex digit, or -1 if c isn't one */
+static inline int hex_digit_value(unsigned char c)
+{
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+
+	c |= 0x20;	/* lower case */
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+
+	return -1;
+}
+
+/* These sit on the GDB memory read/write path for every byte transferred,
+ * so they avoid going through sscanf()/snprintf() per byte. */
 int unhexify(char *bin, const char *hex, int count)
 {
-	int i, tmp;
+	int i;
 
 	for (i = 0; i < count; i++) {
-		if (sscanf(hex + (2 * i), "%02x", &tmp) != 1)
+		int hi = hex_digit_value(hex[2 * i]);
+		if (hi < 0)
+			return i;
+		int lo = hex_digit_value(hex[2 * i + 1]);
+		if (lo < 0)
 			return i;
-		bin[i] = tmp;
+		bin[i] = (hi << 4) | lo;
 	}
 
 	return i;
@@ -386,14 +405,21 @@ int unhexify(char *bin, const char *hex, int count)
 
 int hexify(char *hex, const char *bin, int count, int out_maxlen)
 {
+	static const char hex_digits[] = "0123456789abcdef";
 	int i, cmd_len = 0;
 
 	/* May use a length, or a null-terminated string as input. */
 	if (count == 0)
 		count = strlen(bin);
 
-	for (i = 0; i < count; i++)
-		cmd_len += snprintf(hex + cmd_len, out_maxlen - cmd_len, "%02x", bin[i] & 0xff);
+	/* always leave room for the terminating zero */
+	for (i = 0; (i < count) && (cmd_len + 2 < out_maxlen); i++) {
+		hex[cmd_len++] = hex_digits[(bin[i] >> 4) & 0xf];
+		hex[cmd_len++] = hex_digits[bin[i] & 0xf];
+	}
+
+	if (cmd_len < out_maxlen)
+		hex[cmd_len] = '\0';
 
 	return cmd_len;
 }
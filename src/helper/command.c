@@ -146,31 +146,22 @@ void script_debug(Jim_Interp *interp, const char *name,
 	free(dbg);
 }
 
-static void script_command_args_free(char **words, unsigned nwords)
-{
-	for (unsigned i = 0; i < nwords; i++)
-		free(words[i]);
-	free(words);
-}
+/* handlers with up to this many words get them passed on the stack */
+#define SCRIPT_COMMAND_WORDS	16
 
-static char **script_command_args_alloc(
-	unsigned argc, Jim_Obj * const *argv, unsigned *nwords)
+/* The words are the string representations of the Jim objects, which
+ * stay valid as long as the caller holds its references to argv. */
+static const char **script_command_args_get(unsigned argc,
+	Jim_Obj * const *argv, const char **words)
 {
-	char **words = malloc(argc * sizeof(char *));
-	if (NULL == words)
-		return NULL;
-
-	unsigned i;
-	for (i = 0; i < argc; i++) {
-		int len;
-		const char *w = Jim_GetString(argv[i], &len);
-		words[i] = strdup(w);
-		if (words[i] == NULL) {
-			script_command_args_free(words, i);
+	if (argc > SCRIPT_COMMAND_WORDS) {
+		words = malloc(argc * sizeof(*words));
+		if (NULL == words)
 			return NULL;
-		}
 	}
-	*nwords = i;
+
+	for (unsigned i = 0; i < argc; i++)
+		words[i] = Jim_GetString(argv[i], NULL);
 	return words;
 }
 
@@ -197,8 +188,8 @@ static int script_command_run(Jim_Interp *interp,
 	target_call_timer_callbacks_now();
 	LOG_USER_N("%s", "");	/* Keep GDB connection alive*/
 
-	unsigned nwords;
-	char **words = script_command_args_alloc(argc, argv, &nwords);
+	const char *stack_words[SCRIPT_COMMAND_WORDS];
+	const char **words = script_command_args_get(argc, argv, stack_words);
 	if (NULL == words)
 		return JIM_ERR;
 
@@ -207,11 +198,12 @@ static int script_command_run(Jim_Interp *interp,
 		state = command_log_capture_start(interp);
 
 	struct command_context *cmd_ctx = current_command_context(interp);
-	int retval = run_command(cmd_ctx, c, (const char **)words, nwords);
+	int retval = run_command(cmd_ctx, c, words, argc);
 
 	command_log_capture_finish(state);
 
-	script_command_args_free(words, nwords);
+	if (words != stack_words)
+		free(words);
 	return command_retval_set(interp, retval);
 }
 
@@ -246,6 +238,43 @@ static struct command *command_find(struct command *head, const char *name)
 	return NULL;
 }
 
+/* Commands go away with e.g. flash banks; a lookup cached before one was
+ * freed may point to it and is only trusted while this stays the same. */
+static uintptr_t command_epoch;
+
+/* a word resolved to a subcommand: ptr1 is the command, ptr2 the epoch */
+static const Jim_ObjType command_obj_type = {
+	.name = "openocd-command",
+	.flags = JIM_TYPE_NONE,
+};
+
+/**
+ * Find the subcommand of @a parent named by @a obj.  The command found
+ * is cached in @a obj, so a script calling the same subcommand in a
+ * loop only walks the list of children the first time.
+ */
+static struct command *command_find_obj(Jim_Interp *interp,
+	struct command *parent, Jim_Obj *obj)
+{
+	struct command *c;
+
+	if (obj->typePtr == &command_obj_type &&
+			obj->internalRep.twoPtrValue.ptr2 == (void *)command_epoch) {
+		c = obj->internalRep.twoPtrValue.ptr1;
+		if (c->parent == parent)
+			return c;
+	}
+
+	c = command_find(parent->children, Jim_GetString(obj, NULL));
+	if (NULL != c) {
+		Jim_FreeIntRep(interp, obj);
+		obj->typePtr = &command_obj_type;
+		obj->internalRep.twoPtrValue.ptr1 = c;
+		obj->internalRep.twoPtrValue.ptr2 = (void *)command_epoch;
+	}
+	return c;
+}
+
 struct command *command_find_in_context(struct command_context *cmd_ctx,
 	const char *name)
 {
@@ -293,6 +322,8 @@ static void command_free(struct command *c)
 {
 	/** @todo if command has a handler, unregister its jim command! */
 
+	command_epoch++;
+
 	while (NULL != c->children) {
 		struct command *tmp = c->children;
 		c->children = tmp->next;
@@ -354,6 +385,19 @@ command_new_error:
 }
 
 static int command_unknown(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+static int command_bounce(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+
+/* private data of the command registered under the plain name */
+struct command_bouncer {
+	struct command *c;
+	uintptr_t epoch;
+	char name[];
+};
+
+static void command_bouncer_free(Jim_Interp *interp, void *priv)
+{
+	free(priv);
+}
 
 static int register_command_handler(struct command_context *cmd_ctx,
 	struct command *c)
@@ -371,17 +415,17 @@ static int register_command_handler(struct command_context *cmd_ctx,
 	if (JIM_OK != retval)
 		return retval;
 
-	/* we now need to add an overrideable proc */
-	char *override_name = alloc_printf(
-			"proc %s {args} {eval ocd_bouncer %s $args}",
-			c->name, c->name);
-	if (NULL == override_name)
+	/* The plain name runs the command the way ocd_bouncer in startup.tcl
+	 * does, and can still be overridden by a proc. */
+	struct command_bouncer *bouncer = malloc(sizeof(*bouncer) + strlen(c->name) + 1);
+	if (NULL == bouncer)
 		return JIM_ERR;
+	bouncer->c = c;
+	bouncer->epoch = command_epoch;
+	strcpy(bouncer->name, c->name);
 
-	retval = Jim_Eval_Named(interp, override_name, 0, 0);
-	free(override_name);
-
-	return retval;
+	return Jim_CreateCommand(interp, c->name, &command_bounce, bouncer,
+			&command_bouncer_free);
 }
 
 struct command *register_command(struct command_context *context,
@@ -954,19 +998,24 @@ COMMAND_HANDLER(handle_help_command)
 	return retval;
 }
 
-static int command_unknown_find(unsigned argc, Jim_Obj *const *argv,
-	struct command *head, struct command **out, bool top_level)
+static int command_unknown_find(Jim_Interp *interp, unsigned argc,
+	Jim_Obj *const *argv, struct command *head, struct command **out,
+	bool top_level)
 {
 	if (0 == argc)
 		return argc;
-	const char *cmd_name = Jim_GetString(argv[0], NULL);
-	struct command *c = command_find(head, cmd_name);
-	if (NULL == c && top_level && strncmp(cmd_name, "ocd_", 4) == 0)
-		c = command_find(head, cmd_name + 4);
+	struct command *c;
+	if (top_level) {
+		const char *cmd_name = Jim_GetString(argv[0], NULL);
+		c = command_find(head, cmd_name);
+		if (NULL == c && strncmp(cmd_name, "ocd_", 4) == 0)
+			c = command_find(head, cmd_name + 4);
+	} else
+		c = command_find_obj(interp, *out, argv[0]);
 	if (NULL == c)
 		return argc;
 	*out = c;
-	return command_unknown_find(--argc, ++argv, (*out)->children, out, false);
+	return command_unknown_find(interp, --argc, ++argv, (*out)->children, out, false);
 }
 
 static int command_unknown(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
@@ -982,7 +1031,7 @@ static int command_unknown(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 
 	struct command_context *cmd_ctx = current_command_context(interp);
 	struct command *c = cmd_ctx->commands;
-	int remaining = command_unknown_find(argc, argv, c, &c, true);
+	int remaining = command_unknown_find(interp, argc, argv, c, &c, true);
 	/* if nothing could be consumed, then it's really an unknown command */
 	if (remaining == argc) {
 		const char *cmd = Jim_GetString(argv[0], NULL);
@@ -1016,6 +1065,52 @@ static int command_unknown(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 	return script_command_run(interp, count, start, c, found);
 }
 
+static int command_bounce(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	struct command_bouncer *bouncer = interp->cmdPrivData;
+	if (bouncer->epoch != command_epoch) {
+		struct command_context *cmd_ctx = current_command_context(interp);
+		bouncer->c = command_find(cmd_ctx->commands, bouncer->name);
+		bouncer->epoch = command_epoch;
+	}
+
+	struct command *c = bouncer->c;
+	if (NULL == c) {
+		Jim_SetResultFormatted(interp, "Unknown command type: unknown");
+		return JIM_ERR;
+	}
+	script_debug(interp, bouncer->name, argc - 1, argv + 1);
+
+	int remaining = command_unknown_find(interp, argc - 1, argv + 1,
+			c->children, &c, false);
+	Jim_Obj *const *start = argv + (argc - remaining - 1);
+	unsigned count = remaining + 1;
+
+	if (c->jim_handler) {
+		interp->cmdPrivData = c->jim_handler_data;
+		return (*c->jim_handler)(interp, count, start);
+	}
+
+	if (c->handler) {
+		/* the output of 'classic' commands goes to the log, error
+		 * messages included, and the result stays empty */
+		int retval = script_command_run(interp, count, start, c, false);
+		Jim_SetEmptyResult(interp);
+		return retval;
+	}
+
+	Jim_Obj *line = Jim_ConcatObj(interp, argc, argv);
+	Jim_IncrRefCount(line);
+	char *usage = alloc_printf("ocd_usage %s", Jim_String(line));
+	if (NULL != usage) {
+		Jim_Eval(interp, usage);
+		free(usage);
+	}
+	Jim_SetResultFormatted(interp, "%#s: command requires more arguments", line);
+	Jim_DecrRefCount(interp, line);
+	return JIM_ERR;
+}
+
 static int jim_command_mode(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 {
 	struct command_context *cmd_ctx = current_command_context(interp);
@@ -1023,7 +1118,7 @@ static int jim_command_mode(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 
 	if (argc > 1) {
 		struct command *c = cmd_ctx->commands;
-		int remaining = command_unknown_find(argc - 1, argv + 1, c, &c, true);
+		int remaining = command_unknown_find(interp, argc - 1, argv + 1, c, &c, true);
 		/* if nothing could be consumed, then it's an unknown command */
 		if (remaining == argc - 1) {
 			Jim_SetResultString(interp, "unknown", -1);
@@ -1059,7 +1154,7 @@ static int jim_command_type(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 
 	struct command_context *cmd_ctx = current_command_context(interp);
 	struct command *c = cmd_ctx->commands;
-	int remaining = command_unknown_find(argc - 1, argv + 1, c, &c, true);
+	int remaining = command_unknown_find(interp, argc - 1, argv + 1, c, &c, true);
 	/* if nothing could be consumed, then it's an unknown command */
 	if (remaining == argc - 1) {
 		Jim_SetResultString(interp, "unknown", -1);
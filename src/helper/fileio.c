@@ -32,12 +32,17 @@
 #include "configuration.h"
 #include "fileio.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 struct fileio_internal {
 	char *url;
 	ssize_t size;
 	enum fileio_type type;
 	enum fileio_access access;
 	FILE *file;
+	void *map;		/* read-only mapping of the whole file, if any */
 };
 
 static inline int fileio_close_local(struct fileio_internal *fileio);
@@ -113,6 +118,7 @@ int fileio_open(struct fileio *fileio_p,
 	fileio->type = type;
 	fileio->access = access_type;
 	fileio->url = strdup(url);
+	fileio->map = NULL;
 
 	retval = fileio_open_local(fileio);
 
@@ -139,6 +145,11 @@ int fileio_close(struct fileio *fileio_p)
 	int retval;
 	struct fileio_internal *fileio = fileio_p->fp;
 
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->map)
+		munmap(fileio->map, fileio->size);
+#endif
+
 	retval = fileio_close_local(fileio);
 
 	free(fileio->url);
@@ -178,6 +189,39 @@ int fileio_read(struct fileio *fileio_p, size_t size, void *buffer,
 	return fileio_local_read(fileio, size, buffer, size_read);
 }
 
+/**
+ * Map the whole file read-only into memory, so callers can use its
+ * contents in place instead of copying them out with fileio_read().
+ * The mapping stays valid until fileio_close().
+ *
+ * @returns ERROR_FILEIO_OPERATION_NOT_SUPPORTED when the host can't map
+ * this file; callers are expected to fall back to fileio_read().
+ */
+int fileio_map(struct fileio *fileio_p, const uint8_t **data)
+{
+	struct fileio_internal *fileio = fileio_p->fp;
+
+#ifdef HAVE_SYS_MMAN_H
+	if (!fileio->map) {
+		if (fileio->access != FILEIO_READ || fileio->size <= 0)
+			return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+		void *map = mmap(NULL, fileio->size, PROT_READ, MAP_PRIVATE,
+				fileno(fileio->file), 0);
+		if (map == MAP_FAILED) {
+			LOG_DEBUG("couldn't map %s: %s", fileio->url, strerror(errno));
+			return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+		}
+		fileio->map = map;
+	}
+
+	*data = fileio->map;
+	return ERROR_OK;
+#else
+	return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+#endif
+}
+
 int fileio_read_u32(struct fileio *fileio_p, uint32_t *data)
 {
 	uint8_t buf[4];
@@ -59,6 +59,7 @@ int fileio_read(struct fileio *fileio,
 		size_t size, void *buffer, size_t *size_read);
 int fileio_write(struct fileio *fileio,
 		size_t size, const void *buffer, size_t *size_written);
+int fileio_map(struct fileio *fileio, const uint8_t **data);
 
 int fileio_read_u32(struct fileio *fileio, uint32_t *data);
 int fileio_write_u32(struct fileio *fileio, uint32_t data);
@@ -29,6 +29,7 @@
 #endif
 
 #include "time_support.h"
+#include "log_ring.h"
 /* @todo the inclusion of server.h here is a layering violation */
 #include <server/server.h>
 
@@ -179,6 +180,11 @@ void log_printf(enum log_levels level,
 	va_list ap;
 
 	count++;
+	if (level <= log_ring_level) {
+		va_start(ap, format);
+		log_ring_record(level, count, timeval_ms() - start, file, line, function, format, ap);
+		va_end(ap);
+	}
 	if (level > debug_level)
 		return;
 
@@ -204,6 +210,11 @@ void log_printf_lf(enum log_levels level,
 	va_list ap;
 
 	count++;
+	if (level <= log_ring_level) {
+		va_start(ap, format);
+		log_ring_record(level, count, timeval_ms() - start, file, line, function, format, ap);
+		va_end(ap);
+	}
 	if (level > debug_level)
 		return;
 
@@ -250,6 +261,138 @@ COMMAND_HANDLER(handle_log_output_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_log_ring_size_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned kbytes;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], kbytes);
+		if (log_ring_resize((size_t)kbytes * 1024) != ERROR_OK) {
+			LOG_ERROR("can't allocate a log ring of %u KiB", kbytes);
+			return ERROR_FAIL;
+		}
+	}
+
+	command_print(CMD_CTX, "log ring: %u KiB", (unsigned)(log_ring_size() / 1024));
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_log_ring_level_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		int level;
+		COMMAND_PARSE_NUMBER(int, CMD_ARGV[0], level);
+		if ((level > LOG_LVL_DEBUG) || (level < LOG_LVL_SILENT)) {
+			LOG_ERROR("level must be between %d and %d", LOG_LVL_SILENT, LOG_LVL_DEBUG);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+		log_ring_set_level(level);
+	}
+
+	command_print(CMD_CTX, "log ring level: %i", log_ring_get_level());
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_log_ring_filter_command)
+{
+	const char *prefix;
+	int level;
+
+	if (CMD_ARGC == 2) {
+		COMMAND_PARSE_NUMBER(int, CMD_ARGV[1], level);
+		int retval = log_ring_set_filter(CMD_ARGV[0], level);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("can't add log ring filter '%s'", CMD_ARGV[0]);
+			return retval;
+		}
+	} else if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	for (unsigned i = 0; (prefix = log_ring_get_filter(i, &level)) != NULL; i++)
+		command_print(CMD_CTX, "%s*: %i", prefix, level);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_log_ring_dump_command)
+{
+	FILE *out = log_output;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		out = fopen(CMD_ARGV[0], "w");
+		if (out == NULL) {
+			LOG_ERROR("can't open %s", CMD_ARGV[0]);
+			return ERROR_FAIL;
+		}
+	}
+
+	log_ring_dump(out);
+
+	if (out != log_output)
+		fclose(out);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_log_ring_clear_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	log_ring_clear();
+	return ERROR_OK;
+}
+
+static const struct command_registration log_ring_command_handlers[] = {
+	{
+		.name = "size",
+		.handler = handle_log_ring_size_command,
+		.mode = COMMAND_ANY,
+		.help = "Sets the size of the log ring in KiB, 0 (default) "
+			"turns it off. Drops its contents.",
+		.usage = "[kbytes]",
+	},
+	{
+		.name = "level",
+		.handler = handle_log_ring_level_command,
+		.mode = COMMAND_ANY,
+		.help = "Sets the verbosity level captured in the log ring, "
+			"independent of debug_level (default 3).",
+		.usage = "[number]",
+	},
+	{
+		.name = "filter",
+		.handler = handle_log_ring_filter_command,
+		.mode = COMMAND_ANY,
+		.help = "Limits capturing of messages from source files "
+			"starting with prefix to the given level, or lists the limits.",
+		.usage = "[prefix level]",
+	},
+	{
+		.name = "dump",
+		.handler = handle_log_ring_dump_command,
+		.mode = COMMAND_ANY,
+		.help = "Formats the captured messages, oldest first, "
+			"to the log output or a file.",
+		.usage = "[file_name]",
+	},
+	{
+		.name = "clear",
+		.handler = handle_log_ring_clear_command,
+		.mode = COMMAND_ANY,
+		.help = "Drops the captured messages.",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static struct command_registration log_command_handlers[] = {
 	{
 		.name = "log_output",
@@ -267,6 +410,13 @@ static struct command_registration log_command_handlers[] = {
 			"2 (default) adds other info; 3 adds debugging.",
 		.usage = "number",
 	},
+	{
+		.name = "log_ring",
+		.mode = COMMAND_ANY,
+		.help = "in memory capture of log messages, formatted on demand",
+		.usage = "",
+		.chain = log_ring_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
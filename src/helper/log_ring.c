@@ -0,0 +1,534 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "log.h"
+#include "log_ring.h"
+
+#include <ctype.h>
+#include <stddef.h>
+
+#define LOG_RING_DATA_SIZE		200
+#define LOG_RING_MAX_FILTERS	16
+#define LOG_RING_FILTER_CACHE	64
+
+/* one message: format and arguments, or its text when format is NULL */
+struct log_ring_entry {
+	const char *file;
+	const char *function;
+	const char *format;
+	int64_t time;
+	uint32_t count;
+	uint32_t line;
+	int level;
+	uint8_t data[LOG_RING_DATA_SIZE];
+};
+
+enum log_ring_arg {
+	LOG_RING_INT,
+	LOG_RING_LONG,
+	LOG_RING_LLONG,
+	LOG_RING_INTMAX,
+	LOG_RING_SIZE,
+	LOG_RING_PTRDIFF,
+	LOG_RING_DOUBLE,
+	LOG_RING_STRING,
+	LOG_RING_POINTER,
+	LOG_RING_UNSUPPORTED,
+};
+
+/* one printf conversion specification */
+struct log_ring_conv {
+	const char *start;		/* its '%' */
+	size_t len;
+	int stars;				/* '*' width and precision arguments */
+	enum log_ring_arg arg;
+	bool is_unsigned;
+};
+
+struct log_ring_filter {
+	char prefix[32];
+	int level;
+};
+
+int log_ring_level = LOG_LVL_SILENT;
+static int log_ring_capture_level = LOG_LVL_DEBUG;
+
+static struct log_ring_entry *ring;
+static uint32_t ring_entries;
+static uint64_t ring_written;
+
+static struct log_ring_filter filters[LOG_RING_MAX_FILTERS];
+static unsigned num_filters;
+
+/* level limit by __FILE__ pointer, to not match prefixes on every message */
+static struct {
+	const char *file;
+	int level;
+} filter_cache[LOG_RING_FILTER_CACHE];
+
+static const char *log_ring_basename(const char *file)
+{
+	const char *f = strrchr(file, '/');
+	return f ? f + 1 : file;
+}
+
+static int log_ring_file_level(const char *file)
+{
+	unsigned slot = ((uintptr_t)file >> 3) % LOG_RING_FILTER_CACHE;
+
+	if (filter_cache[slot].file == file)
+		return filter_cache[slot].level;
+
+	const char *name = log_ring_basename(file);
+	size_t best = 0;
+	int level = log_ring_capture_level;
+
+	for (unsigned i = 0; i < num_filters; i++) {
+		size_t len = strlen(filters[i].prefix);
+		if (len > best && strncmp(name, filters[i].prefix, len) == 0) {
+			best = len;
+			level = filters[i].level;
+		}
+	}
+
+	filter_cache[slot].file = file;
+	filter_cache[slot].level = level;
+	return level;
+}
+
+int log_ring_set_filter(const char *prefix, int level)
+{
+	unsigned i;
+
+	if (strlen(prefix) >= sizeof(filters[0].prefix))
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	for (i = 0; i < num_filters; i++) {
+		if (strcmp(filters[i].prefix, prefix) == 0)
+			break;
+	}
+	if (i == num_filters) {
+		if (num_filters == LOG_RING_MAX_FILTERS)
+			return ERROR_FAIL;
+		strcpy(filters[num_filters++].prefix, prefix);
+	}
+	filters[i].level = level;
+
+	memset(filter_cache, 0, sizeof(filter_cache));
+	return ERROR_OK;
+}
+
+const char *log_ring_get_filter(unsigned i, int *level)
+{
+	if (i >= num_filters)
+		return NULL;
+
+	*level = filters[i].level;
+	return filters[i].prefix;
+}
+
+void log_ring_set_level(int level)
+{
+	log_ring_capture_level = level;
+	if (ring)
+		log_ring_level = level;
+	memset(filter_cache, 0, sizeof(filter_cache));
+}
+
+int log_ring_get_level(void)
+{
+	return log_ring_capture_level;
+}
+
+int log_ring_resize(size_t bytes)
+{
+	free(ring);
+	ring = NULL;
+	ring_entries = 0;
+	ring_written = 0;
+	log_ring_level = LOG_LVL_SILENT;
+
+	if (bytes == 0)
+		return ERROR_OK;
+
+	ring_entries = bytes / sizeof(struct log_ring_entry);
+	if (ring_entries < 16)
+		ring_entries = 16;
+
+	ring = malloc(ring_entries * sizeof(struct log_ring_entry));
+	if (ring == NULL) {
+		ring_entries = 0;
+		return ERROR_FAIL;
+	}
+
+	log_ring_level = log_ring_capture_level;
+	return ERROR_OK;
+}
+
+size_t log_ring_size(void)
+{
+	return ring_entries * sizeof(struct log_ring_entry);
+}
+
+void log_ring_clear(void)
+{
+	ring_written = 0;
+}
+
+/* parse the conversion specification following the '%' at conv->start */
+static const char *log_ring_parse(struct log_ring_conv *conv)
+{
+	const char *p = conv->start + 1;
+	int longs = 0;
+	char mod = 0;
+
+	conv->stars = 0;
+	conv->is_unsigned = false;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		conv->stars++;
+		p++;
+	} else {
+		while (isdigit((unsigned char)*p))
+			p++;
+	}
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			conv->stars++;
+			p++;
+		} else {
+			while (isdigit((unsigned char)*p))
+				p++;
+		}
+	}
+	for (;; p++) {
+		if (*p == 'l')
+			longs++;
+		else if (*p && strchr("hjztLq", *p))
+			mod = *p;
+		else
+			break;
+	}
+
+	conv->arg = LOG_RING_UNSUPPORTED;
+	switch (*p) {
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			conv->is_unsigned = true;
+			/* fall through */
+		case 'd':
+		case 'i':
+			if (longs >= 2 || mod == 'q')
+				conv->arg = LOG_RING_LLONG;
+			else if (longs == 1)
+				conv->arg = LOG_RING_LONG;
+			else if (mod == 'j')
+				conv->arg = LOG_RING_INTMAX;
+			else if (mod == 'z')
+				conv->arg = LOG_RING_SIZE;
+			else if (mod == 't')
+				conv->arg = LOG_RING_PTRDIFF;
+			else if (mod != 'L')
+				conv->arg = LOG_RING_INT;
+			break;
+		case 'c':
+			if (longs == 0)
+				conv->arg = LOG_RING_INT;
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (mod != 'L')
+				conv->arg = LOG_RING_DOUBLE;
+			break;
+		case 's':
+			if (longs == 0)
+				conv->arg = LOG_RING_STRING;
+			break;
+		case 'p':
+			conv->arg = LOG_RING_POINTER;
+			break;
+	}
+
+	if (*p)
+		p++;
+	conv->len = p - conv->start;
+	return p;
+}
+
+void log_ring_record(int level, unsigned count, int64_t time,
+		const char *file, unsigned line, const char *function,
+		const char *format, va_list ap)
+{
+	if (ring == NULL)
+		return;
+	if (num_filters && level > log_ring_file_level(file))
+		return;
+
+	/* skip the empty messages sent to keep GDB connections alive */
+	if (format[0] == 0)
+		return;
+	if (strcmp(format, "%s") == 0) {
+		va_list aq;
+		va_copy(aq, ap);
+		const char *s = va_arg(aq, const char *);
+		va_end(aq);
+		if (s != NULL && s[0] == 0)
+			return;
+	}
+
+	struct log_ring_entry *entry = &ring[ring_written++ % ring_entries];
+	struct log_ring_conv conv;
+	const char *p = format;
+	size_t pos = 0;
+	va_list aq;
+
+	entry->file = file;
+	entry->function = function;
+	entry->format = format;
+	entry->time = time;
+	entry->count = count;
+	entry->line = line;
+	entry->level = level;
+
+	va_copy(aq, ap);
+
+	while ((p = strchr(p, '%')) != NULL) {
+		if (p[1] == '%') {
+			p += 2;
+			continue;
+		}
+		conv.start = p;
+		p = log_ring_parse(&conv);
+
+		/* integers and doubles take 8 bytes, strings a length and their text */
+		uint64_t value = 0;
+		double d;
+		for (int i = 0; i < conv.stars; i++) {
+			int64_t star = va_arg(aq, int);
+			if (pos + 8 > LOG_RING_DATA_SIZE)
+				goto text;
+			memcpy(entry->data + pos, &star, 8);
+			pos += 8;
+		}
+		switch (conv.arg) {
+			case LOG_RING_INT:
+				value = conv.is_unsigned ? va_arg(aq, unsigned) : (uint64_t)va_arg(aq, int);
+				break;
+			case LOG_RING_LONG:
+				value = conv.is_unsigned ? va_arg(aq, unsigned long) : (uint64_t)va_arg(aq, long);
+				break;
+			case LOG_RING_LLONG:
+				value = conv.is_unsigned ? va_arg(aq, unsigned long long) :
+					(uint64_t)va_arg(aq, long long);
+				break;
+			case LOG_RING_INTMAX:
+				value = conv.is_unsigned ? va_arg(aq, uintmax_t) : (uint64_t)va_arg(aq, intmax_t);
+				break;
+			case LOG_RING_SIZE:
+				value = va_arg(aq, size_t);
+				break;
+			case LOG_RING_PTRDIFF:
+				value = va_arg(aq, ptrdiff_t);
+				break;
+			case LOG_RING_DOUBLE:
+				d = va_arg(aq, double);
+				memcpy(&value, &d, 8);
+				break;
+			case LOG_RING_POINTER:
+				value = (uintptr_t)va_arg(aq, void *);
+				break;
+			case LOG_RING_STRING:
+			{
+				const char *s = va_arg(aq, const char *);
+				uint16_t len;
+
+				if (s == NULL)
+					s = "(null)";
+				if (pos + sizeof(len) > LOG_RING_DATA_SIZE)
+					goto text;
+				len = strnlen(s, LOG_RING_DATA_SIZE - pos - sizeof(len));
+				memcpy(entry->data + pos, &len, sizeof(len));
+				memcpy(entry->data + pos + sizeof(len), s, len);
+				pos += sizeof(len) + len;
+				continue;
+			}
+			default:
+				goto text;
+		}
+		if (pos + 8 > LOG_RING_DATA_SIZE)
+			goto text;
+		memcpy(entry->data + pos, &value, 8);
+		pos += 8;
+	}
+
+	va_end(aq);
+	return;
+
+text:
+	/* too many arguments or an odd conversion, format right away */
+	va_end(aq);
+	entry->format = NULL;
+	vsnprintf((char *)entry->data, LOG_RING_DATA_SIZE, format, ap);
+}
+
+static void log_ring_print(FILE *out, struct log_ring_entry *entry)
+{
+	struct log_ring_conv conv;
+	const char *format = entry->format;
+	const char *p = format;
+	size_t pos = 0;
+
+	if (format == NULL) {
+		fputs((char *)entry->data, out);
+		return;
+	}
+
+	while (*p) {
+		const char *next = strchr(p, '%');
+		if (next == NULL) {
+			fputs(p, out);
+			break;
+		}
+		fwrite(p, 1, next - p, out);
+		if (next[1] == '%') {
+			fputc('%', out);
+			p = next + 2;
+			continue;
+		}
+
+		conv.start = next;
+		p = log_ring_parse(&conv);
+
+		/* rebuild the conversion with '*' replaced by the recorded values */
+		char spec[64];
+		size_t len = 0;
+		for (const char *c = conv.start; c < p && len < sizeof(spec) - 24; c++) {
+			if (*c == '*') {
+				int64_t star;
+				memcpy(&star, entry->data + pos, 8);
+				pos += 8;
+				len += sprintf(spec + len, "%d", (int)star);
+			} else
+				spec[len++] = *c;
+		}
+		spec[len] = 0;
+
+		uint64_t value = 0;
+		double d;
+		if (conv.arg != LOG_RING_STRING) {
+			memcpy(&value, entry->data + pos, 8);
+			pos += 8;
+		}
+		switch (conv.arg) {
+			case LOG_RING_INT:
+				if (conv.is_unsigned)
+					fprintf(out, spec, (unsigned)value);
+				else
+					fprintf(out, spec, (int)value);
+				break;
+			case LOG_RING_LONG:
+				if (conv.is_unsigned)
+					fprintf(out, spec, (unsigned long)value);
+				else
+					fprintf(out, spec, (long)value);
+				break;
+			case LOG_RING_LLONG:
+				if (conv.is_unsigned)
+					fprintf(out, spec, (unsigned long long)value);
+				else
+					fprintf(out, spec, (long long)value);
+				break;
+			case LOG_RING_INTMAX:
+				if (conv.is_unsigned)
+					fprintf(out, spec, (uintmax_t)value);
+				else
+					fprintf(out, spec, (intmax_t)value);
+				break;
+			case LOG_RING_SIZE:
+				fprintf(out, spec, (size_t)value);
+				break;
+			case LOG_RING_PTRDIFF:
+				fprintf(out, spec, (ptrdiff_t)value);
+				break;
+			case LOG_RING_DOUBLE:
+				memcpy(&d, &value, 8);
+				fprintf(out, spec, d);
+				break;
+			case LOG_RING_POINTER:
+				fprintf(out, spec, (void *)(uintptr_t)value);
+				break;
+			case LOG_RING_STRING:
+			{
+				uint16_t slen;
+				char s[LOG_RING_DATA_SIZE];
+
+				memcpy(&slen, entry->data + pos, sizeof(slen));
+				memcpy(s, entry->data + pos + sizeof(slen), slen);
+				s[slen] = 0;
+				pos += sizeof(slen) + slen;
+				fprintf(out, spec, s);
+				break;
+			}
+			default:
+				break;
+		}
+	}
+}
+
+void log_ring_dump(FILE *out)
+{
+	static const char *const level_strings[] = {
+		"User : ", "Error: ", "Warn : ", "Info : ", "Debug: "
+	};
+	uint64_t first = 0;
+
+	if (ring_written > ring_entries)
+		first = ring_written - ring_entries;
+
+	for (uint64_t i = first; i < ring_written; i++) {
+		struct log_ring_entry *entry = &ring[i % ring_entries];
+
+		if (entry->level >= LOG_LVL_USER)
+			fprintf(out, "%s%" PRIu32 " %" PRId64 " %s:%" PRIu32 " %s(): ",
+					level_strings[entry->level + 1], entry->count, entry->time,
+					log_ring_basename(entry->file), entry->line, entry->function);
+		log_ring_print(out, entry);
+
+		/* messages logged without a newline still get their own line */
+		const char *end = entry->format ? entry->format : (char *)entry->data;
+		if (*end == 0 || end[strlen(end) - 1] != '\n')
+			fputc('\n', out);
+	}
+
+	fflush(out);
+}
@@ -0,0 +1,71 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * The log ring keeps the most recent log messages in memory without
+ * formatting them: each message takes one fixed size slot holding the
+ * format string pointer and a binary copy of its arguments.  Text is
+ * only produced by log_ring_dump(), so messages can be captured at a
+ * higher level than the one printed for little more than the cost of
+ * copying the arguments.
+ *
+ * Format strings, file and function names are kept by pointer and must
+ * therefore be string literals, as they are for all LOG_* macros.
+ * String arguments are copied, truncated to the room left in the slot.
+ */
+
+/* log_ring_level (see log.h) is the highest level captured in the ring,
+ * LOG_LVL_SILENT while it is disabled */
+
+/** Allocate a ring of about @a bytes, 0 frees it.  Drops its contents. */
+int log_ring_resize(size_t bytes);
+size_t log_ring_size(void);
+void log_ring_clear(void);
+
+/** Set the level captured while the ring is allocated. */
+void log_ring_set_level(int level);
+int log_ring_get_level(void);
+
+/**
+ * Capture messages from source files whose name starts with @a prefix
+ * (e.g. "mips32_pracc", "ftdi", "arm_adi") only up to @a level.  The
+ * longest matching prefix applies.
+ */
+int log_ring_set_filter(const char *prefix, int level);
+/** Iterate the filters; @returns the prefix of filter @a i or NULL */
+const char *log_ring_get_filter(unsigned i, int *level);
+
+/**
+ * Capture one message; @a count is its sequence number and @a time its
+ * timestamp in ms, both as shown on the console at debug level.
+ */
+void log_ring_record(int level, unsigned count, int64_t time,
+		const char *file, unsigned line, const char *function,
+		const char *format, va_list ap);
+
+/** Format all messages in the ring, oldest first, to @a out. */
+void log_ring_dump(FILE *out);
+
+#endif /* LOG_RING_H */
@@ -0,0 +1,291 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "log.h"
+#include "command.h"
+#include "metrics.h"
+#include "time_support.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+
+#define METRIC_SUB_BUCKETS	(1 << METRIC_SUB_BUCKET_BITS)
+
+/* all metrics updated so far, sorted by name */
+static struct metric *metrics;
+
+void metric_register(struct metric *metric)
+{
+	if (metric->registered)
+		return;
+
+	if (metric->histogram) {
+		metric->buckets = calloc(METRIC_BUCKETS, sizeof(*metric->buckets));
+		if (metric->buckets == NULL) {
+			/* keep counting samples, without percentiles */
+			metric->histogram = false;
+		}
+		metric->min = UINT64_MAX;
+	}
+
+	struct metric **p = &metrics;
+	while (*p && strcmp((*p)->name, metric->name) < 0)
+		p = &(*p)->next;
+	metric->next = *p;
+	*p = metric;
+	metric->registered = true;
+}
+
+/* Values below METRIC_SUB_BUCKETS get a bucket each, larger ones are
+ * split by their highest set bit and the METRIC_SUB_BUCKET_BITS below
+ * it, so a bucket is never wider than a quarter of its lower bound. */
+static unsigned metric_bucket(uint64_t value)
+{
+	if (value < METRIC_SUB_BUCKETS)
+		return value;
+
+	unsigned msb = 0;
+	for (uint64_t v = value >> 1; v; v >>= 1)
+		msb++;
+
+	unsigned sub = (value >> (msb - METRIC_SUB_BUCKET_BITS)) & (METRIC_SUB_BUCKETS - 1);
+	unsigned bucket = ((msb - METRIC_SUB_BUCKET_BITS + 1) << METRIC_SUB_BUCKET_BITS) + sub;
+	if (bucket >= METRIC_BUCKETS)
+		bucket = METRIC_BUCKETS - 1;
+	return bucket;
+}
+
+/* the largest value that falls into @a bucket */
+static uint64_t metric_bucket_limit(unsigned bucket)
+{
+	if (bucket < METRIC_SUB_BUCKETS)
+		return bucket;
+
+	unsigned msb = (bucket >> METRIC_SUB_BUCKET_BITS) + METRIC_SUB_BUCKET_BITS - 1;
+	uint64_t sub = bucket & (METRIC_SUB_BUCKETS - 1);
+	uint64_t width = (uint64_t)1 << (msb - METRIC_SUB_BUCKET_BITS);
+	return ((uint64_t)1 << msb) + sub * width + width - 1;
+}
+
+void metric_record(struct metric *metric, uint64_t value)
+{
+	if (!metric->registered)
+		metric_register(metric);
+
+	metric->count++;
+	metric->sum += value;
+	if (value < metric->min)
+		metric->min = value;
+	if (value > metric->max)
+		metric->max = value;
+	if (metric->buckets)
+		metric->buckets[metric_bucket(value)]++;
+}
+
+int64_t metric_now_us(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+uint64_t metric_percentile(struct metric *metric, double percent)
+{
+	if (metric->count == 0 || metric->buckets == NULL)
+		return 0;
+
+	uint64_t rank = (uint64_t)(metric->count * percent / 100.0 + 0.5);
+	if (rank == 0)
+		rank = 1;
+
+	uint64_t seen = 0;
+	for (unsigned i = 0; i < METRIC_BUCKETS; i++) {
+		seen += metric->buckets[i];
+		if (seen >= rank) {
+			uint64_t limit = metric_bucket_limit(i);
+			return limit < metric->max ? limit : metric->max;
+		}
+	}
+	return metric->max;
+}
+
+void metrics_reset(void)
+{
+	for (struct metric *m = metrics; m; m = m->next) {
+		m->count = 0;
+		m->sum = 0;
+		m->max = 0;
+		if (m->histogram)
+			m->min = UINT64_MAX;
+		if (m->buckets)
+			memset(m->buckets, 0, METRIC_BUCKETS * sizeof(*m->buckets));
+	}
+}
+
+/* a growing string for the JSON output */
+struct metrics_text {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+static void metrics_printf(struct metrics_text *text, const char *format, ...)
+	__attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 2, 3)));
+
+static void metrics_printf(struct metrics_text *text, const char *format, ...)
+{
+	va_list ap;
+
+	for (;;) {
+		if (text->buf) {
+			va_start(ap, format);
+			int n = vsnprintf(text->buf + text->len, text->size - text->len, format, ap);
+			va_end(ap);
+			if (n < 0)
+				return;
+			if (text->len + n < text->size) {
+				text->len += n;
+				return;
+			}
+		}
+
+		size_t size = text->size ? text->size * 2 : 1024;
+		char *buf = realloc(text->buf, size);
+		if (buf == NULL)
+			return;
+		text->buf = buf;
+		text->size = size;
+		text->buf[text->len] = 0;
+	}
+}
+
+static void metrics_json(struct metrics_text *text)
+{
+	metrics_printf(text, "{");
+	for (struct metric *m = metrics; m; m = m->next) {
+		metrics_printf(text, "%s\n  \"%s\": ", m == metrics ? "" : ",", m->name);
+		if (!m->histogram) {
+			metrics_printf(text, "%" PRIu64, m->count);
+			continue;
+		}
+		metrics_printf(text, "{\"count\": %" PRIu64 ", \"sum\": %" PRIu64
+				", \"min\": %" PRIu64 ", \"max\": %" PRIu64
+				", \"p50\": %" PRIu64 ", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64 "}",
+				m->count, m->sum, m->count ? m->min : 0, m->max,
+				metric_percentile(m, 50), metric_percentile(m, 90),
+				metric_percentile(m, 99));
+	}
+	metrics_printf(text, "\n}\n");
+}
+
+/* one line per metric whose name starts with @a prefix */
+static void metrics_list(struct metrics_text *text, const char *prefix)
+{
+	for (struct metric *m = metrics; m; m = m->next) {
+		if (strncmp(m->name, prefix, strlen(prefix)) != 0)
+			continue;
+		if (!m->histogram) {
+			metrics_printf(text, "%-28s %" PRIu64 "\n", m->name, m->count);
+			continue;
+		}
+		metrics_printf(text, "%-28s n %" PRIu64 ", avg %" PRIu64
+				", p50 %" PRIu64 ", p90 %" PRIu64 ", p99 %" PRIu64 ", max %" PRIu64 "\n",
+				m->name, m->count, m->count ? m->sum / m->count : 0,
+				metric_percentile(m, 50), metric_percentile(m, 90),
+				metric_percentile(m, 99), m->max);
+	}
+}
+
+/* The listing and the JSON object are returned as the Tcl result, so
+ * scripts can use them directly: set j [stats json] */
+static int jim_stats(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	const char *arg = argc > 1 ? Jim_GetString(argv[1], NULL) : "";
+	struct metrics_text text = { NULL, 0, 0 };
+
+	if (strcmp(arg, "reset") == 0) {
+		if (argc != 2) {
+			Jim_WrongNumArgs(interp, 1, argv, "reset");
+			return JIM_ERR;
+		}
+		metrics_reset();
+		return JIM_OK;
+	}
+
+	if (strcmp(arg, "json") == 0) {
+		if (argc > 3) {
+			Jim_WrongNumArgs(interp, 1, argv, "json [filename]");
+			return JIM_ERR;
+		}
+		metrics_json(&text);
+	} else {
+		/* plain listing, optionally limited to names starting with a prefix */
+		if (argc > 2) {
+			Jim_WrongNumArgs(interp, 1, argv, "[prefix]");
+			return JIM_ERR;
+		}
+		metrics_list(&text, arg);
+	}
+
+	/* an empty listing leaves the buffer unallocated */
+	if (text.buf == NULL) {
+		if (strcmp(arg, "json") != 0)
+			return JIM_OK;
+		Jim_SetResultString(interp, "out of memory", -1);
+		return JIM_ERR;
+	}
+
+	int retval = JIM_OK;
+	if (argc == 3) {
+		const char *filename = Jim_GetString(argv[2], NULL);
+		FILE *file = fopen(filename, "w");
+		if (file == NULL) {
+			Jim_SetResultFormatted(interp, "cannot open '%s' for writing", filename);
+			retval = JIM_ERR;
+		} else {
+			fputs(text.buf, file);
+			fclose(file);
+		}
+	} else
+		Jim_SetResultString(interp, text.buf, text.len);
+
+	free(text.buf);
+	return retval;
+}
+
+static const struct command_registration metrics_command_handlers[] = {
+	{
+		.name = "stats",
+		.jim_handler = jim_stats,
+		.mode = COMMAND_ANY,
+		.help = "Return the counters and latency histograms collected "
+			"by the JTAG layer, targets and servers, as text or JSON, "
+			"or reset them.",
+		.usage = "[prefix | 'json' [filename] | 'reset']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int metrics_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, metrics_command_handlers);
+}
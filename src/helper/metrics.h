@@ -0,0 +1,79 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct command_context;
+
+/* log-linear histogram buckets: four per power of two, up to 2^40 */
+#define METRIC_SUB_BUCKET_BITS	2
+#define METRIC_BUCKETS			(41 << METRIC_SUB_BUCKET_BITS)
+
+/**
+ * A counter, or a histogram of e.g. latencies in microseconds.  Metrics
+ * are static objects at the code they measure, named "subsystem.what",
+ * and link themselves into the list shown by the "stats" command the
+ * first time they are updated, so metrics never touched stay hidden.
+ */
+struct metric {
+	const char *name;
+	bool histogram;
+	bool registered;
+	uint64_t count;		/**< counter value, or number of samples */
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint32_t *buckets;	/**< histograms only, allocated on registration */
+	struct metric *next;
+};
+
+#define METRIC_COUNTER(metric_name) { .name = metric_name }
+#define METRIC_HISTOGRAM(metric_name) { .name = metric_name, .histogram = true }
+
+void metric_register(struct metric *metric);
+
+static inline void metric_add(struct metric *metric, uint64_t n)
+{
+	if (!metric->registered)
+		metric_register(metric);
+	metric->count += n;
+}
+
+static inline void metric_inc(struct metric *metric)
+{
+	metric_add(metric, 1);
+}
+
+/** Add one sample to a histogram. */
+void metric_record(struct metric *metric, uint64_t value);
+
+/** A microsecond timestamp for measuring latencies. */
+int64_t metric_now_us(void);
+
+/** @returns the value below which @a percent of the samples fall */
+uint64_t metric_percentile(struct metric *metric, double percent);
+
+void metrics_reset(void);
+
+int metrics_register_commands(struct command_context *cmd_ctx);
+
+#endif /* METRICS_H */
@@ -11,8 +11,9 @@ proc exit {} {
 }
 
 # All commands are registered with an 'ocd_' prefix, while the "real"
-# command is a wrapper that calls this function.  Its primary purpose is
-# to discard 'handler' command output,
+# command is a wrapper that behaves like this function; for speed it is
+# implemented in C (command_bounce() in command.c) and the two must be
+# kept in sync.  Its primary purpose is to discard 'handler' command output,
 proc ocd_bouncer {name args} {
 	set cmd [format "ocd_%s" $name]
 	set type [eval ocd_command type $cmd $args]
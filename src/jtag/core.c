@@ -36,6 +36,7 @@
 #include "swd.h"
 #include "interface.h"
 #include <transport/transport.h>
+#include <helper/metrics.h>
 
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
@@ -51,6 +52,10 @@ static int jtag_flush_queue_count;
 /* Sleep this # of ms after flushing the queue */
 static int jtag_flush_queue_sleep;
 
+static struct metric jtag_scans = METRIC_COUNTER("jtag.scans");
+static struct metric jtag_scan_bits = METRIC_COUNTER("jtag.scan_bits");
+static struct metric jtag_execute_queue_us = METRIC_HISTOGRAM("jtag.execute_queue_us");
+
 static void jtag_add_scan_check(struct jtag_tap *active,
 		void (*jtag_add_scan)(struct jtag_tap *active,
 		int in_num_fields,
@@ -349,10 +354,18 @@ static void jtag_prelude(tap_state_t state)
 	cmd_queue_cur_state = state;
 }
 
+static void jtag_count_scan(int num_fields, const struct scan_field *fields)
+{
+	metric_inc(&jtag_scans);
+	for (int i = 0; i < num_fields; i++)
+		metric_add(&jtag_scan_bits, fields[i].num_bits);
+}
+
 void jtag_add_ir_scan_noverify(struct jtag_tap *active, const struct scan_field *in_fields,
 	tap_state_t state)
 {
 	jtag_prelude(state);
+	jtag_count_scan(1, in_fields);
 
 	int retval = interface_jtag_add_ir_scan(active, in_fields, state);
 	jtag_set_error(retval);
@@ -392,6 +405,8 @@ void jtag_add_plain_ir_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
 	assert(state != TAP_RESET);
 
 	jtag_prelude(state);
+	metric_inc(&jtag_scans);
+	metric_add(&jtag_scan_bits, num_bits);
 
 	int retval = interface_jtag_add_plain_ir_scan(
 			num_bits, out_bits, in_bits, state);
@@ -453,6 +468,7 @@ void jtag_add_dr_scan(struct jtag_tap *active,
 	assert(state != TAP_RESET);
 
 	jtag_prelude(state);
+	jtag_count_scan(in_num_fields, in_fields);
 
 	int retval;
 	retval = interface_jtag_add_dr_scan(active, in_num_fields, in_fields, state);
@@ -466,6 +482,8 @@ void jtag_add_plain_dr_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
 	assert(state != TAP_RESET);
 
 	jtag_prelude(state);
+	metric_inc(&jtag_scans);
+	metric_add(&jtag_scan_bits, num_bits);
 
 	int retval;
 	retval = interface_jtag_add_plain_dr_scan(num_bits, out_bits, in_bits, state);
@@ -833,8 +851,11 @@ int default_interface_jtag_execute_queue(void)
 
 void jtag_execute_queue_noclear(void)
 {
+	int64_t start = metric_now_us();
+
 	jtag_flush_queue_count++;
 	jtag_set_error(interface_jtag_execute_queue());
+	metric_record(&jtag_execute_queue_us, metric_now_us() - start);
 
 	if (jtag_flush_queue_sleep > 0) {
 		/* For debug purposes it can be useful to test performance
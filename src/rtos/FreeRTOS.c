@@ -117,6 +117,7 @@ enum FreeRTOS_symbol_values {
 	FreeRTOS_VAL_xSuspendedTaskList = 8,
 	FreeRTOS_VAL_uxCurrentNumberOfTasks = 9,
 	FreeRTOS_VAL_uxTopUsedPriority = 10,
+	FreeRTOS_VAL_uxTaskNumber = 11,
 };
 
 static char *FreeRTOS_symbol_list[] = {
@@ -131,6 +132,7 @@ static char *FreeRTOS_symbol_list[] = {
 	"xSuspendedTaskList",
 	"uxCurrentNumberOfTasks",
 	"uxTopUsedPriority",
+	"uxTaskNumber",
 	NULL
 };
 
@@ -139,7 +141,7 @@ static char *FreeRTOS_symbol_list[] = {
 /* may be problems reading if sizes are not 32 bit long integers. */
 /* test mallocs for failure */
 
-static int FreeRTOS_update_threads(struct rtos *rtos)
+static int FreeRTOS_update_thread_list(struct rtos *rtos)
 {
 	int i = 0;
 	int retval;
@@ -356,6 +358,105 @@ static int FreeRTOS_update_threads(struct rtos *rtos)
 	return 0;
 }
 
+/* uxTaskNumber counts every task created, uxCurrentNumberOfTasks goes down
+ * once a deleted task is cleaned up. While neither changes the task lists
+ * hold the same TCBs. */
+static int FreeRTOS_read_generation(struct rtos *rtos, uint64_t *generation)
+{
+	const struct FreeRTOS_params *param = rtos->rtos_specific_params;
+	uint32_t task_number = 0;
+	uint32_t task_count = 0;
+	int retval;
+
+	if ((rtos->symbols[FreeRTOS_VAL_uxTaskNumber].address == 0) ||
+			(rtos->symbols[FreeRTOS_VAL_uxCurrentNumberOfTasks].address == 0) ||
+			(param->thread_count_width > sizeof(task_number)))
+		return ERROR_FAIL;
+
+	retval = target_read_buffer(rtos->target,
+			rtos->symbols[FreeRTOS_VAL_uxTaskNumber].address,
+			param->thread_count_width,
+			(uint8_t *)&task_number);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = target_read_buffer(rtos->target,
+			rtos->symbols[FreeRTOS_VAL_uxCurrentNumberOfTasks].address,
+			param->thread_count_width,
+			(uint8_t *)&task_count);
+	if (retval != ERROR_OK)
+		return retval;
+
+	*generation = ((uint64_t)task_number << 32) | task_count;
+	return ERROR_OK;
+}
+
+/* Keep the thread list of the previous update, only the running task is
+ * read again. Fails if that task isn't in the list. */
+static int FreeRTOS_update_current_thread(struct rtos *rtos)
+{
+	const struct FreeRTOS_params *param = rtos->rtos_specific_params;
+	threadid_t current_thread = 0;
+	int i;
+
+	int retval = target_read_buffer(rtos->target,
+			rtos->symbols[FreeRTOS_VAL_pxCurrentTCB].address,
+			param->pointer_width,
+			(uint8_t *)&current_thread);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (i = 0; i < rtos->thread_count; i++) {
+		if (rtos->thread_details[i].threadid == current_thread)
+			break;
+	}
+	if ((current_thread == 0) || (i == rtos->thread_count))
+		return ERROR_FAIL;
+
+	rtos->current_thread = current_thread;
+	for (i = 0; i < rtos->thread_count; i++) {
+		struct thread_detail *detail = &rtos->thread_details[i];
+
+		free(detail->extra_info_str);
+		detail->extra_info_str = NULL;
+		if (detail->threadid == current_thread) {
+			char running_str[] = "Running";
+			detail->extra_info_str = malloc(sizeof(running_str));
+			if (detail->extra_info_str)
+				strcpy(detail->extra_info_str, running_str);
+		}
+	}
+
+	return ERROR_OK;
+}
+
+static int FreeRTOS_update_threads(struct rtos *rtos)
+{
+	uint64_t generation = 0;
+	bool have_generation;
+	int retval;
+
+	if ((rtos->rtos_specific_params == NULL) || (rtos->symbols == NULL))
+		return FreeRTOS_update_thread_list(rtos);
+
+	have_generation = (FreeRTOS_read_generation(rtos, &generation) == ERROR_OK);
+	if (have_generation && rtos->thread_list_valid &&
+			(generation == rtos->thread_list_generation) &&
+			(FreeRTOS_update_current_thread(rtos) == ERROR_OK))
+		return ERROR_OK;
+
+	rtos->thread_list_valid = false;
+	retval = FreeRTOS_update_thread_list(rtos);
+
+	/* the "Current Execution" placeholder isn't worth keeping */
+	if ((retval == ERROR_OK) && have_generation && (rtos->current_thread != 0)) {
+		rtos->thread_list_generation = generation;
+		rtos->thread_list_valid = true;
+	}
+
+	return retval;
+}
+
 static int FreeRTOS_get_thread_reg_list(struct rtos *rtos, int64_t thread_id, char **hex_reg_list)
 {
 	int retval;
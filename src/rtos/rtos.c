@@ -82,6 +82,7 @@ static void os_free(struct target *target)
 	if (target->rtos->symbols)
 		free(target->rtos->symbols);
 
+	free(target->rtos->threads_xml);
 	free(target->rtos);
 	target->rtos = NULL;
 }
@@ -154,8 +155,11 @@ static char *next_symbol(struct rtos *os, char *cur_symbol, uint64_t cur_addr)
 	if (!os->symbols)
 		os->type->get_symbol_list_to_lookup(&os->symbols);
 
-	if (!cur_symbol[0])
+	if (!cur_symbol[0]) {
+		/* a new lookup, the kernel variables may have moved */
+		os->thread_list_valid = false;
 		return os->symbols[0].symbol_name;
+	}
 
 	for (s = os->symbols; s->symbol_name; s++)
 		if (!strcmp(s->symbol_name, cur_symbol)) {
@@ -254,6 +258,131 @@ done:
 	return rtos_detected;
 }
 
+/* append str to the document at *xml, escaping XML markup as well as the
+ * characters that are special in GDB packets */
+static char *rtos_xml_append(char *xml, size_t *len, const char *str, bool escape)
+{
+	size_t add = 0;
+	const char *p;
+
+	for (p = str; *p; p++)
+		add += escape ? 6 : 1;
+
+	char *tmp = realloc(xml, *len + add + 1);
+	if (!tmp) {
+		free(xml);
+		return NULL;
+	}
+	xml = tmp;
+
+	for (p = str; *p; p++) {
+		char c = *p;
+		if (escape && (strchr("<>&\"'$#}*", c) || ((unsigned char)c < 0x20)))
+			*len += sprintf(xml + *len, "&#%d;", (unsigned char)c);
+		else
+			xml[(*len)++] = c;
+	}
+	xml[*len] = '\0';
+
+	return xml;
+}
+
+static char *rtos_threads_xml(struct rtos *rtos)
+{
+	char *xml = NULL;
+	size_t len = 0;
+	int i;
+
+	xml = rtos_xml_append(xml, &len, "<?xml version=\"1.0\"?>\n<threads>\n", false);
+
+	for (i = 0; xml && (i < rtos->thread_count); i++) {
+		struct thread_detail *detail = &rtos->thread_details[i];
+		char id[40];
+
+		if (!detail->exists)
+			continue;
+
+		snprintf(id, sizeof(id), "<thread id=\"%" PRIx64 "\"", detail->threadid);
+		xml = rtos_xml_append(xml, &len, id, false);
+		if (xml && detail->thread_name_str) {
+			xml = rtos_xml_append(xml, &len, " name=\"", false);
+			if (xml)
+				xml = rtos_xml_append(xml, &len, detail->thread_name_str, true);
+			if (xml)
+				xml = rtos_xml_append(xml, &len, "\"", false);
+		}
+		if (xml)
+			xml = rtos_xml_append(xml, &len, ">", false);
+		if (xml && detail->display_str)
+			xml = rtos_xml_append(xml, &len, detail->display_str, true);
+		if (xml && detail->display_str && detail->extra_info_str)
+			xml = rtos_xml_append(xml, &len, " : ", false);
+		if (xml && detail->extra_info_str)
+			xml = rtos_xml_append(xml, &len, detail->extra_info_str, true);
+		if (xml)
+			xml = rtos_xml_append(xml, &len, "</thread>\n", false);
+	}
+
+	if (xml)
+		xml = rtos_xml_append(xml, &len, "</threads>\n", false);
+
+	return xml;
+}
+
+/* qXfer:threads:read::offset,length returns the whole thread list in
+ * one transfer instead of a qfThreadInfo/qThreadExtraInfo per thread */
+static int rtos_qxfer_threads(struct connection *connection, char const *packet)
+{
+	struct target *target = get_target_from_connection(connection);
+	struct rtos *rtos = target->rtos;
+	unsigned long offset, length;
+	char *separator;
+
+	offset = strtoul(packet + 20, &separator, 16);
+	if (*separator != ',') {
+		gdb_put_packet(connection, "E00", 3);
+		return ERROR_OK;
+	}
+	length = strtoul(separator + 1, NULL, 16);
+
+	if (!rtos->threads_xml) {
+		rtos->threads_xml = rtos_threads_xml(rtos);
+		if (!rtos->threads_xml) {
+			gdb_put_packet(connection, "E01", 3);
+			return ERROR_OK;
+		}
+	}
+
+	size_t xml_len = strlen(rtos->threads_xml);
+	if (offset >= xml_len) {
+		gdb_put_packet(connection, "l", 1);
+		return ERROR_OK;
+	}
+
+	/* leave room for the m/l prefix */
+	if (length > GDB_BUFFER_SIZE - 2)
+		length = GDB_BUFFER_SIZE - 2;
+
+	size_t chunk = xml_len - offset;
+	char *reply = malloc(length + 1);
+	if (!reply) {
+		gdb_put_packet(connection, "E01", 3);
+		return ERROR_OK;
+	}
+
+	if (chunk > length) {
+		chunk = length;
+		reply[0] = 'm';
+	} else
+		reply[0] = 'l';
+	memcpy(reply + 1, rtos->threads_xml + offset, chunk);
+
+	gdb_put_packet(connection, reply, chunk + 1);
+	free(reply);
+
+	return ERROR_OK;
+}
+
 int rtos_thread_packet(struct connection *connection, char const *packet, int packet_size)
 {
 	struct target *target = get_target_from_connection(connection);
@@ -324,9 +453,13 @@ int rtos_thread_packet(struct connection *connection, char const *packet, int pa
 		if (rtos_qsymbol(connection, packet, packet_size) == 1) {
 			target->rtos_auto_detect = false;
 			target->rtos->type->create(target);
-			target->rtos->type->update_threads(target->rtos);
+			rtos_update_threads(target);
 		}
 		return ERROR_OK;
+	} else if (strncmp(packet, "qXfer:threads:read::", 20) == 0) {
+		if (target->rtos == NULL)
+			return GDB_THREAD_PACKET_NOT_CONSUMED;
+		return rtos_qxfer_threads(connection, packet);
 	} else if (strncmp(packet, "qfThreadInfo", 12) == 0) {
 		int i;
 		if (target->rtos != NULL) {
@@ -509,23 +642,37 @@ int rtos_try_next(struct target *target)
 
 int rtos_update_threads(struct target *target)
 {
-	if ((target->rtos != NULL) && (target->rtos->type != NULL))
+	if ((target->rtos != NULL) && (target->rtos->type != NULL)) {
+		/* not all drivers go through rtos_free_threadlist() */
+		free(target->rtos->threads_xml);
+		target->rtos->threads_xml = NULL;
 		target->rtos->type->update_threads(target->rtos);
+	}
 	return ERROR_OK;
 }
 
+void rtos_free_thread_details(struct thread_detail *details, int count)
+{
+	int j;
+
+	if (!details)
+		return;
+
+	for (j = 0; j < count; j++) {
+		free(details[j].display_str);
+		free(details[j].thread_name_str);
+		free(details[j].extra_info_str);
+	}
+	free(details);
+}
+
 void rtos_free_threadlist(struct rtos *rtos)
 {
-	if (rtos->thread_details) {
-		int j;
+	free(rtos->threads_xml);
+	rtos->threads_xml = NULL;
 
-		for (j = 0; j < rtos->thread_count; j++) {
-			struct thread_detail *current_thread = &rtos->thread_details[j];
-			free(current_thread->display_str);
-			free(current_thread->thread_name_str);
-			free(current_thread->extra_info_str);
-		}
-		free(rtos->thread_details);
+	if (rtos->thread_details) {
+		rtos_free_thread_details(rtos->thread_details, rtos->thread_count);
 		rtos->thread_details = NULL;
 		rtos->thread_count = 0;
 	}
@@ -58,6 +58,14 @@ struct rtos {
 	int thread_count;
 	int (*gdb_thread_packet)(struct connection *connection, char const *packet, int packet_size);
 	void *rtos_specific_params;
+	/*  qXfer:threads:read document, built from thread_details on first
+	 *  request and dropped whenever the thread list is refreshed */
+	char *threads_xml;
+	/*  driver specific count of task creations and deletions that
+	 *  thread_details was read at, while valid and unchanged the
+	 *  driver may keep the list instead of walking the kernel's */
+	uint64_t thread_list_generation;
+	bool thread_list_valid;
 };
 
 struct rtos_type {
@@ -99,6 +107,7 @@ int gdb_thread_packet(struct connection *connection, char const *packet, int pac
 int rtos_get_gdb_reg_list(struct connection *connection);
 int rtos_update_threads(struct target *target);
 void rtos_free_threadlist(struct rtos *rtos);
+void rtos_free_thread_details(struct thread_detail *details, int count);
 int rtos_smp_init(struct target *target);
 /*  function for handling symbol access */
 int rtos_qsymbol(struct connection *connection, char const *packet, int packet_size);
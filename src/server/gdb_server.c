@@ -48,6 +48,7 @@
 #include "gdb_server.h"
 #include <target/image.h>
 #include <jtag/jtag.h>
+#include <helper/metrics.h>
 #include "rtos/rtos.h"
 #include "target/smp.h"
 
@@ -92,8 +93,53 @@ struct gdb_connection {
 	bool attached;
 	/* temporarily used for target description support */
 	struct target_desc_format target_desc;
+	/* set if another connection owned the target when this one attached.
+	 * Observers can read registers and memory and wait for halts, but
+	 * can't modify or resume the target. */
+	bool observer;
+	/* breakpoint/watchpoint packets acknowledged but not yet applied,
+	 * see gdb_breakpoint_batch */
+	struct gdb_bp_op *bp_ops;
 };
 
+/* a Z/z packet queued until the next resume/step */
+struct gdb_bp_op {
+	bool insert;
+	int type;
+	uint32_t address;
+	uint32_t size;
+	struct gdb_bp_op *next;
+};
+
+/* a range of target memory read by one of the clients while halted */
+struct gdb_mem_block {
+	uint32_t address;
+	uint32_t len;
+	uint8_t *data;
+	struct gdb_mem_block *next;
+};
+
+/* halt-scoped state shared by all GDB connections of one service, so
+ * that extra clients don't re-read the target on every halt */
+struct gdb_halt_snapshot {
+	/* rtos thread list already refreshed for the current halt */
+	bool threads_valid;
+	struct gdb_mem_block *blocks;
+	uint32_t size;
+	/* gdb_service->write_count when the blocks were read */
+	uint32_t write_count;
+};
+
+/* the snapshot is allocated along with its service, so that it goes away
+ * with the service's private data */
+struct gdb_service_snapshot {
+	struct gdb_service service;
+	struct gdb_halt_snapshot snapshot;
+};
+
+/* upper bound on the memory kept in a halt snapshot */
+#define GDB_SNAPSHOT_MAX_SIZE (64 * 1024)
+
 #if 0
 #define _DEBUG_GDB_IO_
 #endif
@@ -104,6 +150,9 @@ static int gdb_breakpoint_override;
 static enum breakpoint_type gdb_breakpoint_override_type;
 
 static int gdb_error(struct connection *connection, int retval);
+static void gdb_discard_breakpoint_ops(struct connection *connection);
+static void gdb_unpatch_breakpoint_ops(struct connection *connection,
+		uint32_t addr, uint32_t len, uint8_t *buffer);
 static char *gdb_port;
 static char *gdb_port_next;
 
@@ -135,6 +184,115 @@ static int gdb_use_target_description = 1;
 /* current processing free-run type, used by file-I/O */
 static char gdb_running_type;
 
+/* number of GDB connections accepted per target, extra connections
+ * attach as observers of the first one */
+static int gdb_max_connections = 1;
+
+/* if set, Z/z packets are acknowledged immediately and applied in one go
+ * before the target is resumed or stepped. GDB removes and re-inserts all
+ * breakpoints around every stop, such pairs cancel out in the queue.
+ * Disabled by default.
+ */
+static int gdb_breakpoint_batch;
+
+static void gdb_snapshot_invalidate(struct gdb_service *gdb_service)
+{
+	struct gdb_halt_snapshot *snapshot = gdb_service->snapshot;
+	struct gdb_mem_block *block;
+
+	if (snapshot == NULL)
+		return;
+
+	block = snapshot->blocks;
+	while (block) {
+		struct gdb_mem_block *next = block->next;
+		free(block->data);
+		free(block);
+		block = next;
+	}
+
+	snapshot->blocks = NULL;
+	snapshot->size = 0;
+	snapshot->threads_valid = false;
+}
+
+/* the snapshot is only used when more than one client is attached */
+static bool gdb_snapshot_active(struct gdb_service *gdb_service)
+{
+	if (!gdb_service->snapshot || (gdb_service->connection_count < 2) ||
+			(gdb_service->target->state != TARGET_HALTED))
+		return false;
+
+	/* memory was written since, e.g. from telnet or an event script */
+	if (gdb_service->snapshot->write_count != gdb_service->write_count) {
+		gdb_snapshot_invalidate(gdb_service);
+		gdb_service->snapshot->write_count = gdb_service->write_count;
+	}
+
+	return true;
+}
+
+static bool gdb_snapshot_read(struct gdb_service *gdb_service,
+		uint32_t address, uint32_t len, uint8_t *buffer)
+{
+	struct gdb_mem_block *block;
+
+	if (!gdb_snapshot_active(gdb_service))
+		return false;
+
+	for (block = gdb_service->snapshot->blocks; block; block = block->next) {
+		if ((address >= block->address) &&
+				((uint64_t)address + len <= (uint64_t)block->address + block->len)) {
+			memcpy(buffer, block->data + (address - block->address), len);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void gdb_snapshot_store(struct gdb_service *gdb_service,
+		uint32_t address, uint32_t len, const uint8_t *buffer)
+{
+	struct gdb_halt_snapshot *snapshot = gdb_service->snapshot;
+	struct gdb_mem_block *block;
+
+	if (!gdb_snapshot_active(gdb_service))
+		return;
+
+	if (snapshot->size + len > GDB_SNAPSHOT_MAX_SIZE)
+		return;
+
+	block = malloc(sizeof(struct gdb_mem_block));
+	if (block == NULL)
+		return;
+	block->data = malloc(len);
+	if (block->data == NULL) {
+		free(block);
+		return;
+	}
+
+	memcpy(block->data, buffer, len);
+	block->address = address;
+	block->len = len;
+	block->next = snapshot->blocks;
+	snapshot->blocks = block;
+	snapshot->size += len;
+}
+
+/* reject packets that would modify the target from an observer */
+static bool gdb_observer_reject(struct connection *connection)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+
+	if (!gdb_connection->observer)
+		return false;
+
+	LOG_DEBUG("ignoring target modification from observer connection");
+	gdb_put_packet(connection, "E01", 3);
+	return true;
+}
+
 static int gdb_last_signal(struct target *target)
 {
 	switch (target->debug_reason) {
@@ -760,7 +918,14 @@ static void gdb_signal_reply(struct target *target, struct connection *connectio
 
 	gdb_put_packet(connection, sig_reply, sig_reply_len);
 	gdb_connection->frontend_state = TARGET_HALTED;
-	rtos_update_threads(target);
+
+	/* the thread list is shared, refresh it once per halt */
+	struct gdb_service *gdb_service = connection->service->priv;
+	if (!gdb_snapshot_active(gdb_service) || !gdb_service->snapshot->threads_valid) {
+		rtos_update_threads(target);
+		if (gdb_snapshot_active(gdb_service))
+			gdb_service->snapshot->threads_valid = true;
+	}
 }
 
 static void gdb_fileio_reply(struct target *target, struct connection *connection)
@@ -868,8 +1033,9 @@ static void gdb_frontend_halted(struct target *target, struct connection *connec
 		/* stop forwarding log packets! */
 		log_remove_callback(gdb_log_callback, connection);
 
-		/* check fileio first */
-		if (target_get_gdb_fileio_info(target, target->fileio_info) == ERROR_OK)
+		/* check fileio first, it is handled by the owning connection */
+		if (!gdb_connection->observer &&
+				(target_get_gdb_fileio_info(target, target->fileio_info) == ERROR_OK))
 			gdb_fileio_reply(target, connection);
 		else
 			gdb_signal_reply(target, connection);
@@ -893,7 +1059,15 @@ static int gdb_target_callback_event_handler(struct target *target,
 		case TARGET_EVENT_HALTED:
 			target_call_event_callbacks(target, TARGET_EVENT_GDB_END);
 			break;
+		case TARGET_EVENT_RESUMED:
+		case TARGET_EVENT_RESUME_START:
+		case TARGET_EVENT_DEBUG_RESUMED:
+		case TARGET_EVENT_RESET_START:
+		case TARGET_EVENT_GDB_FLASH_WRITE_END:
+			gdb_snapshot_invalidate(gdb_service);
+			break;
 		case TARGET_EVENT_GDB_FLASH_ERASE_START:
+			gdb_snapshot_invalidate(gdb_service);
 			retval = jtag_execute_queue();
 			if (retval != ERROR_OK)
 				return retval;
@@ -928,6 +1102,8 @@ static int gdb_new_connection(struct connection *connection)
 	gdb_connection->attached = true;
 	gdb_connection->target_desc.tdesc = NULL;
 	gdb_connection->target_desc.tdesc_length = 0;
+	gdb_connection->observer = gdb_service->has_owner;
+	gdb_connection->bp_ops = NULL;
 
 	/* send ACK to GDB for debug request */
 	gdb_write(connection, "+", 1);
@@ -935,16 +1111,20 @@ static int gdb_new_connection(struct connection *connection)
 	/* output goes through gdb connection */
 	command_set_output_handler(connection->cmd_ctx, gdb_output, connection);
 
-	/* we must remove all breakpoints registered to the target as a previous
-	 * GDB session could leave dangling breakpoints if e.g. communication
-	 * timed out.
-	 */
-	breakpoint_clear_target(gdb_service->target);
-	watchpoint_clear_target(gdb_service->target);
+	/* observers share the session of the owning connection, leave its
+	 * breakpoints and rtos state alone */
+	if (!gdb_connection->observer) {
+		/* we must remove all breakpoints registered to the target as a previous
+		 * GDB session could leave dangling breakpoints if e.g. communication
+		 * timed out.
+		 */
+		breakpoint_clear_target(gdb_service->target);
+		watchpoint_clear_target(gdb_service->target);
 
-	/* clean previous rtos session if supported*/
-	if ((gdb_service->target->rtos) && (gdb_service->target->rtos->type->clean))
-		gdb_service->target->rtos->type->clean(gdb_service->target);
+		/* clean previous rtos session if supported*/
+		if ((gdb_service->target->rtos) && (gdb_service->target->rtos->type->clean))
+			gdb_service->target->rtos->type->clean(gdb_service->target);
+	}
 
 	/* remove the initial ACK from the incoming buffer */
 	retval = gdb_get_char(connection, &initial_ack);
@@ -956,7 +1136,8 @@ static int gdb_new_connection(struct connection *connection)
 	 */
 	if (initial_ack != '+')
 		gdb_putback_char(connection, initial_ack);
-	target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_ATTACH);
+	if (!gdb_connection->observer)
+		target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_ATTACH);
 
 	if (gdb_use_memory_map) {
 		/* Connect must fail if the memory map can't be set up correctly.
@@ -980,10 +1161,14 @@ static int gdb_new_connection(struct connection *connection)
 	}
 
 	gdb_actual_connections++;
-	LOG_DEBUG("New GDB Connection: %d, Target %s, state: %s",
+	gdb_service->connection_count++;
+	if (!gdb_connection->observer)
+		gdb_service->has_owner = true;
+	LOG_DEBUG("New GDB Connection: %d, Target %s, state: %s%s",
 			gdb_actual_connections,
 			target_name(gdb_service->target),
-			target_state_name(gdb_service->target));
+			target_state_name(gdb_service->target),
+			gdb_connection->observer ? " (observer)" : "");
 
 	/* DANGER! If we fail subsequently, we must remove this handler,
 	 * otherwise we occasionally see crashes as the timer can invoke the
@@ -999,6 +1184,7 @@ static int gdb_connection_closed(struct connection *connection)
 {
 	struct gdb_service *gdb_service = connection->service->priv;
 	struct gdb_connection *gdb_connection = connection->priv;
+	bool observer = gdb_connection->observer;
 
 	/* we're done forwarding messages. Tear down callback before
 	 * cleaning up connection.
@@ -1006,6 +1192,11 @@ static int gdb_connection_closed(struct connection *connection)
 	log_remove_callback(gdb_log_callback, connection);
 
 	gdb_actual_connections--;
+	gdb_service->connection_count--;
+	if (!observer)
+		gdb_service->has_owner = false;
+	if (gdb_service->connection_count < 2)
+		gdb_snapshot_invalidate(gdb_service);
 	LOG_DEBUG("GDB Close, Target: %s, state: %s, gdb_actual_connections=%d",
 		target_name(gdb_service->target),
 		target_state_name(gdb_service->target),
@@ -1018,6 +1209,9 @@ static int gdb_connection_closed(struct connection *connection)
 		gdb_connection->vflash_image = NULL;
 	}
 
+	/* breakpoints GDB didn't resume with are dropped with the session */
+	gdb_discard_breakpoint_ops(connection);
+
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, gdb_service->target);
 
@@ -1029,6 +1223,9 @@ static int gdb_connection_closed(struct connection *connection)
 
 	target_unregister_event_callback(gdb_target_callback_event_handler, connection);
 
+	if (observer)
+		return ERROR_OK;
+
 	target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_END);
 
 	target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_DETACH);
@@ -1341,6 +1538,8 @@ static int gdb_read_memory_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
 	struct target *target = get_target_from_connection(connection);
+	struct gdb_service *gdb_service = connection->service->priv;
+	struct gdb_connection *gdb_connection = connection->priv;
 	char *separator;
 	uint32_t addr = 0;
 	uint32_t len = 0;
@@ -1372,7 +1571,15 @@ static int gdb_read_memory_packet(struct connection *connection,
 
 	LOG_DEBUG("addr: 0x%8.8" PRIx32 ", len: 0x%8.8" PRIx32 "", addr, len);
 
-	retval = target_read_buffer(target, addr, len, buffer);
+	/* observers are served from what the other clients already read
+	 * during this halt, the owner always reads the target */
+	if (!gdb_connection->observer || !gdb_snapshot_read(gdb_service, addr, len, buffer)) {
+		retval = target_read_buffer(target, addr, len, buffer);
+		if (retval == ERROR_OK) {
+			gdb_unpatch_breakpoint_ops(connection, addr, len, buffer);
+			gdb_snapshot_store(gdb_service, addr, len, buffer);
+		}
+	}
 
 	if ((retval != ERROR_OK) && !gdb_report_data_abort) {
 		/* TODO : Here we have to lie and send back all zero's lest stack traces won't work.
@@ -1540,13 +1747,171 @@ static int gdb_step_continue_packet(struct connection *connection,
 	return retval;
 }
 
+static int gdb_apply_breakpoint_op(struct target *target, bool insert,
+		int type, uint32_t address, uint32_t size)
+{
+	enum breakpoint_type bp_type = (type == 1) ? BKPT_HARD : BKPT_SOFT;
+	enum watchpoint_rw wp_type;
+
+	switch (type) {
+		case 0:
+		case 1:
+			if (gdb_breakpoint_override)
+				bp_type = gdb_breakpoint_override_type;
+			if (insert)
+				return breakpoint_add(target, address, size, bp_type);
+			breakpoint_remove(target, address);
+			return ERROR_OK;
+		case 2:
+		case 3:
+		case 4:
+			if (type == 2)
+				wp_type = WPT_WRITE;
+			else if (type == 3)
+				wp_type = WPT_READ;
+			else
+				wp_type = WPT_ACCESS;
+			if (insert)
+				return watchpoint_add(target, address, size, wp_type, 0, 0xffffffffu);
+			watchpoint_remove(target, address);
+			return ERROR_OK;
+		default:
+			return ERROR_OK;
+	}
+}
+
+static bool gdb_breakpoint_op_present(struct target *target, int type, uint32_t address)
+{
+	if (type <= 1)
+		return breakpoint_find(target, address) != NULL;
+
+	struct watchpoint *watchpoint;
+	for (watchpoint = target->watchpoints; watchpoint; watchpoint = watchpoint->next) {
+		if (watchpoint->address == address)
+			return true;
+	}
+
+	return false;
+}
+
+static void gdb_queue_breakpoint_op(struct connection *connection, bool insert,
+		int type, uint32_t address, uint32_t size)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+	struct gdb_bp_op **p = &gdb_con->bp_ops;
+	struct gdb_bp_op *op;
+
+	/* an insert cancels a pending remove of the same breakpoint and vice
+	 * versa, only keep the op if it still changes the target */
+	while (*p) {
+		op = *p;
+		if ((op->insert != insert) && (op->type == type) &&
+				(op->address == address) && (op->size == size)) {
+			*p = op->next;
+			free(op);
+			if (!insert || gdb_breakpoint_op_present(target, type, address))
+				return;
+			break;
+		}
+		p = &op->next;
+	}
+
+	op = malloc(sizeof(struct gdb_bp_op));
+	if (op == NULL) {
+		/* fall back to applying it right away */
+		gdb_apply_breakpoint_op(target, insert, type, address, size);
+		return;
+	}
+
+	op->insert = insert;
+	op->type = type;
+	op->address = address;
+	op->size = size;
+	op->next = NULL;
+
+	while (*p)
+		p = &(*p)->next;
+	*p = op;
+}
+
+/* apply the queued breakpoint/watchpoint packets. Removals go first so
+ * that the comparators they free can be used by the insertions. */
+static int gdb_flush_breakpoint_ops(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+	struct gdb_bp_op *op;
+	int retval = ERROR_OK;
+	int pass;
+
+	if (gdb_con->bp_ops == NULL)
+		return ERROR_OK;
+
+	for (pass = 0; pass < 2; pass++) {
+		for (op = gdb_con->bp_ops; op; op = op->next) {
+			if (op->insert != (pass == 1))
+				continue;
+
+			int retval2 = gdb_apply_breakpoint_op(target, op->insert,
+					op->type, op->address, op->size);
+			if (retval2 != ERROR_OK) {
+				LOG_ERROR("unable to set %s at 0x%8.8" PRIx32,
+						(op->type <= 1) ? "breakpoint" : "watchpoint", op->address);
+				retval = retval2;
+			}
+		}
+	}
+
+	gdb_discard_breakpoint_ops(connection);
+
+	return retval;
+}
+
+static void gdb_discard_breakpoint_ops(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+
+	while (gdb_con->bp_ops) {
+		struct gdb_bp_op *next = gdb_con->bp_ops->next;
+		free(gdb_con->bp_ops);
+		gdb_con->bp_ops = next;
+	}
+}
+
+/* GDB expects memory without the breakpoints it removed, even when the
+ * removal is still queued */
+static void gdb_unpatch_breakpoint_ops(struct connection *connection,
+		uint32_t addr, uint32_t len, uint8_t *buffer)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+	struct gdb_bp_op *op;
+
+	for (op = gdb_con->bp_ops; op; op = op->next) {
+		if (op->insert || (op->type > 1))
+			continue;
+
+		struct breakpoint *breakpoint = breakpoint_find(target, op->address);
+		if (!breakpoint || !breakpoint->set || (breakpoint->type != BKPT_SOFT))
+			continue;
+
+		/* odd lengths carry ISA mode information on some targets */
+		uint32_t bp_len = breakpoint->length & ~1;
+		uint32_t i;
+		for (i = 0; i < bp_len; i++) {
+			uint32_t bp_addr = breakpoint->address + i;
+			if ((bp_addr >= addr) && (bp_addr - addr < len))
+				buffer[bp_addr - addr] = breakpoint->orig_instr[i];
+		}
+	}
+}
+
 static int gdb_breakpoint_watchpoint_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
 	struct target *target = get_target_from_connection(connection);
 	int type;
-	enum breakpoint_type bp_type = BKPT_SOFT /* dummy init to avoid warning */;
-	enum watchpoint_rw wp_type = WPT_READ /* dummy init to avoid warning */;
 	uint32_t address;
 	uint32_t size;
 	char *separator;
@@ -1556,24 +1921,11 @@ static int gdb_breakpoint_watchpoint_packet(struct connection *connection,
 
 	type = strtoul(packet + 1, &separator, 16);
 
-	if (type == 0)	/* memory breakpoint */
-		bp_type = BKPT_SOFT;
-	else if (type == 1)	/* hardware breakpoint */
-		bp_type = BKPT_HARD;
-	else if (type == 2)	/* write watchpoint */
-		wp_type = WPT_WRITE;
-	else if (type == 3)	/* read watchpoint */
-		wp_type = WPT_READ;
-	else if (type == 4)	/* access watchpoint */
-		wp_type = WPT_ACCESS;
-	else {
+	if ((type < 0) || (type > 4)) {
 		LOG_ERROR("invalid gdb watch/breakpoint type(%d), dropping connection", type);
 		return ERROR_SERVER_REMOTE_CLOSED;
 	}
 
-	if (gdb_breakpoint_override && ((bp_type == BKPT_SOFT) || (bp_type == BKPT_HARD)))
-		bp_type = gdb_breakpoint_override_type;
-
 	if (*separator != ',') {
 		LOG_ERROR("incomplete breakpoint/watchpoint packet received, dropping connection");
 		return ERROR_SERVER_REMOTE_CLOSED;
@@ -1588,44 +1940,20 @@ static int gdb_breakpoint_watchpoint_packet(struct connection *connection,
 
 	size = strtoul(separator + 1, &separator, 16);
 
-	switch (type) {
-		case 0:
-		case 1:
-			if (packet[0] == 'Z') {
-				retval = breakpoint_add(target, address, size, bp_type);
-				if (retval != ERROR_OK) {
-					retval = gdb_error(connection, retval);
-					if (retval != ERROR_OK)
-						return retval;
-				} else
-					gdb_put_packet(connection, "OK", 2);
-			} else {
-				breakpoint_remove(target, address);
-				gdb_put_packet(connection, "OK", 2);
-			}
-			break;
-		case 2:
-		case 3:
-		case 4:
-		{
-			if (packet[0] == 'Z') {
-				retval = watchpoint_add(target, address, size, wp_type, 0, 0xffffffffu);
-				if (retval != ERROR_OK) {
-					retval = gdb_error(connection, retval);
-					if (retval != ERROR_OK)
-						return retval;
-				} else
-					gdb_put_packet(connection, "OK", 2);
-			} else {
-				watchpoint_remove(target, address);
-				gdb_put_packet(connection, "OK", 2);
-			}
-			break;
-		}
-		default:
-			break;
+	if (gdb_breakpoint_batch) {
+		gdb_queue_breakpoint_op(connection, packet[0] == 'Z', type, address, size);
+		gdb_put_packet(connection, "OK", 2);
+		return ERROR_OK;
 	}
 
+	retval = gdb_apply_breakpoint_op(target, packet[0] == 'Z', type, address, size);
+	if (retval != ERROR_OK) {
+		retval = gdb_error(connection, retval);
+		if (retval != ERROR_OK)
+			return retval;
+	} else
+		gdb_put_packet(connection, "OK", 2);
+
 	return ERROR_OK;
 }
 
@@ -2321,7 +2649,8 @@ static int gdb_query_packet(struct connection *connection,
 		}
 	} else if (strncmp(packet, "qSupported", 10) == 0) {
 		/* we currently support packet size and qXfer:memory-map:read (if enabled)
-		 * qXfer:features:read is supported for some targets */
+		 * qXfer:features:read is supported for some targets
+		 * qXfer:threads:read is supported when an rtos is configured */
 		int retval = ERROR_OK;
 		char *buffer = NULL;
 		int pos = 0;
@@ -2346,10 +2675,12 @@ static int gdb_query_packet(struct connection *connection,
 			&buffer,
 			&pos,
 			&size,
-			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;QStartNoAckMode+",
+			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;"
+			"qXfer:threads:read%c;QStartNoAckMode+",
 			(GDB_BUFFER_SIZE - 1),
 			((gdb_use_memory_map == 1) && (flash_get_bank_count() > 0)) ? '+' : '-',
-			(gdb_target_desc_supported == 1) ? '+' : '-');
+			(gdb_target_desc_supported == 1) ? '+' : '-',
+			(target->rtos != NULL) ? '+' : '-');
 
 		if (retval != ERROR_OK) {
 			gdb_send_error(connection, 01);
@@ -2541,8 +2872,10 @@ static int gdb_v_packet(struct connection *connection,
 static int gdb_detach(struct connection *connection)
 {
 	struct gdb_service *gdb_service = connection->service->priv;
+	struct gdb_connection *gdb_connection = connection->priv;
 
-	target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_DETACH);
+	if (!gdb_connection->observer)
+		target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_DETACH);
 
 	return gdb_put_packet(connection, "OK", 2);
 }
@@ -2616,6 +2949,48 @@ static void gdb_sig_halted(struct connection *connection)
 	gdb_put_packet(connection, sig_reply, 3);
 }
 
+/* received packets by their first character, the last one counts the rest */
+static struct metric gdb_packets[] = {
+	METRIC_COUNTER("gdb.packets.?"),
+	METRIC_COUNTER("gdb.packets.c"),
+	METRIC_COUNTER("gdb.packets.D"),
+	METRIC_COUNTER("gdb.packets.F"),
+	METRIC_COUNTER("gdb.packets.g"),
+	METRIC_COUNTER("gdb.packets.G"),
+	METRIC_COUNTER("gdb.packets.H"),
+	METRIC_COUNTER("gdb.packets.j"),
+	METRIC_COUNTER("gdb.packets.J"),
+	METRIC_COUNTER("gdb.packets.k"),
+	METRIC_COUNTER("gdb.packets.m"),
+	METRIC_COUNTER("gdb.packets.M"),
+	METRIC_COUNTER("gdb.packets.p"),
+	METRIC_COUNTER("gdb.packets.P"),
+	METRIC_COUNTER("gdb.packets.q"),
+	METRIC_COUNTER("gdb.packets.Q"),
+	METRIC_COUNTER("gdb.packets.R"),
+	METRIC_COUNTER("gdb.packets.s"),
+	METRIC_COUNTER("gdb.packets.T"),
+	METRIC_COUNTER("gdb.packets.v"),
+	METRIC_COUNTER("gdb.packets.X"),
+	METRIC_COUNTER("gdb.packets.z"),
+	METRIC_COUNTER("gdb.packets.Z"),
+	METRIC_COUNTER("gdb.packets.!"),
+	METRIC_COUNTER("gdb.packets.other"),
+};
+static struct metric gdb_packet_us = METRIC_HISTOGRAM("gdb.packet_us");
+
+static void gdb_count_packet(char type)
+{
+	const size_t prefix = strlen("gdb.packets.");
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(gdb_packets) - 1; i++) {
+		if (gdb_packets[i].name[prefix] == type)
+			break;
+	}
+	metric_inc(&gdb_packets[i]);
+}
+
 static int gdb_input_inner(struct connection *connection)
 {
 	/* Do not allocate this on the stack */
@@ -2663,6 +3038,9 @@ static int gdb_input_inner(struct connection *connection)
 		}
 
 		if (packet_size > 0) {
+			int64_t start = metric_now_us();
+			gdb_count_packet(packet[0]);
+
 			retval = ERROR_OK;
 			switch (packet[0]) {
 				case 'T':	/* Is thread alive? */
@@ -2674,6 +3052,12 @@ static int gdb_input_inner(struct connection *connection)
 					break;
 				case 'q':
 				case 'Q':
+					/* monitor commands may resume the target */
+					if (strncmp(packet, "qRcmd,", 6) == 0) {
+						if (gdb_observer_reject(connection))
+							break;
+						gdb_flush_breakpoint_ops(connection);
+					}
 					retval = gdb_thread_packet(connection, packet, packet_size);
 					if (retval == GDB_THREAD_PACKET_NOT_CONSUMED)
 						retval = gdb_query_packet(connection, packet, packet_size);
@@ -2682,22 +3066,34 @@ static int gdb_input_inner(struct connection *connection)
 					retval = gdb_get_registers_packet(connection, packet, packet_size);
 					break;
 				case 'G':
+					if (gdb_observer_reject(connection))
+						break;
+					gdb_snapshot_invalidate(gdb_service);
 					retval = gdb_set_registers_packet(connection, packet, packet_size);
 					break;
 				case 'p':
 					retval = gdb_get_register_packet(connection, packet, packet_size);
 					break;
 				case 'P':
+					if (gdb_observer_reject(connection))
+						break;
+					gdb_snapshot_invalidate(gdb_service);
 					retval = gdb_set_register_packet(connection, packet, packet_size);
 					break;
 				case 'm':
 					retval = gdb_read_memory_packet(connection, packet, packet_size);
 					break;
 				case 'M':
+					if (gdb_observer_reject(connection))
+						break;
+					gdb_snapshot_invalidate(gdb_service);
+					gdb_flush_breakpoint_ops(connection);
 					retval = gdb_write_memory_packet(connection, packet, packet_size);
 					break;
 				case 'z':
 				case 'Z':
+					if (gdb_observer_reject(connection))
+						break;
 					retval = gdb_breakpoint_watchpoint_packet(connection, packet, packet_size);
 					break;
 				case '?':
@@ -2706,6 +3102,16 @@ static int gdb_input_inner(struct connection *connection)
 				case 'c':
 				case 's':
 				{
+					if (gdb_con->observer) {
+						/* observers don't resume the target, they wait for
+						 * the next halt which is reported to all connections */
+						gdb_con->frontend_state = TARGET_RUNNING;
+						if (target->state != TARGET_RUNNING)
+							LOG_INFO("observer waiting for target %s to halt",
+									target_name(target));
+						break;
+					}
+
 					gdb_thread_packet(connection, packet, packet_size);
 					log_add_callback(gdb_log_callback, connection);
 
@@ -2761,7 +3167,9 @@ static int gdb_input_inner(struct connection *connection)
 						if (!already_running) {
 							/* Here we don't want packet processing to stop even if this fails,
 							 * so we use a local variable instead of retval. */
-							retval = gdb_step_continue_packet(connection, packet, packet_size);
+							retval = gdb_flush_breakpoint_ops(connection);
+							if (retval == ERROR_OK)
+								retval = gdb_step_continue_packet(connection, packet, packet_size);
 							if (retval != ERROR_OK) {
 								/* we'll never receive a halted
 								 * condition... issue a false one..
@@ -2773,18 +3181,32 @@ static int gdb_input_inner(struct connection *connection)
 				}
 				break;
 				case 'v':
+					if ((strncmp(packet, "vFlash", 6) == 0) && gdb_observer_reject(connection))
+						break;
+					/* queued breakpoint ops must reach the target first,
+					 * tell GDB when they didn't */
+					if (gdb_flush_breakpoint_ops(connection) != ERROR_OK) {
+						gdb_put_packet(connection, "E01", 3);
+						break;
+					}
 					retval = gdb_v_packet(connection, packet, packet_size);
 					break;
 				case 'D':
+					gdb_flush_breakpoint_ops(connection);
 					retval = gdb_detach(connection);
 					extended_protocol = 0;
 					break;
 				case 'X':
+					if (gdb_observer_reject(connection))
+						break;
+					gdb_snapshot_invalidate(gdb_service);
+					gdb_flush_breakpoint_ops(connection);
 					retval = gdb_write_memory_binary_packet(connection, packet, packet_size);
 					if (retval != ERROR_OK)
 						return retval;
 					break;
 				case 'k':
+					gdb_flush_breakpoint_ops(connection);
 					if (extended_protocol != 0) {
 						gdb_con->attached = false;
 						break;
@@ -2797,7 +3219,10 @@ static int gdb_input_inner(struct connection *connection)
 					gdb_put_packet(connection, "OK", 2);
 					break;
 				case 'R':
+					if (gdb_observer_reject(connection))
+						break;
 					/* handle extended restart packet */
+					gdb_discard_breakpoint_ops(connection);
 					breakpoint_clear_target(gdb_service->target);
 					watchpoint_clear_target(gdb_service->target);
 					command_run_linef(connection->cmd_ctx, "ocd_gdb_restart %s",
@@ -2829,6 +3254,9 @@ static int gdb_input_inner(struct connection *connection)
 					 * The format of 'F' response packet is
 					 * Fretcode,errno,Ctrl-C flag;call-specific attachment
 					 */
+					if (gdb_observer_reject(connection))
+						break;
+					gdb_flush_breakpoint_ops(connection);
 					gdb_con->frontend_state = TARGET_RUNNING;
 					log_add_callback(gdb_log_callback, connection);
 					gdb_fileio_response_packet(connection, packet, packet_size);
@@ -2840,6 +3268,7 @@ static int gdb_input_inner(struct connection *connection)
 					gdb_put_packet(connection, NULL, 0);
 					break;
 			}
+			metric_record(&gdb_packet_us, metric_now_us() - start);
 
 			/* if a packet handler returned an error, exit input loop */
 			if (retval != ERROR_OK)
@@ -2847,7 +3276,12 @@ static int gdb_input_inner(struct connection *connection)
 		}
 
 		if (gdb_con->ctrl_c) {
-			if (target->state == TARGET_RUNNING) {
+			if (gdb_con->observer) {
+				/* only the owner halts the target, observers get
+				 * their stop reply when it does */
+				LOG_INFO("ignoring halt request from observer connection");
+				gdb_con->ctrl_c = 0;
+			} else if (target->state == TARGET_RUNNING) {
 				retval = target_halt(target);
 				if (retval != ERROR_OK)
 					target_call_event_callbacks(target, TARGET_EVENT_GDB_HALT);
@@ -2882,18 +3316,29 @@ static int gdb_target_start(struct target *target, const char *port)
 {
 	struct gdb_service *gdb_service;
 	int ret;
-	gdb_service = malloc(sizeof(struct gdb_service));
-
-	if (NULL == gdb_service)
-		return -ENOMEM;
+	if (gdb_max_connections > 1) {
+		struct gdb_service_snapshot *s = calloc(1, sizeof(struct gdb_service_snapshot));
+		if (NULL == s)
+			return -ENOMEM;
+		gdb_service = &s->service;
+		gdb_service->snapshot = &s->snapshot;
+	} else {
+		gdb_service = malloc(sizeof(struct gdb_service));
+		if (NULL == gdb_service)
+			return -ENOMEM;
+		gdb_service->snapshot = NULL;
+	}
 
 	gdb_service->target = target;
 	gdb_service->core[0] = -1;
 	gdb_service->core[1] = -1;
+	gdb_service->connection_count = 0;
+	gdb_service->has_owner = false;
+	gdb_service->write_count = 0;
 	target->gdb_service = gdb_service;
 
 	ret = add_service("gdb",
-			port, 1, &gdb_new_connection, &gdb_input,
+			port, gdb_max_connections, &gdb_new_connection, &gdb_input,
 			&gdb_connection_closed, gdb_service);
 	/* initialialize all targets gdb service with the same pointer */
 	{
@@ -2978,6 +3423,27 @@ COMMAND_HANDLER(handle_gdb_port_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_gdb_max_connections_command)
+{
+	if (CMD_ARGC == 0) {
+		command_print(CMD_CTX, "%d", gdb_max_connections);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	int max_connections;
+	COMMAND_PARSE_NUMBER(int, CMD_ARGV[0], max_connections);
+	if (max_connections < 1) {
+		LOG_ERROR("at least one GDB connection is required");
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	gdb_max_connections = max_connections;
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_gdb_memory_map_command)
 {
 	if (CMD_ARGC != 1)
@@ -2996,6 +3462,15 @@ COMMAND_HANDLER(handle_gdb_flash_program_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_breakpoint_batch_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ENABLE(CMD_ARGV[0], gdb_breakpoint_batch);
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_gdb_report_data_abort_command)
 {
 	if (CMD_ARGC != 1)
@@ -3105,6 +3580,16 @@ static const struct command_registration gdb_command_handlers[] = {
 			"Output pipe is the same name as input pipe, but with 'o' appended.",
 		.usage = "[port_num]",
 	},
+	{
+		.name = "gdb_max_connections",
+		.handler = handle_gdb_max_connections_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Number of GDB connections accepted per target. "
+			"The first connection owns the target, the other ones "
+			"attach as read-mostly observers sharing its halt state. "
+			"No arguments reports the current value.",
+		.usage = "[count]"
+	},
 	{
 		.name = "gdb_memory_map",
 		.handler = handle_gdb_memory_map_command,
@@ -3134,6 +3619,14 @@ static const struct command_registration gdb_command_handlers[] = {
 			"to be used by gdb 'break' commands.",
 		.usage = "('hard'|'soft'|'disable')"
 	},
+	{
+		.name = "gdb_breakpoint_batch",
+		.handler = handle_gdb_breakpoint_batch_command,
+		.mode = COMMAND_ANY,
+		.help = "enable or disable deferred application of gdb "
+			"breakpoint/watchpoint packets until the next resume or step",
+		.usage = "('enable'|'disable')"
+	},
 	{
 		.name = "gdb_target_description",
 		.handler = handle_gdb_target_description_command,
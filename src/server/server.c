@@ -46,6 +46,12 @@ static struct service *services;
 /* shutdown_openocd == 1: exit the main event loop, and quit the debugger */
 static int shutdown_openocd;
 
+/* upper bound on the output queued for one connection */
+static int connection_output_limit = 256 * 1024;
+
+/* what to do when a connection that may drop output exceeds the limit */
+static bool connection_output_overflow_close;
+
 static int add_connection(struct service *service, struct command_context *cmd_ctx)
 {
 	socklen_t address_size;
@@ -60,6 +66,12 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	c->cmd_ctx = copy_command_context(cmd_ctx);
 	c->service = service;
 	c->input_pending = 0;
+	c->queue_output = false;
+	c->may_drop_output = false;
+	c->out_buf = NULL;
+	c->out_len = 0;
+	c->out_size = 0;
+	c->dropped = 0;
 	c->priv = NULL;
 	c->next = NULL;
 
@@ -142,6 +154,77 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	return ERROR_OK;
 }
 
+static bool connection_write_would_block(void)
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+#endif
+}
+
+/* write without blocking, returns 0 if the peer doesn't accept anything.
+ * The socket is only non-blocking for the duration of the write, the input
+ * handlers rely on blocking reads. */
+static int connection_send(struct connection *connection, const void *data, int len)
+{
+	socket_nonblock(connection->fd_out);
+	int n = write_socket(connection->fd_out, data, len);
+	bool would_block = (n < 0) && connection_write_would_block();
+	socket_block(connection->fd_out);
+
+	return would_block ? 0 : n;
+}
+
+/* append to the output queue of connection, returns false if the
+ * connection must be closed */
+static bool connection_queue_data(struct connection *connection, const char *data, int len)
+{
+	if (connection->out_len + len > connection_output_limit)
+		return false;
+
+	if (connection->out_len + len > connection->out_size) {
+		int size = connection->out_size ? connection->out_size : 4096;
+		while (size < connection->out_len + len)
+			size *= 2;
+		char *buf = realloc(connection->out_buf, size);
+		if (buf == NULL)
+			return false;
+		connection->out_buf = buf;
+		connection->out_size = size;
+	}
+
+	memcpy(connection->out_buf + connection->out_len, data, len);
+	connection->out_len += len;
+	return true;
+}
+
+/* send as much queued output as the peer accepts without blocking.
+ * Returns a negative value if the connection failed. */
+static int connection_flush_output(struct connection *connection)
+{
+	while (connection->out_len) {
+		int n = connection_send(connection, connection->out_buf, connection->out_len);
+		if (n <= 0)
+			return n;
+
+		connection->out_len -= n;
+		memmove(connection->out_buf, connection->out_buf + n, connection->out_len);
+	}
+
+	if (connection->dropped) {
+		char notice[64];
+		int len = snprintf(notice, sizeof(notice),
+				"\r\n[%u bytes of output dropped]\r\n", connection->dropped);
+		connection->dropped = 0;
+		if (!connection_queue_data(connection, notice, len))
+			return -1;
+		return connection_flush_output(connection);
+	}
+
+	return 0;
+}
+
 static int remove_connection(struct service *service, struct connection *connection)
 {
 	struct connection **p = &service->connections;
@@ -150,6 +233,11 @@ static int remove_connection(struct service *service, struct connection *connect
 	/* find connection */
 	while ((c = *p)) {
 		if (c->fd == connection->fd) {
+			/* last chance for queued output, e.g. a reply to "exit" */
+			if (c->out_len)
+				connection_flush_output(c);
+			free(c->out_buf);
+
 			service->connection_closed(c);
 			if (service->type == CONNECTION_TCP)
 				close_socket(c->fd);
@@ -335,6 +423,7 @@ int server_loop(struct command_context *command_context)
 
 	/* used in select() */
 	fd_set read_fds;
+	fd_set write_fds;
 	int fd_max;
 
 	/* used in accept() */
@@ -349,6 +438,7 @@ int server_loop(struct command_context *command_context)
 		/* monitor sockets for activity */
 		fd_max = 0;
 		FD_ZERO(&read_fds);
+		FD_ZERO(&write_fds);
 
 		/* add service and connection fds to read_fds */
 		for (service = services; service; service = service->next) {
@@ -368,6 +458,13 @@ int server_loop(struct command_context *command_context)
 					FD_SET(c->fd, &read_fds);
 					if (c->fd > fd_max)
 						fd_max = c->fd;
+
+					/* wait for the peer to accept queued output */
+					if (c->out_len) {
+						FD_SET(c->fd_out, &write_fds);
+						if (c->fd_out > fd_max)
+							fd_max = c->fd_out;
+					}
 				}
 			}
 		}
@@ -378,14 +475,16 @@ int server_loop(struct command_context *command_context)
 			/* we're just polling this iteration, this is faster on embedded
 			 * hosts */
 			tv.tv_usec = 0;
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			retval = socket_select(fd_max + 1, &read_fds, &write_fds, NULL, &tv);
 		} else {
-			/* Every 100ms */
-			tv.tv_usec = 100000;
+			/* Every 100ms, or sooner when a timer callback (e.g. the
+			 * poller right after a resume) is due earlier */
+			int64_t next = target_timer_next_event();
+			tv.tv_usec = (next < 100) ? next * 1000 : 100000;
 			/* Only while we're sleeping we'll let others run */
 			openocd_sleep_prelude();
 			kept_alive();
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			retval = socket_select(fd_max + 1, &read_fds, &write_fds, NULL, &tv);
 			openocd_sleep_postlude();
 		}
 
@@ -394,17 +493,19 @@ int server_loop(struct command_context *command_context)
 
 			errno = WSAGetLastError();
 
-			if (errno == WSAEINTR)
+			if (errno == WSAEINTR) {
 				FD_ZERO(&read_fds);
-			else {
+				FD_ZERO(&write_fds);
+			} else {
 				LOG_ERROR("error during select: %s", strerror(errno));
 				exit(-1);
 			}
 #else
 
-			if (errno == EINTR)
+			if (errno == EINTR) {
 				FD_ZERO(&read_fds);
-			else {
+				FD_ZERO(&write_fds);
+			} else {
 				LOG_ERROR("error during select: %s", strerror(errno));
 				exit(-1);
 			}
@@ -418,6 +519,7 @@ int server_loop(struct command_context *command_context)
 			process_jim_events(command_context);
 
 			FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
+			FD_ZERO(&write_fds);
 
 			/* We timed out/there was nothing to do, timeout rather than poll next time
 			 **/
@@ -461,22 +563,27 @@ int server_loop(struct command_context *command_context)
 				struct connection *c;
 
 				for (c = service->connections; c; ) {
-					if ((FD_ISSET(c->fd, &read_fds)) || c->input_pending) {
+					retval = ERROR_OK;
+					if (c->out_len && FD_ISSET(c->fd_out, &write_fds)) {
+						if (connection_flush_output(c) < 0)
+							retval = ERROR_SERVER_REMOTE_CLOSED;
+					}
+					if ((retval == ERROR_OK) &&
+							((FD_ISSET(c->fd, &read_fds)) || c->input_pending))
 						retval = service->input(c);
-						if (retval != ERROR_OK) {
-							struct connection *next = c->next;
-							if (service->type == CONNECTION_PIPE ||
-									service->type == CONNECTION_STDINOUT) {
-								/* if connection uses a pipe then
-								 * shutdown openocd on error */
-								shutdown_openocd = 1;
-							}
-							remove_connection(service, c);
-							LOG_INFO("dropped '%s' connection",
-								service->name);
-							c = next;
-							continue;
+					if (retval != ERROR_OK) {
+						struct connection *next = c->next;
+						if (service->type == CONNECTION_PIPE ||
+								service->type == CONNECTION_STDINOUT) {
+							/* if connection uses a pipe then
+							 * shutdown openocd on error */
+							shutdown_openocd = 1;
 						}
+						remove_connection(service, c);
+						LOG_INFO("dropped '%s' connection",
+							service->name);
+						c = next;
+						continue;
 					}
 					c = c->next;
 				}
@@ -564,10 +671,56 @@ int connection_write(struct connection *connection, const void *data, int len)
 		/* successful no-op. Sockets and pipes behave differently here... */
 		return 0;
 	}
-	if (connection->service->type == CONNECTION_TCP)
-		return write_socket(connection->fd_out, data, len);
-	else
+	if (connection->service->type != CONNECTION_TCP)
 		return write(connection->fd_out, data, len);
+	if (!connection->queue_output)
+		return write_socket(connection->fd_out, data, len);
+
+	/* keep the output in order behind what is already queued */
+	if (connection->out_len && (connection_flush_output(connection) < 0))
+		return -1;
+
+	int n = 0;
+	if (!connection->out_len) {
+		n = connection_send(connection, data, len);
+		if (n == len)
+			return len;
+		if (n < 0)
+			return n;
+	}
+
+	if (!connection_queue_data(connection, (const char *)data + n, len - n))
+		return -1;
+
+	return len;
+}
+
+/* Let connection_write() queue what a slow peer doesn't accept right away,
+ * instead of blocking the whole server. Only TCP connections whose input is
+ * driven by server_loop() can do this. A connection whose queue would grow
+ * beyond the limit is closed; if may_drop is set, the owner can check with
+ * connection_drop_output() whether to skip a log message instead. */
+void connection_enable_output_queue(struct connection *connection, bool may_drop)
+{
+	if (connection->service->type != CONNECTION_TCP)
+		return;
+
+	connection->queue_output = true;
+	connection->may_drop_output = may_drop;
+}
+
+/* Returns true if a log message of len bytes is to be dropped as a whole
+ * because the output queue is full, see connection_output_overflow. The
+ * client is told how much it missed once it catches up. */
+bool connection_drop_output(struct connection *connection, int len)
+{
+	if (!connection->may_drop_output || connection_output_overflow_close)
+		return false;
+	if (connection->out_len + len <= connection_output_limit)
+		return false;
+
+	connection->dropped += len;
+	return true;
 }
 
 int connection_read(struct connection *connection, void *data, int len)
@@ -588,6 +741,49 @@ COMMAND_HANDLER(handle_shutdown_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_connection_output_limit_command)
+{
+	switch (CMD_ARGC) {
+		case 0:
+			command_print(CMD_CTX, "%d", connection_output_limit);
+			break;
+		case 1:
+		{
+			int limit;
+			COMMAND_PARSE_NUMBER(int, CMD_ARGV[0], limit);
+			if (limit <= 0) {
+				LOG_ERROR("the output limit must be positive");
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+			connection_output_limit = limit;
+			break;
+		}
+		default:
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_connection_output_overflow_command)
+{
+	switch (CMD_ARGC) {
+		case 0:
+			command_print(CMD_CTX, "%s", connection_output_overflow_close ? "close" : "drop");
+			break;
+		case 1:
+			if (strcmp(CMD_ARGV[0], "close") == 0)
+				connection_output_overflow_close = true;
+			else if (strcmp(CMD_ARGV[0], "drop") == 0)
+				connection_output_overflow_close = false;
+			else
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			break;
+		default:
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+	return ERROR_OK;
+}
+
 static const struct command_registration server_command_handlers[] = {
 	{
 		.name = "shutdown",
@@ -596,6 +792,22 @@ static const struct command_registration server_command_handlers[] = {
 		.usage = "",
 		.help = "shut the server down",
 	},
+	{
+		.name = "connection_output_limit",
+		.handler = &handle_connection_output_limit_command,
+		.mode = COMMAND_ANY,
+		.usage = "[bytes]",
+		.help = "Display or set the maximum output queued for a "
+			"telnet or tcl connection that doesn't keep up.",
+	},
+	{
+		.name = "connection_output_overflow",
+		.handler = &handle_connection_output_overflow_command,
+		.mode = COMMAND_ANY,
+		.usage = "['drop'|'close']",
+		.help = "Display or set whether telnet output beyond the "
+			"limit is dropped or the connection is closed.",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -46,6 +46,14 @@ struct connection {
 	struct command_context *cmd_ctx;
 	struct service *service;
 	int input_pending;
+	/* output not yet accepted by the peer, drained from server_loop() */
+	bool queue_output;
+	/* whole log messages may be dropped when the queue is full */
+	bool may_drop_output;
+	char *out_buf;
+	int out_len;
+	int out_size;
+	unsigned dropped;
 	void *priv;
 	struct connection *next;
 };
@@ -85,6 +93,8 @@ int server_register_commands(struct command_context *context);
 
 int connection_write(struct connection *connection, const void *data, int len);
 int connection_read(struct connection *connection, void *data, int len);
+void connection_enable_output_queue(struct connection *connection, bool may_drop);
+bool connection_drop_output(struct connection *connection, int len);
 
 /**
  * Used by server_loop(), defined in server_stubs.c
@@ -44,8 +44,9 @@ static int tcl_closed(struct connection *connection);
 
 /* write data out to a socket.
  *
- * this is a blocking write, so the return value must equal the length, if
- * that is not the case then flag the connection with an output error.
+ * what the peer doesn't accept right away is queued by connection_write(),
+ * so the return value must equal the length, if that is not the case then
+ * flag the connection with an output error.
  */
 int tcl_output(struct connection *connection, const void *data, ssize_t len)
 {
@@ -77,6 +78,9 @@ static int tcl_new_connection(struct connection *connection)
 
 	memset(tclc, 0, sizeof(struct tcl_connection));
 	connection->priv = tclc;
+
+	/* replies can't be dropped, a client that stops reading is closed */
+	connection_enable_output_queue(connection, false);
 	return ERROR_OK;
 }
 
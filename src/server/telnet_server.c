@@ -105,6 +105,18 @@ static void telnet_log_callback(void *priv, const char *file, unsigned line,
 	struct telnet_connection *t_con = connection->priv;
 	int i;
 
+	/* drop the whole message, including the prompt redraw, rather than
+	 * let a client that doesn't keep up receive part of it */
+	int len = strlen(string);
+	for (i = 0; string[i]; i++) {
+		if (string[i] == '\n')
+			len++;
+	}
+	if (t_con->line_cursor >= 0)
+		len += 4 * (strlen(t_con->prompt) + t_con->line_size);
+	if (connection_drop_output(connection, len))
+		return;
+
 	/* if there is no prompt, simply output the message */
 	if (t_con->line_cursor < 0) {
 		telnet_outputline(connection, string);
@@ -224,6 +236,10 @@ static int telnet_new_connection(struct connection *connection)
 	/* output goes through telnet connection */
 	command_set_output_handler(connection->cmd_ctx, telnet_output, connection);
 
+	/* a stalled telnet client must not block the server, log output
+	 * it can't keep up with is dropped */
+	connection_enable_output_queue(connection, true);
+
 	/* negotiate telnet options */
 	telnet_write(connection, negotiate, strlen(negotiate));
 
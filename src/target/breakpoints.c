@@ -43,44 +43,147 @@ static char *watchpoint_rw_strings[] = {
 /* monotonic counter/id-number for breakpoints and watch points */
 static int bpwp_unique_id;
 
+/* Breakpoints and watchpoints stay on the per-target lists, which the
+ * target drivers walk when (re)arming them.  Lookups by address go
+ * through a hash over the same entries instead, so that scripts placing
+ * hundreds of breakpoints don't pay for a list scan on every add, remove
+ * or halt.  New entries are still appended, keeping list order stable.
+ * Every entry also points back at the links to it in both chains, so
+ * removing one found through the hash doesn't walk the list either.
+ */
+#define BREAKPOINT_HASH_BITS	8
+#define BREAKPOINT_HASH_SIZE	(1 << BREAKPOINT_HASH_BITS)
+
+struct breakpoint_index {
+	struct breakpoint *breakpoints[BREAKPOINT_HASH_SIZE];
+	struct watchpoint *watchpoints[BREAKPOINT_HASH_SIZE];
+	struct breakpoint **breakpoint_tail;
+	struct watchpoint **watchpoint_tail;
+};
+
+static unsigned breakpoint_hash(uint32_t address)
+{
+	/* instructions are at least halfword aligned */
+	return ((address >> 1) * 0x9e3779b1u) >> (32 - BREAKPOINT_HASH_BITS);
+}
+
+static struct breakpoint_index *breakpoint_index(struct target *target)
+{
+	struct breakpoint_index *index = target->bp_index;
+
+	if (index == NULL) {
+		index = calloc(1, sizeof(struct breakpoint_index));
+		index->breakpoint_tail = &target->breakpoints;
+		index->watchpoint_tail = &target->watchpoints;
+		target->bp_index = index;
+	}
+
+	return index;
+}
+
+/* allocate a breakpoint and hang it off the end of the target's list */
+static struct breakpoint *breakpoint_new(struct target *target,
+	uint32_t address, uint32_t asid, uint32_t length,
+	enum breakpoint_type type)
+{
+	struct breakpoint_index *index = breakpoint_index(target);
+	struct breakpoint *breakpoint = malloc(sizeof(struct breakpoint));
+
+	breakpoint->address = address;
+	breakpoint->asid = asid;
+	breakpoint->length = length;
+	breakpoint->type = type;
+	breakpoint->set = 0;
+	breakpoint->orig_instr = malloc(length);
+	breakpoint->next = NULL;
+	breakpoint->prev = index->breakpoint_tail;
+	breakpoint->hash_next = NULL;
+	breakpoint->hash_prev = NULL;
+	breakpoint->unique_id = bpwp_unique_id++;
+
+	*index->breakpoint_tail = breakpoint;
+	return breakpoint;
+}
+
+/* the target accepted the new breakpoint, make it findable */
+static void breakpoint_commit(struct target *target, struct breakpoint *breakpoint)
+{
+	struct breakpoint_index *index = target->bp_index;
+	unsigned bucket = breakpoint_hash(breakpoint->address);
+
+	breakpoint->hash_next = index->breakpoints[bucket];
+	if (breakpoint->hash_next)
+		breakpoint->hash_next->hash_prev = &breakpoint->hash_next;
+	breakpoint->hash_prev = &index->breakpoints[bucket];
+	index->breakpoints[bucket] = breakpoint;
+	index->breakpoint_tail = &breakpoint->next;
+}
+
+/* the target refused the new breakpoint, drop it from the list again */
+static void breakpoint_discard(struct target *target, struct breakpoint *breakpoint)
+{
+	*target->bp_index->breakpoint_tail = NULL;
+	free(breakpoint->orig_instr);
+	free(breakpoint);
+}
+
+static struct breakpoint *breakpoint_lookup(struct target *target, uint32_t address)
+{
+	struct breakpoint *breakpoint;
+
+	if (target->bp_index == NULL)
+		return NULL;
+
+	breakpoint = target->bp_index->breakpoints[breakpoint_hash(address)];
+	while (breakpoint) {
+		if (breakpoint->address == address)
+			return breakpoint;
+		breakpoint = breakpoint->hash_next;
+	}
+
+	return NULL;
+}
+
+static struct watchpoint *watchpoint_lookup(struct target *target, uint32_t address)
+{
+	struct watchpoint *watchpoint;
+
+	if (target->bp_index == NULL)
+		return NULL;
+
+	watchpoint = target->bp_index->watchpoints[breakpoint_hash(address)];
+	while (watchpoint) {
+		if (watchpoint->address == address)
+			return watchpoint;
+		watchpoint = watchpoint->hash_next;
+	}
+
+	return NULL;
+}
+
 int breakpoint_add_internal(struct target *target,
 	uint32_t address,
 	uint32_t length,
 	enum breakpoint_type type)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-	struct breakpoint **breakpoint_p = &target->breakpoints;
+	struct breakpoint *breakpoint;
 	char *reason;
 	int retval;
-	int n;
 
-	n = 0;
-	while (breakpoint) {
-		n++;
-		if (breakpoint->address == address) {
-			/* FIXME don't assume "same address" means "same
-			 * breakpoint" ... check all the parameters before
-			 * succeeding.
-			 */
-			LOG_DEBUG("Duplicate Breakpoint address: 0x%08" PRIx32 " (BP %" PRIu32 ")",
-				address, breakpoint->unique_id);
-			return ERROR_OK;
-		}
-		breakpoint_p = &breakpoint->next;
-		breakpoint = breakpoint->next;
+	breakpoint = breakpoint_lookup(target, address);
+	if (breakpoint) {
+		/* FIXME don't assume "same address" means "same
+		 * breakpoint" ... check all the parameters before
+		 * succeeding.
+		 */
+		LOG_DEBUG("Duplicate Breakpoint address: 0x%08" PRIx32 " (BP %" PRIu32 ")",
+			address, breakpoint->unique_id);
+		return ERROR_OK;
 	}
 
-	(*breakpoint_p) = malloc(sizeof(struct breakpoint));
-	(*breakpoint_p)->address = address;
-	(*breakpoint_p)->asid = 0;
-	(*breakpoint_p)->length = length;
-	(*breakpoint_p)->type = type;
-	(*breakpoint_p)->set = 0;
-	(*breakpoint_p)->orig_instr = malloc(length);
-	(*breakpoint_p)->next = NULL;
-	(*breakpoint_p)->unique_id = bpwp_unique_id++;
-
-	retval = target_add_breakpoint(target, *breakpoint_p);
+	breakpoint = breakpoint_new(target, address, 0, length, type);
+
+	retval = target_add_breakpoint(target, breakpoint);
 	switch (retval) {
 		case ERROR_OK:
 			break;
@@ -94,16 +197,15 @@ int breakpoint_add_internal(struct target *target,
 			reason = "unknown reason";
 fail:
 			LOG_ERROR("can't add breakpoint: %s", reason);
-			free((*breakpoint_p)->orig_instr);
-			free(*breakpoint_p);
-			*breakpoint_p = NULL;
+			breakpoint_discard(target, breakpoint);
 			return retval;
 	}
+	breakpoint_commit(target, breakpoint);
 
 	LOG_DEBUG("added %s breakpoint at 0x%8.8" PRIx32 " of length 0x%8.8x, (BPID: %" PRIu32 ")",
-		breakpoint_type_strings[(*breakpoint_p)->type],
-		(*breakpoint_p)->address, (*breakpoint_p)->length,
-		(*breakpoint_p)->unique_id);
+		breakpoint_type_strings[breakpoint->type],
+		breakpoint->address, breakpoint->length,
+		breakpoint->unique_id);
 
 	return ERROR_OK;
 }
@@ -114,13 +216,10 @@ int context_breakpoint_add_internal(struct target *target,
 	enum breakpoint_type type)
 {
 	struct breakpoint *breakpoint = target->breakpoints;
-	struct breakpoint **breakpoint_p = &target->breakpoints;
 	int retval;
-	int n;
 
-	n = 0;
+	/* context breakpoints are keyed by ASID, not by address */
 	while (breakpoint) {
-		n++;
 		if (breakpoint->asid == asid) {
 			/* FIXME don't assume "same address" means "same
 			 * breakpoint" ... check all the parameters before
@@ -130,32 +229,22 @@ int context_breakpoint_add_internal(struct target *target,
 				asid, breakpoint->unique_id);
 			return -1;
 		}
-		breakpoint_p = &breakpoint->next;
 		breakpoint = breakpoint->next;
 	}
 
-	(*breakpoint_p) = malloc(sizeof(struct breakpoint));
-	(*breakpoint_p)->address = 0;
-	(*breakpoint_p)->asid = asid;
-	(*breakpoint_p)->length = length;
-	(*breakpoint_p)->type = type;
-	(*breakpoint_p)->set = 0;
-	(*breakpoint_p)->orig_instr = malloc(length);
-	(*breakpoint_p)->next = NULL;
-	(*breakpoint_p)->unique_id = bpwp_unique_id++;
-	retval = target_add_context_breakpoint(target, *breakpoint_p);
+	breakpoint = breakpoint_new(target, 0, asid, length, type);
+	retval = target_add_context_breakpoint(target, breakpoint);
 	if (retval != ERROR_OK) {
 		LOG_ERROR("could not add breakpoint");
-		free((*breakpoint_p)->orig_instr);
-		free(*breakpoint_p);
-		*breakpoint_p = NULL;
+		breakpoint_discard(target, breakpoint);
 		return retval;
 	}
+	breakpoint_commit(target, breakpoint);
 
 	LOG_DEBUG("added %s Context breakpoint at 0x%8.8" PRIx32 " of length 0x%8.8x, (BPID: %" PRIu32 ")",
-		breakpoint_type_strings[(*breakpoint_p)->type],
-		(*breakpoint_p)->asid, (*breakpoint_p)->length,
-		(*breakpoint_p)->unique_id);
+		breakpoint_type_strings[breakpoint->type],
+		breakpoint->asid, breakpoint->length,
+		breakpoint->unique_id);
 
 	return ERROR_OK;
 }
@@ -166,13 +255,12 @@ int hybrid_breakpoint_add_internal(struct target *target,
 	uint32_t length,
 	enum breakpoint_type type)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-	struct breakpoint **breakpoint_p = &target->breakpoints;
+	struct breakpoint *breakpoint = NULL;
 	int retval;
-	int n;
-	n = 0;
+
+	if (target->bp_index)
+		breakpoint = target->bp_index->breakpoints[breakpoint_hash(address)];
 	while (breakpoint) {
-		n++;
 		if ((breakpoint->asid == asid) && (breakpoint->address == address)) {
 			/* FIXME don't assume "same address" means "same
 			 * breakpoint" ... check all the parameters before
@@ -187,34 +275,24 @@ int hybrid_breakpoint_add_internal(struct target *target,
 			return -1;
 
 		}
-		breakpoint_p = &breakpoint->next;
-		breakpoint = breakpoint->next;
+		breakpoint = breakpoint->hash_next;
 	}
-	(*breakpoint_p) = malloc(sizeof(struct breakpoint));
-	(*breakpoint_p)->address = address;
-	(*breakpoint_p)->asid = asid;
-	(*breakpoint_p)->length = length;
-	(*breakpoint_p)->type = type;
-	(*breakpoint_p)->set = 0;
-	(*breakpoint_p)->orig_instr = malloc(length);
-	(*breakpoint_p)->next = NULL;
-	(*breakpoint_p)->unique_id = bpwp_unique_id++;
-
-
-	retval = target_add_hybrid_breakpoint(target, *breakpoint_p);
+
+	breakpoint = breakpoint_new(target, address, asid, length, type);
+	retval = target_add_hybrid_breakpoint(target, breakpoint);
 	if (retval != ERROR_OK) {
 		LOG_ERROR("could not add breakpoint");
-		free((*breakpoint_p)->orig_instr);
-		free(*breakpoint_p);
-		*breakpoint_p = NULL;
+		breakpoint_discard(target, breakpoint);
 		return retval;
 	}
+	breakpoint_commit(target, breakpoint);
+
 	LOG_DEBUG(
 		"added %s Hybrid breakpoint at address 0x%8.8" PRIx32 " of length 0x%8.8x, (BPID: %" PRIu32 ")",
-		breakpoint_type_strings[(*breakpoint_p)->type],
-		(*breakpoint_p)->address,
-		(*breakpoint_p)->length,
-		(*breakpoint_p)->unique_id);
+		breakpoint_type_strings[breakpoint->type],
+		breakpoint->address,
+		breakpoint->length,
+		breakpoint->unique_id);
 
 	return ERROR_OK;
 }
@@ -288,42 +366,41 @@ int hybrid_breakpoint_add(struct target *target,
 }
 
 /* free up a breakpoint */
-static void breakpoint_free(struct target *target, struct breakpoint *breakpoint_to_remove)
+static void breakpoint_free(struct target *target, struct breakpoint *breakpoint)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-	struct breakpoint **breakpoint_p = &target->breakpoints;
+	struct breakpoint_index *index = target->bp_index;
 	int retval;
 
-	while (breakpoint) {
-		if (breakpoint == breakpoint_to_remove)
-			break;
-		breakpoint_p = &breakpoint->next;
-		breakpoint = breakpoint->next;
-	}
-
-	if (breakpoint == NULL)
-		return;
-
 	retval = target_remove_breakpoint(target, breakpoint);
 
 	LOG_DEBUG("free BPID: %" PRIu32 " --> %d", breakpoint->unique_id, retval);
-	(*breakpoint_p) = breakpoint->next;
+
+	*breakpoint->prev = breakpoint->next;
+	if (breakpoint->next)
+		breakpoint->next->prev = breakpoint->prev;
+	else
+		index->breakpoint_tail = breakpoint->prev;
+
+	*breakpoint->hash_prev = breakpoint->hash_next;
+	if (breakpoint->hash_next)
+		breakpoint->hash_next->hash_prev = breakpoint->hash_prev;
+
 	free(breakpoint->orig_instr);
 	free(breakpoint);
 }
 
 int breakpoint_remove_internal(struct target *target, uint32_t address)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-
-	while (breakpoint) {
-		if ((breakpoint->address == address) && (breakpoint->asid == 0))
-			break;
-		else if ((breakpoint->address == 0) && (breakpoint->asid == address))
-			break;
-		else if ((breakpoint->address == address) && (breakpoint->asid != 0))
-			break;
-		breakpoint = breakpoint->next;
+	struct breakpoint *breakpoint = breakpoint_lookup(target, address);
+
+	/* context breakpoints are removed by their ASID */
+	if (breakpoint == NULL && target->bp_index) {
+		breakpoint = target->bp_index->breakpoints[breakpoint_hash(0)];
+		while (breakpoint) {
+			if ((breakpoint->address == 0) && (breakpoint->asid == address))
+				break;
+			breakpoint = breakpoint->hash_next;
+		}
 	}
 
 	if (breakpoint) {
@@ -379,53 +456,46 @@ void breakpoint_clear_target(struct target *target)
 
 struct breakpoint *breakpoint_find(struct target *target, uint32_t address)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-
-	while (breakpoint) {
-		if (breakpoint->address == address)
-			return breakpoint;
-		breakpoint = breakpoint->next;
-	}
-
-	return NULL;
+	return breakpoint_lookup(target, address);
 }
 
 int watchpoint_add(struct target *target, uint32_t address, uint32_t length,
 	enum watchpoint_rw rw, uint32_t value, uint32_t mask)
 {
-	struct watchpoint *watchpoint = target->watchpoints;
-	struct watchpoint **watchpoint_p = &target->watchpoints;
+	struct breakpoint_index *index;
+	struct watchpoint *watchpoint;
+	unsigned bucket;
 	int retval;
 	char *reason;
 
-	while (watchpoint) {
-		if (watchpoint->address == address) {
-			if (watchpoint->length != length
-				|| watchpoint->value != value
-				|| watchpoint->mask != mask
-				|| watchpoint->rw != rw) {
-				LOG_ERROR("address 0x%8.8" PRIx32
-					"already has watchpoint %d",
-					address, watchpoint->unique_id);
-				return ERROR_FAIL;
-			}
-
-			/* ignore duplicate watchpoint */
-			return ERROR_OK;
+	watchpoint = watchpoint_lookup(target, address);
+	if (watchpoint) {
+		if (watchpoint->length != length
+			|| watchpoint->value != value
+			|| watchpoint->mask != mask
+			|| watchpoint->rw != rw) {
+			LOG_ERROR("address 0x%8.8" PRIx32
+				"already has watchpoint %d",
+				address, watchpoint->unique_id);
+			return ERROR_FAIL;
 		}
-		watchpoint_p = &watchpoint->next;
-		watchpoint = watchpoint->next;
-	}
 
-	(*watchpoint_p) = calloc(1, sizeof(struct watchpoint));
-	(*watchpoint_p)->address = address;
-	(*watchpoint_p)->length = length;
-	(*watchpoint_p)->value = value;
-	(*watchpoint_p)->mask = mask;
-	(*watchpoint_p)->rw = rw;
-	(*watchpoint_p)->unique_id = bpwp_unique_id++;
+		/* ignore duplicate watchpoint */
+		return ERROR_OK;
+	}
 
-	retval = target_add_watchpoint(target, *watchpoint_p);
+	index = breakpoint_index(target);
+	watchpoint = calloc(1, sizeof(struct watchpoint));
+	watchpoint->address = address;
+	watchpoint->length = length;
+	watchpoint->value = value;
+	watchpoint->mask = mask;
+	watchpoint->rw = rw;
+	watchpoint->unique_id = bpwp_unique_id++;
+	watchpoint->prev = index->watchpoint_tail;
+	*index->watchpoint_tail = watchpoint;
+
+	retval = target_add_watchpoint(target, watchpoint);
 	switch (retval) {
 		case ERROR_OK:
 			break;
@@ -439,53 +509,55 @@ int watchpoint_add(struct target *target, uint32_t address, uint32_t length,
 			reason = "unrecognized error";
 bye:
 			LOG_ERROR("can't add %s watchpoint at 0x%8.8" PRIx32 ", %s",
-				watchpoint_rw_strings[(*watchpoint_p)->rw],
+				watchpoint_rw_strings[watchpoint->rw],
 				address, reason);
-			free(*watchpoint_p);
-			*watchpoint_p = NULL;
+			*index->watchpoint_tail = NULL;
+			free(watchpoint);
 			return retval;
 	}
 
+	bucket = breakpoint_hash(address);
+	watchpoint->hash_next = index->watchpoints[bucket];
+	if (watchpoint->hash_next)
+		watchpoint->hash_next->hash_prev = &watchpoint->hash_next;
+	watchpoint->hash_prev = &index->watchpoints[bucket];
+	index->watchpoints[bucket] = watchpoint;
+	index->watchpoint_tail = &watchpoint->next;
+
 	LOG_DEBUG("added %s watchpoint at 0x%8.8" PRIx32
 		" of length 0x%8.8" PRIx32 " (WPID: %d)",
-		watchpoint_rw_strings[(*watchpoint_p)->rw],
-		(*watchpoint_p)->address,
-		(*watchpoint_p)->length,
-		(*watchpoint_p)->unique_id);
+		watchpoint_rw_strings[watchpoint->rw],
+		watchpoint->address,
+		watchpoint->length,
+		watchpoint->unique_id);
 
 	return ERROR_OK;
 }
 
-static void watchpoint_free(struct target *target, struct watchpoint *watchpoint_to_remove)
+static void watchpoint_free(struct target *target, struct watchpoint *watchpoint)
 {
-	struct watchpoint *watchpoint = target->watchpoints;
-	struct watchpoint **watchpoint_p = &target->watchpoints;
+	struct breakpoint_index *index = target->bp_index;
 	int retval;
 
-	while (watchpoint) {
-		if (watchpoint == watchpoint_to_remove)
-			break;
-		watchpoint_p = &watchpoint->next;
-		watchpoint = watchpoint->next;
-	}
-
-	if (watchpoint == NULL)
-		return;
 	retval = target_remove_watchpoint(target, watchpoint);
 	LOG_DEBUG("free WPID: %d --> %d", watchpoint->unique_id, retval);
-	(*watchpoint_p) = watchpoint->next;
+
+	*watchpoint->prev = watchpoint->next;
+	if (watchpoint->next)
+		watchpoint->next->prev = watchpoint->prev;
+	else
+		index->watchpoint_tail = watchpoint->prev;
+
+	*watchpoint->hash_prev = watchpoint->hash_next;
+	if (watchpoint->hash_next)
+		watchpoint->hash_next->hash_prev = watchpoint->hash_prev;
+
 	free(watchpoint);
 }
 
 void watchpoint_remove(struct target *target, uint32_t address)
 {
-	struct watchpoint *watchpoint = target->watchpoints;
-
-	while (watchpoint) {
-		if (watchpoint->address == address)
-			break;
-		watchpoint = watchpoint->next;
-	}
+	struct watchpoint *watchpoint = watchpoint_lookup(target, address);
 
 	if (watchpoint)
 		watchpoint_free(target, watchpoint);
@@ -40,6 +40,9 @@ struct breakpoint {
 	int set;
 	uint8_t *orig_instr;
 	struct breakpoint *next;
+	struct breakpoint **prev;	/* link pointing at this entry */
+	struct breakpoint *hash_next;
+	struct breakpoint **hash_prev;
 	uint32_t unique_id;
 	int linked_BRP;
 };
@@ -52,6 +55,9 @@ struct watchpoint {
 	enum watchpoint_rw rw;
 	int set;
 	struct watchpoint *next;
+	struct watchpoint **prev;	/* link pointing at this entry */
+	struct watchpoint *hash_next;
+	struct watchpoint **hash_prev;
 	int unique_id;
 };
 
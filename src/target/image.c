@@ -33,6 +33,7 @@
 
 #include "image.h"
 #include "target.h"
+#include <helper/binarybuffer.h>
 #include <helper/log.h>
 
 /* convert ELF header field to host endianness */
@@ -117,193 +118,266 @@ static int identify_image_type(struct image *image, const char *type_string, con
 	return ERROR_OK;
 }
 
+/* longest record we accept: count, 32 bit address, type, 255 data bytes
+ * and the checksum */
+#define IMAGE_RECORD_MAX_BYTES		(1 + 4 + 1 + 255 + 1)
+
+/**
+ * Get the whole text of a hex-record image, mapped if the host supports
+ * it or read in one go otherwise.  @a to_free is set to the buffer the
+ * caller must release, if any.
+ */
+static int image_records_text(struct fileio *fileio, const char **text,
+	size_t *text_size, char **to_free)
+{
+	const uint8_t *map;
+	size_t size_read;
+	int filesize;
+	int retval;
+
+	retval = fileio_size(fileio, &filesize);
+	if (retval != ERROR_OK)
+		return retval;
+
+	*to_free = NULL;
+	*text_size = filesize;
+
+	if (fileio_map(fileio, &map) == ERROR_OK) {
+		*text = (const char *)map;
+		return ERROR_OK;
+	}
+
+	*to_free = malloc(filesize + 1);
+	if (*to_free == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	retval = fileio_read(fileio, filesize, *to_free, &size_read);
+	if (retval != ERROR_OK) {
+		free(*to_free);
+		*to_free = NULL;
+		return retval;
+	}
+
+	*text = *to_free;
+	*text_size = size_read;
+	return ERROR_OK;
+}
+
+/**
+ * Split the next line off @a text, without its line ending and trailing
+ * blanks.  Returns false at the end of the text.
+ */
+static bool image_records_next_line(const char **text, const char *end,
+	const char **line, size_t *len)
+{
+	const char *eol;
+
+	if (*text >= end)
+		return false;
+
+	eol = memchr(*text, '\n', end - *text);
+	if (eol == NULL)
+		eol = end;
+
+	*line = *text;
+	*len = eol - *text;
+	*text = (eol < end) ? eol + 1 : end;
+
+	while (*len > 0 && isspace((unsigned char)(*line)[*len - 1]))
+		(*len)--;
+
+	return true;
+}
+
+/* decode the hex digits of one record, returns the number of bytes or -1 */
+static int image_records_decode(const char *hex, size_t len, uint8_t *record)
+{
+	int count = len / 2;
+
+	if ((len & 1) || count > IMAGE_RECORD_MAX_BYTES)
+		return -1;
+
+	if (unhexify((char *)record, hex, count) != count)
+		return -1;
+
+	return count;
+}
+
+/* start a new section at @a base, unless the current one is still empty,
+ * in which case this just specifies its base address */
+static int image_records_new_section(struct image *image,
+	struct imagesection *section, uint32_t base)
+{
+	if (section[image->num_sections].size != 0) {
+		image->num_sections++;
+		if (image->num_sections >= IMAGE_MAX_SECTIONS) {
+			/* too many sections */
+			LOG_ERROR("Too many sections found in image");
+			return ERROR_IMAGE_FORMAT_ERROR;
+		}
+		section[image->num_sections].size = 0x0;
+		section[image->num_sections].flags = 0;
+	}
+	section[image->num_sections].base_address = base;
+
+	return ERROR_OK;
+}
+
+/* append the payload of a data record to the current section, growing
+ * the buffer as decoded data comes in */
+static int image_records_add_data(struct image *image,
+	struct imagesection *section, uint8_t **buffer,
+	uint32_t *cooked_bytes, uint32_t *buffer_size,
+	const uint8_t *data, uint32_t count)
+{
+	if (*cooked_bytes + count > *buffer_size) {
+		uint32_t size = *buffer_size ? *buffer_size : 4096;
+		while (*cooked_bytes + count > size)
+			size *= 2;
+
+		uint8_t *new_buffer = realloc(*buffer, size);
+		if (new_buffer == NULL) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		*buffer = new_buffer;
+		*buffer_size = size;
+	}
+
+	memcpy(*buffer + *cooked_bytes, data, count);
+	*cooked_bytes += count;
+	section[image->num_sections].size += count;
+
+	return ERROR_OK;
+}
+
+/* finish the current section, trim the buffer to the decoded data and
+ * copy the section information to the image */
+static int image_records_finish(struct image *image,
+	struct imagesection *section, uint8_t **buffer, uint32_t cooked_bytes)
+{
+	uint32_t offset = 0;
+	int i;
+
+	image->num_sections++;
+
+	if (cooked_bytes > 0) {
+		uint8_t *new_buffer = realloc(*buffer, cooked_bytes);
+		if (new_buffer != NULL)
+			*buffer = new_buffer;
+	}
+
+	/* sections were decoded back to back, so their data follows in order */
+	image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
+	if (image->sections == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	for (i = 0; i < image->num_sections; i++) {
+		image->sections[i].private = *buffer + offset;
+		image->sections[i].base_address = section[i].base_address;
+		image->sections[i].size = section[i].size;
+		image->sections[i].flags = section[i].flags;
+		offset += section[i].size;
+	}
+
+	return ERROR_OK;
+}
+
 static int image_ihex_buffer_complete_inner(struct image *image,
-	char *lpszLine,
+	const char *text, const char *end,
 	struct imagesection *section)
 {
 	struct image_ihex *ihex = image->type_private;
-	struct fileio *fileio = &ihex->fileio;
 	uint32_t full_address = 0x0;
-	uint32_t cooked_bytes;
-	int i;
+	uint32_t cooked_bytes = 0x0;
+	uint32_t buffer_size = 0x0;
+	uint8_t record[IMAGE_RECORD_MAX_BYTES];
+	const char *line;
+	size_t len;
+	int retval;
 
 	/* we can't determine the number of sections that we'll have to create ahead of time,
 	 * so we locally hold them until parsing is finished */
-
-	int filesize;
-	int retval;
-	retval = fileio_size(fileio, &filesize);
-	if (retval != ERROR_OK)
-		return retval;
-
-	ihex->buffer = malloc(filesize >> 1);
-	cooked_bytes = 0x0;
 	image->num_sections = 0;
-	section[image->num_sections].private = &ihex->buffer[cooked_bytes];
 	section[image->num_sections].base_address = 0x0;
 	section[image->num_sections].size = 0x0;
 	section[image->num_sections].flags = 0;
 
-	while (fileio_fgets(fileio, 1023, lpszLine) == ERROR_OK) {
-		uint32_t count;
-		uint32_t address;
-		uint32_t record_type;
-		uint32_t checksum;
+	while (image_records_next_line(&text, end, &line, &len)) {
 		uint8_t cal_checksum = 0;
-		size_t bytes_read = 0;
+		uint32_t count, address, record_type;
+		const uint8_t *data;
+		int i, n;
 
-		if (lpszLine[0] == '#')
+		if (len == 0 || line[0] == '#')
 			continue;
 
-		if (sscanf(&lpszLine[bytes_read], ":%2" SCNx32 "%4" SCNx32 "%2" SCNx32, &count,
-			&address, &record_type) != 3)
+		/* ":" count(1) address(2) type(1) data(count) checksum(1) */
+		n = (line[0] == ':') ? image_records_decode(line + 1, len - 1, record) : -1;
+		if (n < 5 || n != record[0] + 5)
 			return ERROR_IMAGE_FORMAT_ERROR;
-		bytes_read += 9;
 
-		cal_checksum += (uint8_t)count;
-		cal_checksum += (uint8_t)(address >> 8);
-		cal_checksum += (uint8_t)address;
-		cal_checksum += (uint8_t)record_type;
+		for (i = 0; i < n; i++)
+			cal_checksum += record[i];
+		if (cal_checksum != 0) {
+			/* checksum failed */
+			LOG_ERROR("incorrect record checksum found in IHEX file");
+			return ERROR_IMAGE_CHECKSUM;
+		}
+
+		count = record[0];
+		address = be_to_h_u16(&record[1]);
+		record_type = record[3];
+		data = &record[4];
 
 		if (record_type == 0) {	/* Data Record */
 			if ((full_address & 0xffff) != address) {
-				/* we encountered a nonconsecutive location, create a new section,
-				 * unless the current section has zero size, in which case this specifies
-				 * the current section's base address
-				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-						/* too many sections */
-						LOG_ERROR("Too many sections found in IHEX file");
-						return ERROR_IMAGE_FORMAT_ERROR;
-					}
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&ihex->buffer[cooked_bytes];
-				}
-				section[image->num_sections].base_address =
-					(full_address & 0xffff0000) | address;
+				/* we encountered a nonconsecutive location */
 				full_address = (full_address & 0xffff0000) | address;
+				retval = image_records_new_section(image, section, full_address);
+				if (retval != ERROR_OK)
+					return retval;
 			}
 
-			while (count-- > 0) {
-				unsigned value;
-				sscanf(&lpszLine[bytes_read], "%2x", &value);
-				ihex->buffer[cooked_bytes] = (uint8_t)value;
-				cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
-				bytes_read += 2;
-				cooked_bytes += 1;
-				section[image->num_sections].size += 1;
-				full_address++;
-			}
+			retval = image_records_add_data(image, section, &ihex->buffer,
+					&cooked_bytes, &buffer_size, data, count);
+			if (retval != ERROR_OK)
+				return retval;
+			full_address += count;
 		} else if (record_type == 1) {	/* End of File Record */
-			/* finish the current section */
-			image->num_sections++;
-
-			/* copy section information */
-			image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
-			for (i = 0; i < image->num_sections; i++) {
-				image->sections[i].private = section[i].private;
-				image->sections[i].base_address = section[i].base_address;
-				image->sections[i].size = section[i].size;
-				image->sections[i].flags = section[i].flags;
-			}
-
-			return ERROR_OK;
-		} else if (record_type == 2) {	/* Linear Address Record */
-			uint16_t upper_address;
-
-			sscanf(&lpszLine[bytes_read], "%4hx", &upper_address);
-			cal_checksum += (uint8_t)(upper_address >> 8);
-			cal_checksum += (uint8_t)upper_address;
-			bytes_read += 4;
-
-			if ((full_address >> 4) != upper_address) {
-				/* we encountered a nonconsecutive location, create a new section,
-				 * unless the current section has zero size, in which case this specifies
-				 * the current section's base address
-				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-						/* too many sections */
-						LOG_ERROR("Too many sections found in IHEX file");
-						return ERROR_IMAGE_FORMAT_ERROR;
-					}
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&ihex->buffer[cooked_bytes];
-				}
-				section[image->num_sections].base_address =
-					(full_address & 0xffff) | (upper_address << 4);
-				full_address = (full_address & 0xffff) | (upper_address << 4);
+			return image_records_finish(image, section, &ihex->buffer, cooked_bytes);
+		} else if (record_type == 2 || record_type == 4) {
+			/* Linear Address Record or Extended Linear Address Record */
+			unsigned shift = (record_type == 2) ? 4 : 16;
+			uint32_t upper_address;
+
+			if (count < 2)
+				return ERROR_IMAGE_FORMAT_ERROR;
+			upper_address = be_to_h_u16(data);
+
+			if ((full_address >> shift) != upper_address) {
+				/* we encountered a nonconsecutive location */
+				full_address = (full_address & 0xffff) | (upper_address << shift);
+				retval = image_records_new_section(image, section, full_address);
+				if (retval != ERROR_OK)
+					return retval;
 			}
 		} else if (record_type == 3) {	/* Start Segment Address Record */
-			uint32_t dummy;
-
 			/* "Start Segment Address Record" will not be supported
 			 * but we must consume it, and do not create an error.  */
-			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2" SCNx32, &dummy);
-				cal_checksum += (uint8_t)dummy;
-				bytes_read += 2;
-			}
-		} else if (record_type == 4) {	/* Extended Linear Address Record */
-			uint16_t upper_address;
-
-			sscanf(&lpszLine[bytes_read], "%4hx", &upper_address);
-			cal_checksum += (uint8_t)(upper_address >> 8);
-			cal_checksum += (uint8_t)upper_address;
-			bytes_read += 4;
-
-			if ((full_address >> 16) != upper_address) {
-				/* we encountered a nonconsecutive location, create a new section,
-				 * unless the current section has zero size, in which case this specifies
-				 * the current section's base address
-				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-						/* too many sections */
-						LOG_ERROR("Too many sections found in IHEX file");
-						return ERROR_IMAGE_FORMAT_ERROR;
-					}
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&ihex->buffer[cooked_bytes];
-				}
-				section[image->num_sections].base_address =
-					(full_address & 0xffff) | (upper_address << 16);
-				full_address = (full_address & 0xffff) | (upper_address << 16);
-			}
 		} else if (record_type == 5) {	/* Start Linear Address Record */
-			uint32_t start_address;
-
-			sscanf(&lpszLine[bytes_read], "%8" SCNx32, &start_address);
-			cal_checksum += (uint8_t)(start_address >> 24);
-			cal_checksum += (uint8_t)(start_address >> 16);
-			cal_checksum += (uint8_t)(start_address >> 8);
-			cal_checksum += (uint8_t)start_address;
-			bytes_read += 8;
+			if (count < 4)
+				return ERROR_IMAGE_FORMAT_ERROR;
 
 			image->start_address_set = 1;
-			image->start_address = be_to_h_u32((uint8_t *)&start_address);
+			image->start_address = be_to_h_u32(data);
 		} else {
 			LOG_ERROR("unhandled IHEX record type: %i", (int)record_type);
 			return ERROR_IMAGE_FORMAT_ERROR;
 		}
-
-		sscanf(&lpszLine[bytes_read], "%2" SCNx32, &checksum);
-
-		if ((uint8_t)checksum != (uint8_t)(~cal_checksum + 1)) {
-			/* checksum failed */
-			LOG_ERROR("incorrect record checksum found in IHEX file");
-			return ERROR_IMAGE_CHECKSUM;
-		}
 	}
 
 	LOG_ERROR("premature end of IHEX file, no end-of-file record found");
@@ -316,23 +390,31 @@ static int image_ihex_buffer_complete_inner(struct image *image,
  */
 static int image_ihex_buffer_complete(struct image *image)
 {
-	char *lpszLine = malloc(1023);
-	if (lpszLine == NULL) {
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
-	}
+	struct image_ihex *ihex = image->type_private;
+	const char *text;
+	size_t text_size;
+	char *to_free;
+	int retval;
+
+	ihex->buffer = NULL;
+
 	struct imagesection *section = malloc(sizeof(struct imagesection) * IMAGE_MAX_SECTIONS);
 	if (section == NULL) {
-		free(lpszLine);
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
-	int retval;
 
-	retval = image_ihex_buffer_complete_inner(image, lpszLine, section);
+	retval = image_records_text(&ihex->fileio, &text, &text_size, &to_free);
+	if (retval == ERROR_OK)
+		retval = image_ihex_buffer_complete_inner(image, text, text + text_size, section);
+
+	if (retval != ERROR_OK) {
+		free(ihex->buffer);
+		ihex->buffer = NULL;
+	}
 
+	free(to_free);
 	free(section);
-	free(lpszLine);
 
 	return retval;
 }
@@ -481,10 +563,18 @@ static int image_elf_read_section(struct image *image,
 
 	/* read initialized data in current segment if any */
 	if (offset < field32(elf, segment->p_filesz)) {
+		const uint8_t *data;
+
 		/* maximal size present in file for the current segment */
 		read_size = MIN(size, field32(elf, segment->p_filesz) - offset);
 		LOG_DEBUG("read elf: size = 0x%zu at 0x%" PRIx32 "", read_size,
 			field32(elf, segment->p_offset) + offset);
+		/* copy straight out of the mapped file if we can */
+		if (image_section_data(image, section, &data) == ERROR_OK) {
+			memcpy(buffer, data + offset, read_size);
+			*size_read += read_size;
+			return ERROR_OK;
+		}
 		/* read initialized area of the segment */
 		retval = fileio_seek(&elf->fileio, field32(elf, segment->p_offset) + offset);
 		if (retval != ERROR_OK) {
@@ -507,157 +597,93 @@ static int image_elf_read_section(struct image *image,
 }
 
 static int image_mot_buffer_complete_inner(struct image *image,
-	char *lpszLine,
+	const char *text, const char *end,
 	struct imagesection *section)
 {
 	struct image_mot *mot = image->type_private;
-	struct fileio *fileio = &mot->fileio;
 	uint32_t full_address = 0x0;
-	uint32_t cooked_bytes;
-	int i;
+	uint32_t cooked_bytes = 0x0;
+	uint32_t buffer_size = 0x0;
+	uint8_t record[IMAGE_RECORD_MAX_BYTES];
+	const char *line;
+	size_t len;
+	int retval;
 
 	/* we can't determine the number of sections that we'll have to create ahead of time,
 	 * so we locally hold them until parsing is finished */
-
-	int retval;
-	int filesize;
-	retval = fileio_size(fileio, &filesize);
-	if (retval != ERROR_OK)
-		return retval;
-
-	mot->buffer = malloc(filesize >> 1);
-	cooked_bytes = 0x0;
 	image->num_sections = 0;
-	section[image->num_sections].private = &mot->buffer[cooked_bytes];
 	section[image->num_sections].base_address = 0x0;
 	section[image->num_sections].size = 0x0;
 	section[image->num_sections].flags = 0;
 
-	while (fileio_fgets(fileio, 1023, lpszLine) == ERROR_OK) {
-		uint32_t count;
-		uint32_t address;
-		uint32_t record_type;
-		uint32_t checksum;
+	while (image_records_next_line(&text, end, &line, &len)) {
 		uint8_t cal_checksum = 0;
-		uint32_t bytes_read = 0;
+		uint32_t count, address, record_type;
+		const uint8_t *data;
+		int i, n;
+
+		if (len == 0)
+			continue;
 
-		/* get record type and record length */
-		if (sscanf(&lpszLine[bytes_read], "S%1" SCNx32 "%2" SCNx32, &record_type,
-			&count) != 2)
+		/* "S" type count(1) address(2..4) data checksum(1) */
+		if (len < 2 || line[0] != 'S' || !isxdigit((unsigned char)line[1]))
 			return ERROR_IMAGE_FORMAT_ERROR;
+		record_type = isdigit((unsigned char)line[1]) ? line[1] - '0' : 10;
 
-		bytes_read += 4;
-		cal_checksum += (uint8_t)count;
+		n = image_records_decode(line + 2, len - 2, record);
+		if (n < 2 || n != record[0] + 1)
+			return ERROR_IMAGE_FORMAT_ERROR;
 
-		/* skip checksum byte */
-		count -= 1;
+		/* account for checksum, will always be 0xFF */
+		for (i = 0; i < n; i++)
+			cal_checksum += record[i];
+		if (cal_checksum != 0xFF) {
+			/* checksum failed */
+			LOG_ERROR("incorrect record checksum found in S19 file");
+			return ERROR_IMAGE_CHECKSUM;
+		}
+
+		/* skip count and checksum byte */
+		count = n - 2;
+		data = &record[1];
 
 		if (record_type == 0) {
 			/* S0 - starting record (optional) */
-			int iValue;
-
-			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2x", &iValue);
-				cal_checksum += (uint8_t)iValue;
-				bytes_read += 2;
-			}
 		} else if (record_type >= 1 && record_type <= 3) {
-			switch (record_type) {
-				case 1:
-					/* S1 - 16 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%4" SCNx32, &address);
-					cal_checksum += (uint8_t)(address >> 8);
-					cal_checksum += (uint8_t)address;
-					bytes_read += 4;
-					count -= 2;
-					break;
-
-				case 2:
-					/* S2 - 24 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%6" SCNx32, &address);
-					cal_checksum += (uint8_t)(address >> 16);
-					cal_checksum += (uint8_t)(address >> 8);
-					cal_checksum += (uint8_t)address;
-					bytes_read += 6;
-					count -= 3;
-					break;
-
-				case 3:
-					/* S3 - 32 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%8" SCNx32, &address);
-					cal_checksum += (uint8_t)(address >> 24);
-					cal_checksum += (uint8_t)(address >> 16);
-					cal_checksum += (uint8_t)(address >> 8);
-					cal_checksum += (uint8_t)address;
-					bytes_read += 8;
-					count -= 4;
-					break;
+			/* S1, S2, S3 - 16, 24 and 32 bit address data records */
+			uint32_t address_bytes = record_type + 1;
 
-			}
+			if (count < address_bytes)
+				return ERROR_IMAGE_FORMAT_ERROR;
+
+			address = 0;
+			for (i = 0; i < (int)address_bytes; i++)
+				address = (address << 8) | data[i];
+			data += address_bytes;
+			count -= address_bytes;
 
 			if (full_address != address) {
-				/* we encountered a nonconsecutive location, create a new section,
-				 * unless the current section has zero size, in which case this specifies
-				 * the current section's base address
-				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&mot->buffer[cooked_bytes];
-				}
-				section[image->num_sections].base_address = address;
+				/* we encountered a nonconsecutive location */
 				full_address = address;
+				retval = image_records_new_section(image, section, full_address);
+				if (retval != ERROR_OK)
+					return retval;
 			}
 
-			while (count-- > 0) {
-				unsigned value;
-				sscanf(&lpszLine[bytes_read], "%2x", &value);
-				mot->buffer[cooked_bytes] = (uint8_t)value;
-				cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
-				bytes_read += 2;
-				cooked_bytes += 1;
-				section[image->num_sections].size += 1;
-				full_address++;
-			}
+			retval = image_records_add_data(image, section, &mot->buffer,
+					&cooked_bytes, &buffer_size, data, count);
+			if (retval != ERROR_OK)
+				return retval;
+			full_address += count;
 		} else if (record_type == 5) {
 			/* S5 is the data count record, we ignore it */
-			uint32_t dummy;
-
-			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2" SCNx32, &dummy);
-				cal_checksum += (uint8_t)dummy;
-				bytes_read += 2;
-			}
 		} else if (record_type >= 7 && record_type <= 9) {
 			/* S7, S8, S9 - ending records for 32, 24 and 16bit */
-			image->num_sections++;
-
-			/* copy section information */
-			image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
-			for (i = 0; i < image->num_sections; i++) {
-				image->sections[i].private = section[i].private;
-				image->sections[i].base_address = section[i].base_address;
-				image->sections[i].size = section[i].size;
-				image->sections[i].flags = section[i].flags;
-			}
-
-			return ERROR_OK;
+			return image_records_finish(image, section, &mot->buffer, cooked_bytes);
 		} else {
 			LOG_ERROR("unhandled S19 record type: %i", (int)(record_type));
 			return ERROR_IMAGE_FORMAT_ERROR;
 		}
-
-		/* account for checksum, will always be 0xFF */
-		sscanf(&lpszLine[bytes_read], "%2" SCNx32, &checksum);
-		cal_checksum += (uint8_t)checksum;
-
-		if (cal_checksum != 0xFF) {
-			/* checksum failed */
-			LOG_ERROR("incorrect record checksum found in S19 file");
-			return ERROR_IMAGE_CHECKSUM;
-		}
 	}
 
 	LOG_ERROR("premature end of S19 file, no end-of-file record found");
@@ -670,23 +696,31 @@ static int image_mot_buffer_complete_inner(struct image *image,
  */
 static int image_mot_buffer_complete(struct image *image)
 {
-	char *lpszLine = malloc(1023);
-	if (lpszLine == NULL) {
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
-	}
+	struct image_mot *mot = image->type_private;
+	const char *text;
+	size_t text_size;
+	char *to_free;
+	int retval;
+
+	mot->buffer = NULL;
+
 	struct imagesection *section = malloc(sizeof(struct imagesection) * IMAGE_MAX_SECTIONS);
 	if (section == NULL) {
-		free(lpszLine);
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
-	int retval;
 
-	retval = image_mot_buffer_complete_inner(image, lpszLine, section);
+	retval = image_records_text(&mot->fileio, &text, &text_size, &to_free);
+	if (retval == ERROR_OK)
+		retval = image_mot_buffer_complete_inner(image, text, text + text_size, section);
 
+	if (retval != ERROR_OK) {
+		free(mot->buffer);
+		mot->buffer = NULL;
+	}
+
+	free(to_free);
 	free(section);
-	free(lpszLine);
 
 	return retval;
 }
@@ -807,6 +841,57 @@ int image_open(struct image *image, const char *url, const char *type_string)
 	return retval;
 };
 
+/**
+ * Get a read-only view of a whole section without copying it.  Plain
+ * binary and ELF sections are served from a mapping of the image file,
+ * sections of the text formats from the buffers they were decoded into.
+ * The view stays valid until image_close().
+ *
+ * @returns ERROR_FILEIO_OPERATION_NOT_SUPPORTED if the section has no
+ * backing store that can be handed out (e.g. target memory images, or
+ * hosts without mmap); use image_read_section() then.
+ */
+int image_section_data(struct image *image, int section, const uint8_t **data)
+{
+	int retval;
+	int filesize;
+
+	if (image->type == IMAGE_BINARY) {
+		struct image_binary *image_binary = image->type_private;
+
+		if (section != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		return fileio_map(&image_binary->fileio, data);
+	} else if (image->type == IMAGE_ELF) {
+		struct image_elf *elf = image->type_private;
+		Elf32_Phdr *segment = (Elf32_Phdr *)image->sections[section].private;
+		uint32_t offset = field32(elf, segment->p_offset);
+
+		/* only hand out segments lying completely inside the file */
+		retval = fileio_size(&elf->fileio, &filesize);
+		if (retval != ERROR_OK)
+			return retval;
+		if (offset > (uint32_t)filesize
+				|| image->sections[section].size > (uint32_t)filesize - offset)
+			return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+		const uint8_t *map;
+		retval = fileio_map(&elf->fileio, &map);
+		if (retval != ERROR_OK)
+			return retval;
+
+		*data = map + offset;
+		return ERROR_OK;
+	} else if (image->type == IMAGE_IHEX || image->type == IMAGE_SRECORD
+			|| image->type == IMAGE_BUILDER) {
+		*data = image->sections[section].private;
+		return ERROR_OK;
+	}
+
+	return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+}
+
 int image_read_section(struct image *image,
 	int section,
 	uint32_t offset,
@@ -833,6 +918,14 @@ int image_read_section(struct image *image,
 		if (section != 0)
 			return ERROR_COMMAND_SYNTAX_ERROR;
 
+		/* copy straight out of the mapped file if we can */
+		const uint8_t *data;
+		if (image_section_data(image, section, &data) == ERROR_OK) {
+			memcpy(buffer, data + offset, size);
+			*size_read = size;
+			return ERROR_OK;
+		}
+
 		/* seek to offset */
 		retval = fileio_seek(&image_binary->fileio, offset);
 		if (retval != ERROR_OK)
@@ -1004,12 +1097,15 @@ void image_close(struct image *image)
 	}
 }
 
-int image_calculate_checksum(uint8_t *buffer, uint32_t nbytes, uint32_t *checksum)
+int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *checksum)
 {
 	uint32_t crc = 0xffffffff;
 	LOG_DEBUG("Calculating checksum");
 
-	static uint32_t crc32_table[256];
+	/* crc32_table[0] is the byte-wise table, crc32_table[k] advances a byte
+	 * through k further zero bytes so 8 bytes can be folded in at a time
+	 * ("slice-by-8") */
+	static uint32_t crc32_table[8][256];
 
 	static bool first_init;
 	if (!first_init) {
@@ -1020,7 +1116,13 @@ int image_calculate_checksum(uint8_t *buffer, uint32_t nbytes, uint32_t *checksu
 			/* as per gdb */
 			for (c = i << 24, j = 8; j > 0; --j)
 				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
+			crc32_table[0][i] = c;
+		}
+		for (i = 0; i < 256; i++) {
+			for (j = 1; j < 8; j++) {
+				c = crc32_table[j - 1][i];
+				crc32_table[j][i] = (c << 8) ^ crc32_table[0][c >> 24];
+			}
 		}
 
 		first_init = true;
@@ -1031,9 +1133,23 @@ int image_calculate_checksum(uint8_t *buffer, uint32_t nbytes, uint32_t *checksu
 		if (run > 32768)
 			run = 32768;
 		nbytes -= run;
+		while (run >= 8) {
+			crc ^= ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) |
+				((uint32_t)buffer[2] << 8) | buffer[3];
+			crc = crc32_table[7][crc >> 24] ^
+				crc32_table[6][(crc >> 16) & 255] ^
+				crc32_table[5][(crc >> 8) & 255] ^
+				crc32_table[4][crc & 255] ^
+				crc32_table[3][buffer[4]] ^
+				crc32_table[2][buffer[5]] ^
+				crc32_table[1][buffer[6]] ^
+				crc32_table[0][buffer[7]];
+			buffer += 8;
+			run -= 8;
+		}
 		while (run--) {
 			/* as per gdb */
-			crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
+			crc = (crc << 8) ^ crc32_table[0][((crc >> 24) ^ *buffer++) & 255];
 		}
 		keep_alive();
 	}
@@ -34,6 +34,8 @@
 #include "breakpoints.h"
 #include "algorithm.h"
 #include "register.h"
+#include "trace.h"
+#include <helper/time_support.h>
 
 static const char *mips_isa_strings[] = {
     "MIPS32", "MIPS16"
@@ -364,51 +366,31 @@ int mips32_init_arch_info(struct target *target, struct mips32_common *mips32, s
     return ERROR_OK;
 }
 
-/* run to exit point. return error if exit point was not reached. */
-static int mips32_run_and_wait(struct target *target, uint32_t entry_point,
-			       int timeout_ms, uint32_t exit_point, struct mips32_common *mips32)
+int mips32_run_algorithm(struct target *target, int num_mem_params,
+			 struct mem_param *mem_params, int num_reg_params,
+			 struct reg_param *reg_params, uint32_t entry_point,
+			 uint32_t exit_point, int timeout_ms, void *arch_info)
 {
-    uint32_t pc;
-    int retval;
+	int retval;
 
-    /* This code relies on the target specific  resume() and  poll()->debug_entry()
-     * sequence to write register values to the processor and the read them back */
-    retval = target_resume(target, 0, entry_point, 0, 1);
-    if (retval != ERROR_OK)
+	retval = mips32_start_algorithm(target, num_mem_params, mem_params,
+			num_reg_params, reg_params, entry_point, exit_point, arch_info);
+	if (retval != ERROR_OK)
 		return retval;
 
-    retval = target_wait_state(target, TARGET_HALTED, timeout_ms);
-    /* If the target fails to halt due to the breakpoint, force a halt */
-    if (retval != ERROR_OK || target->state != TARGET_HALTED) {
-		retval = target_halt(target);
-		if (retval != ERROR_OK)
-			return retval;
-		retval = target_wait_state(target, TARGET_HALTED, 500);
-		if (retval != ERROR_OK)
-			return retval;
-
-		return ERROR_TARGET_TIMEOUT;
-    }
-
-    pc = buf_get_u32(mips32->core_cache->reg_list[MIPS32_PC].value, 0, 32);
-    if (exit_point && (pc != exit_point)) {
-		LOG_DEBUG("failed algorithm halted at 0x%" PRIx32 " ", pc);
-		return ERROR_TARGET_TIMEOUT;
-    }
-
-    return ERROR_OK;
+	return mips32_wait_algorithm(target, num_mem_params, mem_params,
+			num_reg_params, reg_params, exit_point, timeout_ms, arch_info);
 }
 
-int mips32_run_algorithm(struct target *target, int num_mem_params,
+/* save the context into arch_info, load the parameters and resume at
+ * entry_point; the algorithm keeps running until mips32_wait_algorithm */
+int mips32_start_algorithm(struct target *target, int num_mem_params,
 			 struct mem_param *mem_params, int num_reg_params,
 			 struct reg_param *reg_params, uint32_t entry_point,
-			 uint32_t exit_point, int timeout_ms, void *arch_info)
+			 uint32_t exit_point, void *arch_info)
 {
 	struct mips32_common *mips32 = target_to_mips32(target);
 	struct mips32_algorithm *mips32_algorithm_info = arch_info;
-	enum mips32_isa_mode isa_mode = mips32->isa_mode;
-
-	uint32_t context[MIPS32NUMCOREREGS];
 	int i;
 	int retval = ERROR_OK;
 
@@ -432,8 +414,10 @@ int mips32_run_algorithm(struct target *target, int num_mem_params,
 		if (!mips32->core_cache->reg_list[i].valid)
 			mips32->read_core_reg(target, i);
 
-		context[i] = buf_get_u32(mips32->core_cache->reg_list[i].value, 0, 32);
+		mips32_algorithm_info->context[i] =
+			buf_get_u32(mips32->core_cache->reg_list[i].value, 0, 32);
 	}
+	mips32_algorithm_info->saved_isa_mode = mips32->isa_mode;
 
 	for (i = 0; i < num_mem_params; i++) {
 		retval = target_write_buffer(target, mem_params[i].address,
@@ -462,9 +446,43 @@ int mips32_run_algorithm(struct target *target, int num_mem_params,
 
 	mips32->isa_mode = mips32_algorithm_info->isa_mode;
 
-	retval = mips32_run_and_wait(target, entry_point, timeout_ms, exit_point, mips32);
-	if (retval != ERROR_OK)
-		return retval;
+	/* This code relies on the target specific  resume() and  poll()->debug_entry()
+	 * sequence to write register values to the processor and the read them back */
+	return target_resume(target, 0, entry_point, 0, 1);
+}
+
+/* wait for the exit point, read back the parameters and restore the
+ * context saved by mips32_start_algorithm */
+int mips32_wait_algorithm(struct target *target, int num_mem_params,
+			 struct mem_param *mem_params, int num_reg_params,
+			 struct reg_param *reg_params, uint32_t exit_point,
+			 int timeout_ms, void *arch_info)
+{
+	struct mips32_common *mips32 = target_to_mips32(target);
+	struct mips32_algorithm *mips32_algorithm_info = arch_info;
+	uint32_t *context = mips32_algorithm_info->context;
+	uint32_t pc;
+	int i;
+	int retval;
+
+	retval = target_wait_state(target, TARGET_HALTED, timeout_ms);
+	/* If the target fails to halt due to the breakpoint, force a halt */
+	if (retval != ERROR_OK || target->state != TARGET_HALTED) {
+		retval = target_halt(target);
+		if (retval != ERROR_OK)
+			return retval;
+		retval = target_wait_state(target, TARGET_HALTED, 500);
+		if (retval != ERROR_OK)
+			return retval;
+
+		return ERROR_TARGET_TIMEOUT;
+	}
+
+	pc = buf_get_u32(mips32->core_cache->reg_list[MIPS32_PC].value, 0, 32);
+	if (exit_point && (pc != exit_point)) {
+		LOG_DEBUG("failed algorithm halted at 0x%" PRIx32 " ", pc);
+		return ERROR_TARGET_TIMEOUT;
+	}
 
 	for (i = 0; i < num_mem_params; i++) {
 		if (mem_params[i].direction != PARAM_OUT) {
@@ -508,7 +526,7 @@ int mips32_run_algorithm(struct target *target, int num_mem_params,
 		}
 	}
 
-	mips32->isa_mode = isa_mode;
+	mips32->isa_mode = mips32_algorithm_info->saved_isa_mode;
 
 	return ERROR_OK;
 }
@@ -674,59 +692,113 @@ int mips32_enable_interrupts(struct target *target, int enable)
     return ERROR_OK;
 }
 
+/* the crc loaders index a 256 entry table, uploaded behind the code */
+static void mips32_crc_table(struct target *target, uint8_t *buffer)
+{
+	static uint32_t crc32_table[256];
+
+	if (!crc32_table[1]) {
+		for (int i = 0; i < 256; i++) {
+			uint32_t c = i << 24;
+			for (int j = 0; j < 8; j++)
+				c = (c & 0x80000000) ? (c << 1) ^ 0x04c11db7 : (c << 1);
+			crc32_table[i] = c;
+		}
+	}
+
+	target_buffer_set_u32_array(target, buffer, ARRAY_SIZE(crc32_table), crc32_table);
+}
+
+/* copy the code for the isa the core executes into a buffer in target endianness */
+static unsigned mips32_loader_code(struct target *target, uint8_t *buffer,
+		const uint32_t *mips_code, unsigned mips_count,
+		const uint16_t *mmips_code, unsigned mmips_count,
+		struct mips32_algorithm *mips32_info)
+{
+	struct mips32_common *mips32 = target_to_mips32(target);
+
+	mips32_info->common_magic = MIPS32_COMMON_MAGIC;
+
+	if (mips32->mmips == MICRO_MIPS_ONLY) {
+		mips32_info->isa_mode = MIPS32_ISA_MMIPS32;
+		target_buffer_set_u16_array(target, buffer, mmips_count, mmips_code);
+		return mmips_count * 2;
+	}
+
+	mips32_info->isa_mode = MIPS32_ISA_MIPS32;
+	target_buffer_set_u32_array(target, buffer, mips_count, mips_code);
+	return mips_count * 4;
+}
+
 int mips32_checksum_memory(struct target *target, uint32_t address,
 			   uint32_t count, uint32_t *checksum)
 {
     struct working_area *crc_algorithm;
-    struct reg_param reg_params[2];
+    struct reg_param reg_params[3];
     struct mips32_algorithm mips32_info;
 
     /* see contib/loaders/checksum/mips32.s for src */
 
     static const uint32_t mips_crc_code[] = {
-		0x248C0000,		/* addiu	$t4, $a0, 0 */
-		0x24AA0000,		/* addiu	$t2, $a1, 0 */
+		0x00854821,		/* addu		$t1, $a0, $a1 */
+		0x24880000,		/* addiu	$t0, $a0, 0 */
+		0x1109000B,		/* beq		$t0, $t1, done */
 		0x2404FFFF,		/* addiu	$a0, $zero, 0xffffffff */
-		0x10000010,		/* beq		$zero, $zero, ncomp */
-		0x240B0000,		/* addiu	$t3, $zero, 0 */
 
 		/* nbyte: */
-		0x81850000,		/* lb		$a1, ($t4) */
-		0x218C0001,		/* addi		$t4, $t4, 1 */
-		0x00052E00,		/* sll		$a1, $a1, 24 */
-		0x3C0204C1,		/* lui		$v0, 0x04c1 */
-		0x00852026,		/* xor		$a0, $a0, $a1 */
-		0x34471DB7,		/* ori		$a3, $v0, 0x1db7 */
-		0x00003021,		/* addu		$a2, $zero, $zero */
-		/* loop: */
-		0x00044040,		/* sll		$t0, $a0, 1 */
-		0x24C60001,		/* addiu	$a2, $a2, 1 */
-		0x28840000,		/* slti		$a0, $a0, 0 */
-		0x01074826,		/* xor		$t1, $t0, $a3 */
-		0x0124400B,		/* movn		$t0, $t1, $a0 */
-		0x28C30008,		/* slti		$v1, $a2, 8 */
-		0x1460FFF9,		/* bne		$v1, $zero, loop */
-		0x01002021,		/* addu		$a0, $t0, $zero */
-
-		/* ncomp: */
-		0x154BFFF0,		/* bne		$t2, $t3, nbyte */
-		0x256B0001,		/* addiu	$t3, $t3, 1 */
+		0x910A0000,		/* lbu		$t2, ($t0) */
+		0x00045E02,		/* srl		$t3, $a0, 24 */
+		0x016A5826,		/* xor		$t3, $t3, $t2 */
+		0x000B5880,		/* sll		$t3, $t3, 2 */
+		0x01665821,		/* addu		$t3, $t3, $a2 */
+		0x8D6B0000,		/* lw		$t3, ($t3) */
+		0x25080001,		/* addiu	$t0, $t0, 1 */
+		0x00042200,		/* sll		$a0, $a0, 8 */
+		0x1509FFF7,		/* bne		$t0, $t1, nbyte */
+		0x008B2026,		/* xor		$a0, $a0, $t3 */
+
+		/* done: */
 		0x7000003F,		/* sdbbp */
     };
 
-    /* make sure we have a working area */
-    if (target_alloc_working_area(target, sizeof(mips_crc_code), &crc_algorithm) != ERROR_OK)
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+    /* see contib/loaders/checksum/micromips.s for src */
+
+    static const uint16_t mmips_crc_code[] = {
+		0x00A4, 0x4950,		/* addu		$t1, $a0, $a1 */
+		0x3104, 0x0000,		/* addiu	$t0, $a0, 0 */
+		0x9528, 0x0016,		/* beq		$t0, $t1, done */
+		0x3080, 0xFFFF,		/* addiu	$a0, $zero, 0xffffffff */
 
-    /* convert flash writing code into a buffer in target endianness */
-	uint8_t mips_crc_code_8[sizeof(mips_crc_code)];
-	target_buffer_set_u32_array(target, mips_crc_code_8,
-					ARRAY_SIZE(mips_crc_code), mips_crc_code);
+		/* nbyte: */
+		0x1548, 0x0000,		/* lbu		$t2, ($t0) */
+		0x0164, 0xC040,		/* srl		$t3, $a0, 24 */
+		0x014B, 0x5B10,		/* xor		$t3, $t3, $t2 */
+		0x016B, 0x1000,		/* sll		$t3, $t3, 2 */
+		0x00CB, 0x5950,		/* addu		$t3, $t3, $a2 */
+		0xFD6B, 0x0000,		/* lw		$t3, ($t3) */
+		0x3108, 0x0001,		/* addiu	$t0, $t0, 1 */
+		0x0084, 0x4000,		/* sll		$a0, $a0, 8 */
+		0xB528, 0xFFEE,		/* bne		$t0, $t1, nbyte */
+		0x0164, 0x2310,		/* xor		$a0, $a0, $t3 */
+
+		/* done: */
+		0x0000, 0xDB7C,		/* sdbbp */
+    };
 
-	target_write_buffer(target, crc_algorithm->address, sizeof(mips_crc_code), mips_crc_code_8);
+    /* code followed by the crc table, in target endianness */
+	uint8_t crc_code_8[sizeof(mips_crc_code) + 256 * 4];
+	unsigned code_size = mips32_loader_code(target, crc_code_8,
+			mips_crc_code, ARRAY_SIZE(mips_crc_code),
+			mmips_crc_code, ARRAY_SIZE(mmips_crc_code), &mips32_info);
+	mips32_crc_table(target, crc_code_8 + code_size);
 
-    mips32_info.common_magic = MIPS32_COMMON_MAGIC;
-    mips32_info.isa_mode = MIPS32_ISA_MIPS32;
+    /* make sure we have a working area, the code stays resident across calls */
+	if (target_alloc_working_area_code(target, crc_code_8,
+			code_size + 256 * 4, &crc_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+    /* microMIPS code is entered, and halts, with the isa bit set */
+    uint32_t isa = (mips32_info.isa_mode == MIPS32_ISA_MMIPS32) ? 1 : 0;
 
     init_reg_param(&reg_params[0], "a0", 32, PARAM_IN_OUT);
     buf_set_u32(reg_params[0].value, 0, 32, address);
@@ -734,10 +806,14 @@ int mips32_checksum_memory(struct target *target, uint32_t address,
     init_reg_param(&reg_params[1], "a1", 32, PARAM_OUT);
     buf_set_u32(reg_params[1].value, 0, 32, count);
 
+    init_reg_param(&reg_params[2], "a2", 32, PARAM_OUT);
+    buf_set_u32(reg_params[2].value, 0, 32, crc_algorithm->address + code_size);
+
     int timeout = (20000 * (1 + (count / (1024 * 1024))) * 2);
 
-    int retval = target_run_algorithm(target, 0, NULL, 2, reg_params,
-				  crc_algorithm->address, crc_algorithm->address + (sizeof(mips_crc_code)-4), timeout,
+    int retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
+				  crc_algorithm->address | isa,
+				  (crc_algorithm->address + code_size - 4) | isa, timeout,
 				  &mips32_info);
 
 	if (retval == ERROR_OK)
@@ -745,6 +821,7 @@ int mips32_checksum_memory(struct target *target, uint32_t address,
 
     destroy_reg_param(&reg_params[0]);
     destroy_reg_param(&reg_params[1]);
+    destroy_reg_param(&reg_params[2]);
 
     target_free_working_area(target, crc_algorithm);
 
@@ -759,29 +836,110 @@ int mips32_blank_check_memory(struct target *target,
     struct reg_param reg_params[3];
     struct mips32_algorithm mips32_info;
 
+    /* see contib/loaders/erase_check/mips32_erase_check.s for src */
+
     static const uint32_t erase_check_code[] = {
-		/* nbyte: */
-		0x80880000,		/* lb		$t0, ($a0) */
-		0x00C83024,		/* and		$a2, $a2, $t0 */
-		0x24A5FFFF,		/* addiu	$a1, $a1, -1 */
-		0x14A0FFFC,		/* bne		$a1, $zero, nbyte */
+		0x00854021,		/* addu		$t0, $a0, $a1 */
+		0x2409FFFF,		/* addiu	$t1, $zero, 0xffffffff */
+
+		/* head: */
+		0x10880016,		/* beq		$a0, $t0, fold */
+		0x308A0003,		/* andi		$t2, $a0, 3 */
+		0x11400005,		/* beq		$t2, $zero, words */
+		0x00000000,		/* nop */
+		0x908A0000,		/* lbu		$t2, ($a0) */
+		0x24840001,		/* addiu	$a0, $a0, 1 */
+		0x1000FFF9,		/* b		head */
+		0x00CA3024,		/* and		$a2, $a2, $t2 */
+
+		/* words: */
+		0x01045823,		/* subu		$t3, $t0, $a0 */
+		0x000B5882,		/* srl		$t3, $t3, 2 */
+		0x000B5880,		/* sll		$t3, $t3, 2 */
+		0x11600005,		/* beq		$t3, $zero, tail */
+		0x01645821,		/* addu		$t3, $t3, $a0 */
+		/* wloop: */
+		0x8C8A0000,		/* lw		$t2, ($a0) */
+		0x24840004,		/* addiu	$a0, $a0, 4 */
+		0x148BFFFD,		/* bne		$a0, $t3, wloop */
+		0x012A4824,		/* and		$t1, $t1, $t2 */
+
+		/* tail: */
+		0x10880005,		/* beq		$a0, $t0, fold */
+		0x00000000,		/* nop */
+		0x908A0000,		/* lbu		$t2, ($a0) */
 		0x24840001,		/* addiu	$a0, $a0, 1 */
+		0x1000FFFB,		/* b		tail */
+		0x00CA3024,		/* and		$a2, $a2, $t2 */
+
+		/* fold: */
+		0x00095402,		/* srl		$t2, $t1, 16 */
+		0x012A4824,		/* and		$t1, $t1, $t2 */
+		0x00095202,		/* srl		$t2, $t1, 8 */
+		0x012A4824,		/* and		$t1, $t1, $t2 */
+		0x00C93024,		/* and		$a2, $a2, $t1 */
+
 		0x7000003F		/* sdbbp */
     };
 
-    /* make sure we have a working area */
-    if (target_alloc_working_area(target, sizeof(erase_check_code), &erase_check_algorithm) != ERROR_OK)
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+    /* see contib/loaders/erase_check/micromips_erase_check.s for src */
+
+    static const uint16_t mmips_erase_check_code[] = {
+		0x00A4, 0x4150,		/* addu		$t0, $a0, $a1 */
+		0x3120, 0xFFFF,		/* addiu	$t1, $zero, 0xffffffff */
+
+		/* head: */
+		0x9504, 0x002C,		/* beq		$a0, $t0, fold */
+		0xD144, 0x0003,		/* andi		$t2, $a0, 3 */
+		0x940A, 0x000A,		/* beq		$t2, $zero, words */
+		0x0000, 0x0000,		/* nop */
+		0x1544, 0x0000,		/* lbu		$t2, ($a0) */
+		0x3084, 0x0001,		/* addiu	$a0, $a0, 1 */
+		0x9400, 0xFFF2,		/* b		head */
+		0x0146, 0x3250,		/* and		$a2, $a2, $t2 */
+
+		/* words: */
+		0x0088, 0x59D0,		/* subu		$t3, $t0, $a0 */
+		0x016B, 0x1040,		/* srl		$t3, $t3, 2 */
+		0x016B, 0x1000,		/* sll		$t3, $t3, 2 */
+		0x940B, 0x000A,		/* beq		$t3, $zero, tail */
+		0x008B, 0x5950,		/* addu		$t3, $t3, $a0 */
+		/* wloop: */
+		0xFD44, 0x0000,		/* lw		$t2, ($a0) */
+		0x3084, 0x0004,		/* addiu	$a0, $a0, 4 */
+		0xB564, 0xFFFA,		/* bne		$a0, $t3, wloop */
+		0x0149, 0x4A50,		/* and		$t1, $t1, $t2 */
+
+		/* tail: */
+		0x9504, 0x000A,		/* beq		$a0, $t0, fold */
+		0x0000, 0x0000,		/* nop */
+		0x1544, 0x0000,		/* lbu		$t2, ($a0) */
+		0x3084, 0x0001,		/* addiu	$a0, $a0, 1 */
+		0x9400, 0xFFF6,		/* b		tail */
+		0x0146, 0x3250,		/* and		$a2, $a2, $t2 */
+
+		/* fold: */
+		0x0149, 0x8040,		/* srl		$t2, $t1, 16 */
+		0x0149, 0x4A50,		/* and		$t1, $t1, $t2 */
+		0x0149, 0x4040,		/* srl		$t2, $t1, 8 */
+		0x0149, 0x4A50,		/* and		$t1, $t1, $t2 */
+		0x0126, 0x3250,		/* and		$a2, $a2, $t1 */
+
+		0x0000, 0xDB7C		/* sdbbp */
+    };
 
 	/* convert erase check code into a buffer in target endianness */
 	uint8_t erase_check_code_8[sizeof(erase_check_code)];
-	target_buffer_set_u32_array(target, erase_check_code_8,
-					ARRAY_SIZE(erase_check_code), erase_check_code);
+	unsigned code_size = mips32_loader_code(target, erase_check_code_8,
+			erase_check_code, ARRAY_SIZE(erase_check_code),
+			mmips_erase_check_code, ARRAY_SIZE(mmips_erase_check_code), &mips32_info);
 
-	target_write_buffer(target, erase_check_algorithm->address, sizeof(erase_check_code), erase_check_code_8);
+    /* make sure we have a working area, the code stays resident across calls */
+	if (target_alloc_working_area_code(target, erase_check_code_8,
+			code_size, &erase_check_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
-    mips32_info.common_magic = MIPS32_COMMON_MAGIC;
-    mips32_info.isa_mode = MIPS32_ISA_MIPS32;
+    uint32_t isa = (mips32_info.isa_mode == MIPS32_ISA_MMIPS32) ? 1 : 0;
 
     init_reg_param(&reg_params[0], "a0", 32, PARAM_OUT);
     buf_set_u32(reg_params[0].value, 0, 32, address);
@@ -793,8 +951,8 @@ int mips32_blank_check_memory(struct target *target,
     buf_set_u32(reg_params[2].value, 0, 32, 0xff);
 
     int retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
-								  erase_check_algorithm->address,
-								  erase_check_algorithm->address + (sizeof(erase_check_code)-4),
+								  erase_check_algorithm->address | isa,
+								  (erase_check_algorithm->address + code_size - 4) | isa,
 								  10000, &mips32_info);
 	if (retval == ERROR_OK)
 		*blank = buf_get_u32(reg_params[2].value, 0, 32);
@@ -808,6 +966,208 @@ int mips32_blank_check_memory(struct target *target,
     return retval;
 }
 
+/* number of PCsample scans queued per jtag_execute_queue() */
+#define MIPS32_PCSAMPLE_BATCH	256
+
+/* probe for a running core whose PC sampling is already enabled: a
+ * sample with the New bit set can only come from an enabled PCsample.
+ * 41 bit scans leave a 33 bit register just as intact as a 41 bit one. */
+static bool mips32_pcsample_probe(struct target *target)
+{
+	struct mips_ejtag *ejtag_info = &target_to_mips32(target)->ejtag_info;
+	uint8_t in[MIPS32_PCSAMPLE_BATCH][6];
+	uint8_t out[6] = { 0 };
+	struct scan_field field;
+
+	mips_ejtag_set_instr(ejtag_info, EJTAG_INST_PCSAMPLE);
+
+	field.num_bits = 41;
+	field.out_value = out;
+	for (int i = 0; i < MIPS32_PCSAMPLE_BATCH; i++) {
+		field.in_value = in[i];
+		jtag_add_dr_scan(ejtag_info->tap, 1, &field, TAP_IDLE);
+	}
+	if (jtag_execute_queue() != ERROR_OK)
+		return false;
+
+	for (int i = 0; i < MIPS32_PCSAMPLE_BATCH; i++) {
+		if (buf_get_u32(in[i], 0, 1))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Enable PC sampling at its highest rate, every 32 cycles.  DCR is only
+ * reachable from debug mode (DMA access is disabled in this tree), so a
+ * running core is left alone when its PCsample register already delivers
+ * samples, and is halted just once to set DCR.PCSE otherwise.  The result
+ * is remembered until the next reset, later runs don't stop the core.
+ * @returns ERROR_TARGET_RESOURCE_NOT_AVAILABLE if the core has no PC
+ * sampling.
+ */
+static int mips32_pcsample_setup(struct target *target)
+{
+	struct mips32_common *mips32 = target_to_mips32(target);
+	struct mips_ejtag *ejtag_info = &mips32->ejtag_info;
+	bool resume = false;
+	uint32_t dcr;
+	int retval;
+
+	if (ejtag_info->pcsample_enabled)
+		return ERROR_OK;
+
+	if (target->state == TARGET_RUNNING) {
+		if (mips32_pcsample_probe(target)) {
+			ejtag_info->pcsample_enabled = true;
+			return ERROR_OK;
+		}
+
+		LOG_INFO("halting %s once to enable PC sampling", target_name(target));
+		retval = target_halt(target);
+		if (retval == ERROR_OK)
+			retval = target_wait_state(target, TARGET_HALTED, 500);
+		if (retval != ERROR_OK)
+			return retval;
+		resume = true;
+	}
+
+	retval = target_read_u32(target, EJTAG_DCR, &dcr);
+	if (retval == ERROR_OK && !(dcr & EJTAG_DCR_PCS))
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	if (retval == ERROR_OK) {
+		dcr = (dcr & ~EJTAG_DCR_PCR_MASK) | EJTAG_DCR_PCSE;
+		retval = target_write_u32(target, EJTAG_DCR, dcr);
+	}
+	if (retval == ERROR_OK) {
+		ejtag_info->pcsample_enabled = true;
+		ejtag_info->pcsample_noasid = (dcr & EJTAG_DCR_PCNOASID) != 0;
+	}
+
+	if (resume) {
+		int ret = target_resume(target, 1, 0, 0, 0);
+		if (retval == ERROR_OK)
+			retval = ret;
+	}
+
+	return retval;
+}
+
+/**
+ * Stream PCs from the EJTAG PCsample register, set up by
+ * mips32_pcsample_setup().  The core records its PC every few cycles
+ * while it runs; reading the register with the PCSAMPLE instruction
+ * neither halts nor slows it down.  Scans are queued in batches, and
+ * samples whose New bit is clear (nothing taken since the previous
+ * read) are dropped.  A halted target is resumed first, the target is
+ * left running; every new sample is passed to @a sample.
+ */
+static int mips32_pcsample_run(struct target *target, uint32_t seconds,
+		uint32_t max_num_samples, uint32_t *num_samples,
+		int (*sample)(struct target *target, uint32_t pc, void *priv), void *priv)
+{
+	struct mips32_common *mips32 = target_to_mips32(target);
+	struct mips_ejtag *ejtag_info = &mips32->ejtag_info;
+	int retval = ERROR_OK;
+
+	/* New bit, PC and, unless the core leaves it out, an 8 bit ASID */
+	unsigned num_bits = ejtag_info->pcsample_noasid ? 33 : 41;
+	unsigned num_bytes = DIV_ROUND_UP(num_bits, 8);
+
+	uint8_t *in = malloc(MIPS32_PCSAMPLE_BATCH * num_bytes);
+	uint8_t *out = calloc(1, num_bytes);
+	if (in == NULL || out == NULL) {
+		free(in);
+		free(out);
+		return ERROR_FAIL;
+	}
+
+	if (target->state == TARGET_HALTED) {
+		retval = target_resume(target, 1, 0, 0, 0);
+		if (retval != ERROR_OK)
+			goto done;
+	}
+
+	int64_t end = timeval_ms() + seconds * 1000;
+	uint32_t sample_count = 0;
+
+	mips_ejtag_set_instr(ejtag_info, EJTAG_INST_PCSAMPLE);
+
+	while (sample_count < max_num_samples && timeval_ms() < end) {
+		struct scan_field field;
+		int i;
+
+		/* shifting in zeroes clears New, so each sample is seen once */
+		field.num_bits = num_bits;
+		field.out_value = out;
+		for (i = 0; i < MIPS32_PCSAMPLE_BATCH; i++) {
+			field.in_value = in + i * num_bytes;
+			jtag_add_dr_scan(ejtag_info->tap, 1, &field, TAP_IDLE);
+		}
+
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK) {
+			LOG_ERROR("PC sample read failed");
+			break;
+		}
+
+		for (i = 0; i < MIPS32_PCSAMPLE_BATCH && sample_count < max_num_samples; i++) {
+			uint8_t *pcsample = in + i * num_bytes;
+			if (!buf_get_u32(pcsample, 0, 1))
+				continue;
+			retval = sample(target, buf_get_u32(pcsample, 1, 32), priv);
+			if (retval != ERROR_OK)
+				goto done;
+			sample_count++;
+		}
+
+		keep_alive();
+	}
+
+	*num_samples = sample_count;
+
+done:
+	free(in);
+	free(out);
+	return retval;
+}
+
+static int mips32_profiling_sample(struct target *target, uint32_t pc, void *priv)
+{
+	uint32_t **samples = priv;
+	*(*samples)++ = pc;
+	return ERROR_OK;
+}
+
+/**
+ * Profile through the EJTAG PCsample register without halting the core,
+ * falling back to halting and resuming on cores without PC sampling.
+ */
+int mips32_profiling(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+{
+	int retval = mips32_pcsample_setup(target);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		return target_profiling_default(target, samples, max_num_samples,
+				num_samples, seconds);
+	if (retval != ERROR_OK)
+		return retval;
+
+	LOG_INFO("Starting profiling. Sampling the PC through EJTAG PCsample...");
+
+	retval = mips32_pcsample_run(target, seconds, max_num_samples, num_samples,
+			mips32_profiling_sample, &samples);
+	if (retval == ERROR_OK)
+		LOG_INFO("Profiling completed. %" PRIu32 " samples.", *num_samples);
+
+	return retval;
+}
+
+static int mips32_trace_sample(struct target *target, uint32_t pc, void *priv)
+{
+	return trace_record_pc(target, pc);
+}
+
 static int mips32_verify_pointer(struct command_context *cmd_ctx,
 				 struct mips32_common *mips32)
 {
@@ -2103,6 +2463,341 @@ COMMAND_HANDLER(mips32_handle_pic32_reset_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(mips32_handle_trace_sample_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct mips32_common *mips32 = target_to_mips32(target);
+	uint32_t seconds, num_samples = 0;
+	int retval;
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	retval = mips32_verify_pointer(CMD_CTX, mips32);
+	if (retval != ERROR_OK)
+		return retval;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], seconds);
+
+	if (target->state != TARGET_HALTED && target->state != TARGET_RUNNING) {
+		command_print(CMD_CTX, "target must be halted or running for \"%s\" command",
+				CMD_NAME);
+		return ERROR_OK;
+	}
+
+	retval = mips32_pcsample_setup(target);
+	if (retval == ERROR_OK)
+		retval = mips32_pcsample_run(target, seconds, UINT32_MAX, &num_samples,
+				mips32_trace_sample, NULL);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
+		command_print(CMD_CTX, "core does not implement EJTAG PC sampling");
+		return ERROR_OK;
+	}
+	if (retval != ERROR_OK)
+		return retval;
+
+	command_print(CMD_CTX, "%" PRIu32 " samples recorded", num_samples);
+	return ERROR_OK;
+}
+
+/* The PDtrace Trace Control Block is reached through TAP registers only,
+ * so trace can be configured, started and drained while the core runs.
+ * TCBCONTROLB selects which TCB register TCBDATA shows.  The on-chip
+ * memory is read out as raw 64 bit trace words; decoding the PDtrace or
+ * iFlowtrace packets in them is left to offline tools. */
+
+/* number of trace words read per jtag_execute_queue() */
+#define MIPS32_TCB_BATCH	256
+
+static int mips32_tcb_scan(struct mips_ejtag *ejtag_info, int instr, uint32_t *value)
+{
+	mips_ejtag_set_instr(ejtag_info, instr);
+	return mips_ejtag_drscan_32(ejtag_info, value);
+}
+
+static int mips32_tcb_write_controla(struct mips_ejtag *ejtag_info, uint32_t value)
+{
+	ejtag_info->tcb_controla = value;
+	return mips32_tcb_scan(ejtag_info, EJTAG_INST_TCBCONTROLA, &value);
+}
+
+static int mips32_tcb_write_controlb(struct mips_ejtag *ejtag_info, uint32_t value)
+{
+	ejtag_info->tcb_controlb = value & ~(EJTAG_TCBCB_WR | EJTAG_TCBCB_RM);
+	value |= EJTAG_TCBCB_WE;
+	return mips32_tcb_scan(ejtag_info, EJTAG_INST_TCBCONTROLB, &value);
+}
+
+/* read the control registers, writing back what they last were set to */
+static int mips32_tcb_read_control(struct mips_ejtag *ejtag_info,
+		uint32_t *controla, uint32_t *controlb)
+{
+	uint32_t value = ejtag_info->tcb_controla;
+	int retval = mips32_tcb_scan(ejtag_info, EJTAG_INST_TCBCONTROLA, &value);
+	if (retval != ERROR_OK)
+		return retval;
+	*controla = value;
+
+	value = ejtag_info->tcb_controlb | EJTAG_TCBCB_WE;
+	retval = mips32_tcb_scan(ejtag_info, EJTAG_INST_TCBCONTROLB, &value);
+	*controlb = value;
+	return retval;
+}
+
+static uint32_t mips32_tcb_select(struct mips_ejtag *ejtag_info, unsigned reg)
+{
+	return (ejtag_info->tcb_controlb & ~(0x3f << EJTAG_TCBCB_REG_SHIFT))
+		| (reg << EJTAG_TCBCB_REG_SHIFT);
+}
+
+static int mips32_tcb_read_reg(struct mips_ejtag *ejtag_info, unsigned reg, uint32_t *value)
+{
+	int retval = mips32_tcb_write_controlb(ejtag_info, mips32_tcb_select(ejtag_info, reg));
+	if (retval != ERROR_OK)
+		return retval;
+
+	*value = 0;
+	return mips32_tcb_scan(ejtag_info, EJTAG_INST_TCBDATA, value);
+}
+
+static int mips32_tcb_write_reg(struct mips_ejtag *ejtag_info, unsigned reg, uint32_t value)
+{
+	int retval = mips32_tcb_write_controlb(ejtag_info,
+			mips32_tcb_select(ejtag_info, reg) | EJTAG_TCBCB_WR);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return mips32_tcb_scan(ejtag_info, EJTAG_INST_TCBDATA, &value);
+}
+
+/* the size of the on-chip trace memory in bytes, 0 if there is none */
+static int mips32_tcb_size(struct mips_ejtag *ejtag_info, uint32_t *size)
+{
+	uint32_t config;
+	int retval = mips32_tcb_read_reg(ejtag_info, EJTAG_TCB_CONFIG, &config);
+	if (retval != ERROR_OK)
+		return retval;
+
+	*size = (config & EJTAG_TCBCONFIG_ONT) ? 1u << (8 + EJTAG_TCBCONFIG_SZ(config)) : 0;
+	return ERROR_OK;
+}
+
+static int mips32_tcb_start(struct mips_ejtag *ejtag_info, bool wrap)
+{
+	/* start with an empty trace memory */
+	int retval = mips32_tcb_write_reg(ejtag_info, EJTAG_TCB_STP, 0);
+	if (retval == ERROR_OK)
+		retval = mips32_tcb_write_reg(ejtag_info, EJTAG_TCB_WRP, 0);
+	if (retval == ERROR_OK)
+		retval = mips32_tcb_write_controlb(ejtag_info,
+				EJTAG_TCBCB_EN | (wrap ? 0 : EJTAG_TCBCB_TM_FROM));
+	/* full flow trace of everything but debug mode */
+	if (retval == ERROR_OK)
+		retval = mips32_tcb_write_controla(ejtag_info, EJTAG_TCBCA_ON | EJTAG_TCBCA_G
+				| EJTAG_TCBCA_U | EJTAG_TCBCA_K | EJTAG_TCBCA_S | EJTAG_TCBCA_E
+				| EJTAG_TCBCA_TB);
+	return retval;
+}
+
+static int mips32_tcb_stop(struct mips_ejtag *ejtag_info)
+{
+	int retval = mips32_tcb_write_controla(ejtag_info,
+			ejtag_info->tcb_controla & ~EJTAG_TCBCA_ON);
+	if (retval == ERROR_OK)
+		retval = mips32_tcb_write_controlb(ejtag_info,
+				ejtag_info->tcb_controlb & ~EJTAG_TCBCB_EN);
+	return retval;
+}
+
+/**
+ * Stop the trace and write the captured trace words, oldest first, to
+ * @a file as 64 bit little endian values.  The words are read through
+ * TCBDATA in batches of queued scans.
+ */
+static int mips32_tcb_dump(struct mips_ejtag *ejtag_info, uint32_t size,
+		FILE *file, uint32_t *num_words)
+{
+	uint32_t controla, controlb, stp, wrp;
+	int retval;
+
+	retval = mips32_tcb_stop(ejtag_info);
+	if (retval == ERROR_OK)
+		retval = mips32_tcb_read_control(ejtag_info, &controla, &controlb);
+	if (retval == ERROR_OK)
+		retval = mips32_tcb_read_reg(ejtag_info, EJTAG_TCB_STP, &stp);
+	if (retval == ERROR_OK)
+		retval = mips32_tcb_read_reg(ejtag_info, EJTAG_TCB_WRP, &wrp);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* the pointers are byte addresses into the trace memory */
+	uint32_t count = (controlb & EJTAG_TCBCB_TR) ? size / 8 : ((wrp - stp) & (size - 1)) / 8;
+
+	/* RM moves the read pointer to the oldest word, every read of the
+	 * trace word register advances it */
+	retval = mips32_tcb_write_controlb(ejtag_info,
+			mips32_tcb_select(ejtag_info, EJTAG_TCB_TW) | EJTAG_TCBCB_RM);
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint8_t *in = malloc(MIPS32_TCB_BATCH * 8);
+	uint8_t out[8] = { 0 };
+	if (in == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	mips_ejtag_set_instr(ejtag_info, EJTAG_INST_TCBDATA);
+
+	uint32_t done = 0;
+	while (done < count) {
+		uint32_t batch = MIN(count - done, MIPS32_TCB_BATCH);
+		struct scan_field field;
+
+		field.num_bits = 64;
+		field.out_value = out;
+		for (uint32_t i = 0; i < batch; i++) {
+			field.in_value = in + i * 8;
+			jtag_add_dr_scan(ejtag_info->tap, 1, &field, TAP_IDLE);
+		}
+
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK) {
+			LOG_ERROR("trace memory read failed");
+			break;
+		}
+
+		/* scans capture LSB first, the buffer holds little endian words */
+		if (fwrite(in, 8, batch, file) != batch) {
+			LOG_ERROR("couldn't write trace data");
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		done += batch;
+		keep_alive();
+	}
+
+	free(in);
+	*num_words = done;
+
+	int ret = mips32_tcb_write_controlb(ejtag_info, mips32_tcb_select(ejtag_info, 0));
+	return retval != ERROR_OK ? retval : ret;
+}
+
+COMMAND_HANDLER(mips32_handle_tcb_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct mips32_common *mips32 = target_to_mips32(target);
+	struct mips_ejtag *ejtag_info = &mips32->ejtag_info;
+	uint32_t controla, controlb, size;
+	int retval;
+
+	if (CMD_ARGC < 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	retval = mips32_verify_pointer(CMD_CTX, mips32);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (strcmp(CMD_ARGV[0], "control") == 0) {
+		/* raw access, for TCB revisions laid out differently */
+		if (CMD_ARGC > 3)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		if (CMD_ARGC > 1) {
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], controla);
+			retval = mips32_tcb_write_controla(ejtag_info, controla);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		if (CMD_ARGC > 2) {
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], controlb);
+			retval = mips32_tcb_write_controlb(ejtag_info, controlb);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		retval = mips32_tcb_read_control(ejtag_info, &controla, &controlb);
+		if (retval != ERROR_OK)
+			return retval;
+		command_print(CMD_CTX, "tcbcontrola 0x%8.8" PRIx32 " tcbcontrolb 0x%8.8" PRIx32,
+				controla, controlb);
+		return ERROR_OK;
+	}
+
+	retval = mips32_tcb_size(ejtag_info, &size);
+	if (retval != ERROR_OK)
+		return retval;
+	if (size == 0) {
+		command_print(CMD_CTX, "core has no on-chip trace memory");
+		return ERROR_OK;
+	}
+
+	if (strcmp(CMD_ARGV[0], "status") == 0) {
+		uint32_t config, wrp;
+
+		if (CMD_ARGC != 1)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		retval = mips32_tcb_read_reg(ejtag_info, EJTAG_TCB_CONFIG, &config);
+		if (retval == ERROR_OK)
+			retval = mips32_tcb_read_reg(ejtag_info, EJTAG_TCB_WRP, &wrp);
+		if (retval == ERROR_OK)
+			retval = mips32_tcb_read_control(ejtag_info, &controla, &controlb);
+		if (retval != ERROR_OK)
+			return retval;
+
+		command_print(CMD_CTX, "TCB revision %" PRIu32 ", %" PRIu32 " KiB on-chip trace memory",
+				EJTAG_TCBCONFIG_REV(config), size / 1024);
+		command_print(CMD_CTX, "trace %s, write pointer 0x%" PRIx32 "%s%s",
+				(controla & EJTAG_TCBCA_ON) && (controlb & EJTAG_TCBCB_EN) ?
+					"running" : "stopped", wrp,
+				(controlb & EJTAG_TCBCB_TR) ? ", wrapped" : "",
+				(controlb & EJTAG_TCBCB_BF) ? ", full" : "");
+		return ERROR_OK;
+	}
+
+	if (strcmp(CMD_ARGV[0], "start") == 0) {
+		bool wrap = true;
+
+		if (CMD_ARGC > 2)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		if (CMD_ARGC == 2) {
+			if (strcmp(CMD_ARGV[1], "stop") == 0)
+				wrap = false;
+			else if (strcmp(CMD_ARGV[1], "wrap") != 0)
+				return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+		return mips32_tcb_start(ejtag_info, wrap);
+	}
+
+	if (strcmp(CMD_ARGV[0], "stop") == 0) {
+		if (CMD_ARGC != 1)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		return mips32_tcb_stop(ejtag_info);
+	}
+
+	if (strcmp(CMD_ARGV[0], "dump") == 0) {
+		uint32_t num_words = 0;
+
+		if (CMD_ARGC != 2)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		FILE *file = fopen(CMD_ARGV[1], "wb");
+		if (file == NULL) {
+			LOG_ERROR("cannot open '%s' for writing", CMD_ARGV[1]);
+			return ERROR_FAIL;
+		}
+		retval = mips32_tcb_dump(ejtag_info, size, file, &num_words);
+		fclose(file);
+		if (retval != ERROR_OK)
+			return retval;
+
+		command_print(CMD_CTX, "wrote %" PRIu32 " trace words to %s", num_words, CMD_ARGV[1]);
+		return ERROR_OK;
+	}
+
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
 static const struct command_registration mips32_exec_command_handlers[] = {
     {
 		.name = "cp0",
@@ -2153,6 +2848,24 @@ static const struct command_registration mips32_exec_command_handlers[] = {
 		.help = "force pic32 reset",
 		.usage = "[value]",
 	},
+	{
+		.name = "trace_sample",
+		.handler = mips32_handle_trace_sample_command,
+		.mode = COMMAND_EXEC,
+		.help = "let the core run while sampling its PC for the given "
+			"number of seconds, and count the samples against the "
+			"trace points",
+		.usage = "seconds",
+	},
+	{
+		.name = "tcb",
+		.handler = mips32_handle_tcb_command,
+		.mode = COMMAND_EXEC,
+		.help = "configure, start and stop the on-chip PDtrace buffer, "
+			"or write the captured trace words to a file",
+		.usage = "status | start ['wrap'|'stop'] | stop | dump filename | "
+			"control [controla [controlb]]",
+	},
     COMMAND_REGISTRATION_DONE
 };
 
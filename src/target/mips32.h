@@ -121,6 +121,7 @@ static const struct {
 enum mips32_isa_mode {
 	MIPS32_ISA_MIPS32 = 0,
 	MIPS32_ISA_MIPS16E = 1,
+	MIPS32_ISA_MMIPS32 = 1,	/* same isa bit as MIPS16e */
 };
 
 enum micro_mips_enabled {
@@ -143,6 +144,9 @@ struct mips32_comparator {
 	int used;
 	uint32_t bp_value;
 	uint32_t reg_address;
+	uint32_t reg_value;		/* value for the IBA/DBA register */
+	uint32_t ctrl;			/* value for the IBC/DBC register, 0 when free */
+	int dirty;				/* not yet written to the hardware */
 };
 
 
@@ -189,6 +193,10 @@ struct mips32_core_reg {
 struct mips32_algorithm {
 	int common_magic;
 	enum mips32_isa_mode isa_mode;
+
+	/* saved by mips32_start_algorithm, restored by mips32_wait_algorithm */
+	enum mips32_isa_mode saved_isa_mode;
+	uint32_t context[MIPS32NUMCOREREGS];
 };
 
 #define zero	0
@@ -782,6 +790,18 @@ int mips32_run_algorithm(struct target *target,
 		uint32_t entry_point, uint32_t exit_point,
 		int timeout_ms, void *arch_info);
 
+int mips32_start_algorithm(struct target *target,
+		int num_mem_params, struct mem_param *mem_params,
+		int num_reg_params, struct reg_param *reg_params,
+		uint32_t entry_point, uint32_t exit_point,
+		void *arch_info);
+
+int mips32_wait_algorithm(struct target *target,
+		int num_mem_params, struct mem_param *mem_params,
+		int num_reg_params, struct reg_param *reg_params,
+		uint32_t exit_point, int timeout_ms,
+		void *arch_info);
+
 int mips32_configure_break_unit(struct target *target);
 
 int mips32_enable_interrupts(struct target *target, int enable);
@@ -797,6 +817,8 @@ int mips32_checksum_memory(struct target *target, uint32_t address,
 		uint32_t count, uint32_t *checksum);
 int mips32_blank_check_memory(struct target *target,
 		uint32_t address, uint32_t count, uint32_t *blank);
+int mips32_profiling(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
 
 int mips32_mark_reg_invalid (struct target *, int);
 uint32_t DetermineCpuTypeFromPrid(uint32_t prid, uint32_t config, uint32_t config1);
@@ -77,6 +77,7 @@
 #endif
 
 #include <helper/time_support.h>
+#include <helper/metrics.h>
 
 #include "mips32.h"
 #include "mips32_pracc.h"
@@ -201,6 +202,8 @@ int mips32_pracc_clean_text_jump(struct mips_ejtag *ejtag_info)
 	return ERROR_OK;
 }
 
+static struct metric pracc_restarts = METRIC_COUNTER("mips32.pracc_restarts");
+
 int mips32_pracc_exec(struct mips_ejtag *ejtag_info, struct pracc_queue_info *ctx, uint32_t *param_out)
 {
 	int code_count = 0;
@@ -229,6 +232,7 @@ int mips32_pracc_exec(struct mips_ejtag *ejtag_info, struct pracc_queue_info *ct
 			restart_count++;
 			restart = 0;
 			code_count = 0;
+			metric_inc(&pracc_restarts);
 			LOG_DEBUG("restarting code");
 		}
 
@@ -280,6 +284,7 @@ int mips32_pracc_exec(struct mips_ejtag *ejtag_info, struct pracc_queue_info *ct
 					if (code_count == 1 && ejtag_info->pa_addr == MIPS32_PRACC_TEXT && restart_count == 0) {
 						LOG_DEBUG("restarting, without clean jump");
 						restart_count++;
+						metric_inc(&pracc_restarts);
 						code_count = 0;
 						continue;
 					} else if (code_count < 2) {
@@ -878,6 +883,63 @@ exit:
     return ctx.retval;
 }
 
+/* store words to unrelated addresses (e.g. the EJTAG comparator registers)
+ * with a single processor access program per 64 words; no cache handling */
+int mips32_pracc_write_u32_list(struct mips_ejtag *ejtag_info,
+		int count, const uint32_t *addr, const uint32_t *val)
+{
+	struct pracc_queue_info ctx = {.max_code = 64 * 4 + 6};
+
+	pracc_queue_init(&ctx);
+	if (ctx.retval != ERROR_OK)
+		goto exit;
+
+	while (count) {
+		ctx.code_count = 0;
+		ctx.store_count = 0;
+		int this_round_count = (count > 64) ? 64 : count;
+		uint32_t last_upper_base_addr = UPPER16((*addr + 0x8000));
+
+		pracc_add(&ctx, 0, MIPS32_MTC0(15, 31, 0));				/* save $15 in DeSave */
+		pracc_add(&ctx, 0, MIPS32_LUI(15, last_upper_base_addr));	/* load $15 with register base address */
+
+		for (int i = 0; i != this_round_count; i++) {
+			uint32_t upper_base_addr = UPPER16((*addr + 0x8000));
+
+			if (last_upper_base_addr != upper_base_addr) {
+				pracc_add(&ctx, 0, MIPS32_LUI(15, upper_base_addr));
+				last_upper_base_addr = upper_base_addr;
+			}
+
+			if (LOWER16(*val) == 0)
+				pracc_add(&ctx, 0, MIPS32_LUI(8, UPPER16(*val)));
+			else if (UPPER16(*val) == 0)
+				pracc_add(&ctx, 0, MIPS32_ORI(8, 0, LOWER16(*val)));
+			else {
+				pracc_add(&ctx, 0, MIPS32_LUI(8, UPPER16(*val)));
+				pracc_add(&ctx, 0, MIPS32_ORI(8, 8, LOWER16(*val)));
+			}
+			pracc_add(&ctx, 0, MIPS32_SW(8, LOWER16(*addr), 15));
+			addr++;
+			val++;
+		}
+
+		pracc_add(&ctx, 0, MIPS32_LUI(8, UPPER16(ejtag_info->reg8)));		/* restore upper 16 bits of reg 8 */
+		pracc_add(&ctx, 0, MIPS32_ORI(8, 8, LOWER16(ejtag_info->reg8)));	/* restore lower 16 bits of reg 8 */
+		pracc_add(&ctx, 0, MIPS32_B(NEG16(ctx.code_count + 1)));		/* jump to start */
+		pracc_add(&ctx, 0, MIPS32_MFC0(15, 31, 0));				/* restore $15 from DeSave */
+
+		ctx.retval = mips32_pracc_queue_exec(ejtag_info, &ctx, NULL);
+		if (ctx.retval != ERROR_OK)
+			goto exit;
+
+		count -= this_round_count;
+	}
+exit:
+	pracc_queue_free(&ctx);
+	return ctx.retval;
+}
+
 int mips32_pracc_write_mem(struct mips_ejtag *ejtag_info, uint32_t addr, int size, int count, const void *buf)
 {
     int retval = mips32_pracc_write_mem_generic(ejtag_info, addr, size, count, buf);
@@ -1335,6 +1397,9 @@ exit:
  * 2. end addr
  * 3. data ...
  */
+static struct metric fastdata_words = METRIC_COUNTER("mips32.fastdata_words");
+static struct metric fastdata_dangling = METRIC_COUNTER("mips32.fastdata_dangling");
+
 int mips32_pracc_fastdata_xfer(struct mips_ejtag *ejtag_info, struct working_area *source,
 			       int write_t, uint32_t addr, int count, uint32_t *buf)
 {
@@ -1466,6 +1531,7 @@ int mips32_pracc_fastdata_xfer(struct mips_ejtag *ejtag_info, struct working_are
     if (ejtag_info->mode != 0)
 		num_clocks = ((uint64_t)(ejtag_info->scan_delay) * jtag_get_speed_khz() + 500000) / 1000000;
 
+    metric_add(&fastdata_words, count);
     for (i = 0; i < count; i++) {
 		jtag_add_clocks(num_clocks);
 		retval = mips_ejtag_fastdata_scan(ejtag_info, write_t, buf++);
@@ -1508,6 +1574,7 @@ int mips32_pracc_fastdata_xfer(struct mips_ejtag *ejtag_info, struct working_are
 		/* Clean up dangling access */
 		do {
 			pending++;    /* Count total number of dangling accesses */
+			metric_inc(&fastdata_dangling);
 			mips_ejtag_set_instr(ejtag_info, EJTAG_INST_FASTDATA);
 
 			retval = mips_ejtag_fastdata_scan(ejtag_info, 1, &val);
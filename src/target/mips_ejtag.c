@@ -268,6 +268,10 @@ error:
 int mips_ejtag_enter_debug(struct mips_ejtag *ejtag_info)
 {
 	uint32_t ejtag_ctrl;
+
+	/* a control register read ahead no longer shows BrkSt */
+	ejtag_info->polled_pass = 0;
+
 	mips_ejtag_set_instr(ejtag_info, EJTAG_INST_CONTROL);
 
 	if (ejtag_info->ejtag_version == EJTAG_VERSION_20) {
@@ -293,6 +297,154 @@ error:
 	return ERROR_FAIL;
 }
 
+/* Queue one scan over the whole chain, an IR scan when @a ir_scan is set,
+ * a DR scan otherwise.  It puts @a value into the IR (ir_length bits) or
+ * the 32 bit data register of the @a count TAPs of @a ejtag_infos, and
+ * BYPASS, or a single bypass bit, into all others.  The scan buffer is
+ * allocated into @a out; @a in, when not NULL, receives a buffer of the
+ * same layout with the captured bits.  The caller frees both. */
+static int mips_ejtag_add_multi_scan(struct mips_ejtag **ejtag_infos, int count,
+		bool ir_scan, uint32_t value, uint8_t **out, uint8_t **in)
+{
+	int num_bits = 0;
+	struct jtag_tap *tap;
+
+	for (tap = jtag_tap_next_enabled(NULL); tap; tap = jtag_tap_next_enabled(tap))
+		num_bits += ir_scan ? tap->ir_length : (tap->bypass ? 1 : 32);
+
+	*out = calloc(1, DIV_ROUND_UP(num_bits, 8));
+	if (in)
+		*in = calloc(1, DIV_ROUND_UP(num_bits, 8));
+	if (*out == NULL || (in && *in == NULL))
+		return ERROR_FAIL;
+
+	int pos = 0;
+	for (tap = jtag_tap_next_enabled(NULL); tap; tap = jtag_tap_next_enabled(tap)) {
+		bool selected = false;
+		for (int i = 0; i < count; i++)
+			selected |= ejtag_infos[i]->tap == tap;
+
+		if (ir_scan) {
+			/* keep the TAP state the regular scans rely on up to date */
+			if (selected)
+				buf_set_u32(tap->cur_instr, 0, tap->ir_length, value);
+			else
+				buf_set_ones(tap->cur_instr, tap->ir_length);
+			tap->bypass = !selected;
+			buf_set_buf(tap->cur_instr, 0, *out, pos, tap->ir_length);
+			pos += tap->ir_length;
+		} else if (tap->bypass)
+			pos++;
+		else {
+			buf_set_u32(*out, pos, 32, value);
+			pos += 32;
+		}
+	}
+
+	if (ir_scan)
+		jtag_add_plain_ir_scan(num_bits, *out, NULL, TAP_IDLE);
+	else
+		jtag_add_plain_dr_scan(num_bits, *out, in ? *in : NULL, TAP_IDLE);
+
+	return ERROR_OK;
+}
+
+/**
+ * Request debug mode on several cores at once.  One IR scan selects the
+ * CONTROL register of every core's TAP and one DR scan sets JTAGBRK in
+ * all of them, so every core sees the request on the same Update-DR and
+ * the whole sequence costs a single queue flush.  The cores must share
+ * the same ejtag_ctrl value and must not be EJTAG 2.0 parts, which need
+ * DCR.MP cleared through memory accesses first.
+ */
+int mips_ejtag_enter_debug_multi(struct mips_ejtag **ejtag_infos, int count)
+{
+	uint8_t *ir_out = NULL, *brk_out = NULL, *ctrl_out = NULL, *ctrl_in = NULL;
+	uint32_t ejtag_ctrl = ejtag_infos[0]->ejtag_ctrl;
+	int retval;
+
+	for (int i = 0; i < count; i++)
+		ejtag_infos[i]->polled_pass = 0;
+
+	retval = mips_ejtag_add_multi_scan(ejtag_infos, count, true,
+			EJTAG_INST_CONTROL, &ir_out, NULL);
+	if (retval == ERROR_OK)
+		retval = mips_ejtag_add_multi_scan(ejtag_infos, count, false,
+				ejtag_ctrl | EJTAG_CTRL_JTAGBRK, &brk_out, NULL);
+	/* break bit will be cleared by hardware, read back BrkSt */
+	if (retval == ERROR_OK)
+		retval = mips_ejtag_add_multi_scan(ejtag_infos, count, false,
+				ejtag_ctrl, &ctrl_out, &ctrl_in);
+	if (retval == ERROR_OK)
+		retval = jtag_execute_queue();
+
+	if (retval == ERROR_OK) {
+		int pos = 0;
+		for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap;
+				tap = jtag_tap_next_enabled(tap)) {
+			if (tap->bypass) {
+				pos++;
+				continue;
+			}
+			uint32_t ctrl = buf_get_u32(ctrl_in, pos, 32);
+			pos += 32;
+			LOG_DEBUG("%s ejtag_ctrl: 0x%8.8" PRIx32, tap->dotted_name, ctrl);
+			if ((ctrl & EJTAG_CTRL_BRKST) == 0) {
+				LOG_ERROR("%s failed to enter Debug Mode!", tap->dotted_name);
+				retval = ERROR_FAIL;
+			}
+		}
+	}
+
+	free(ir_out);
+	free(brk_out);
+	free(ctrl_out);
+	free(ctrl_in);
+	return retval;
+}
+
+/**
+ * Read the EJTAG control register of several cores with one IR and one
+ * DR scan over the chain, i.e. a single queue flush instead of one per
+ * core.  As with a plain read, every core's register is written with
+ * the ejtag_ctrl value the cores must share.  ctrl[i] receives the value
+ * read from ejtag_infos[i].
+ */
+int mips_ejtag_read_ctrl_multi(struct mips_ejtag **ejtag_infos, int count, uint32_t *ctrl)
+{
+	uint8_t *ir_out = NULL, *ctrl_out = NULL, *ctrl_in = NULL;
+	int retval;
+
+	retval = mips_ejtag_add_multi_scan(ejtag_infos, count, true,
+			EJTAG_INST_CONTROL, &ir_out, NULL);
+	if (retval == ERROR_OK)
+		retval = mips_ejtag_add_multi_scan(ejtag_infos, count, false,
+				ejtag_infos[0]->ejtag_ctrl, &ctrl_out, &ctrl_in);
+	if (retval == ERROR_OK)
+		retval = jtag_execute_queue();
+
+	if (retval == ERROR_OK) {
+		int pos = 0;
+		for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap;
+				tap = jtag_tap_next_enabled(tap)) {
+			if (tap->bypass) {
+				pos++;
+				continue;
+			}
+			for (int i = 0; i < count; i++) {
+				if (ejtag_infos[i]->tap == tap)
+					ctrl[i] = buf_get_u32(ctrl_in, pos, 32);
+			}
+			pos += 32;
+		}
+	}
+
+	free(ir_out);
+	free(ctrl_out);
+	free(ctrl_in);
+	return retval;
+}
+
 int mips_ejtag_exit_debug(struct mips_ejtag *ejtag_info)
 {
 	uint32_t pracc_list[] = {MIPS32_DRET, 0};
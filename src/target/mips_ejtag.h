@@ -38,6 +38,7 @@
 #define EJTAG_INST_TCBCONTROLA	0x10
 #define EJTAG_INST_TCBCONTROLB	0x11
 #define EJTAG_INST_TCBDATA		0x12
+#define EJTAG_INST_PCSAMPLE		0x14
 #define EJTAG_INST_BYPASS		0xFF
 
 /* microchip PIC32MX specific instructions */
@@ -131,11 +132,43 @@
 /* Debug Control Register DCR */
 #define EJTAG_DCR				0xFF300000
 #define EJTAG_DCR_ENM			(1 << 29)
+#define EJTAG_DCR_PCNOASID		(1 << 25)
 #define EJTAG_DCR_DB			(1 << 17)
 #define EJTAG_DCR_IB			(1 << 16)
+#define EJTAG_DCR_PCS			(1 << 9)	/* PC sampling implemented */
+#define EJTAG_DCR_PCR_MASK		(7 << 6)	/* sample every 2^(5+PCR) cycles */
+#define EJTAG_DCR_PCSE			(1 << 5)	/* PC sampling enabled */
 #define EJTAG_DCR_INTE			(1 << 4)
 #define EJTAG_DCR_MP			(1 << 2)
 
+/* PDtrace Trace Control Block, reached through the TAP */
+#define EJTAG_TCBCA_ON			(1 << 0)	/* trace enabled */
+#define EJTAG_TCBCA_G			(1 << 4)	/* all ASIDs */
+#define EJTAG_TCBCA_U			(1 << 13)	/* trace in user mode */
+#define EJTAG_TCBCA_K			(1 << 14)	/* kernel mode */
+#define EJTAG_TCBCA_S			(1 << 15)	/* supervisor mode */
+#define EJTAG_TCBCA_E			(1 << 16)	/* exception mode */
+#define EJTAG_TCBCA_TB			(1 << 19)	/* trace all branches */
+
+#define EJTAG_TCBCB_EN			(1 << 0)	/* TCB collects trace */
+#define EJTAG_TCBCB_TM_FROM		(1 << 13)	/* stop when full, don't wrap */
+#define EJTAG_TCBCB_BF			(1 << 15)	/* trace memory full */
+#define EJTAG_TCBCB_TR			(1 << 16)	/* trace memory wrapped */
+#define EJTAG_TCBCB_RM			(1 << 17)	/* read from the oldest word */
+#define EJTAG_TCBCB_WE			(1 << 19)	/* write the other fields */
+#define EJTAG_TCBCB_REG_SHIFT	20			/* register seen in TCBDATA */
+#define EJTAG_TCBCB_WR			(1u << 31)	/* TCBDATA scans write it */
+
+#define EJTAG_TCB_CONFIG		0
+#define EJTAG_TCB_TW			4	/* 64 bit trace word, at TCBRDP */
+#define EJTAG_TCB_RDP			5
+#define EJTAG_TCB_WRP			6
+#define EJTAG_TCB_STP			7
+
+#define EJTAG_TCBCONFIG_REV(x)	(((x) >> 25) & 7)
+#define EJTAG_TCBCONFIG_SZ(x)	(((x) >> 17) & 0xf)	/* 2^(8+SZ) bytes on-chip */
+#define EJTAG_TCBCONFIG_ONT		(1 << 5)	/* on-chip trace memory */
+
 /* breakpoint support */
 /* EJTAG_V20_* was tested on Broadcom BCM7401
  * and may or will differ with other hardware. For example EZ4021-FC. */
@@ -212,11 +245,30 @@ struct mips_ejtag {
 	uint32_t ejtag_iba_step_size;
 	uint32_t ejtag_dba_step_size;	/* siez of step till next
 					 * *DBAn register. */
+
+	/* control register read ahead for the background poll pass
+	 * polled_pass, see mips_ejtag_read_ctrl_multi(); entering debug
+	 * mode clears polled_pass, the value read ahead is stale then */
+	uint32_t polled_ctrl;
+	unsigned polled_pass;
+
+	/* DCR.PCSE is known to be set, PCsample can be read while the core
+	 * runs; cleared on reset, which disables PC sampling again */
+	bool pcsample_enabled;
+	bool pcsample_noasid;	/* DCR.PCnoASID, PCsample is 33 bits */
+
+	/* last values written to TCBCONTROLA/B; reading the registers
+	 * shifts these in, so a read doesn't change them; reset clears
+	 * both registers */
+	uint32_t tcb_controla;
+	uint32_t tcb_controlb;
 };
 
 void mips_ejtag_set_instr(struct mips_ejtag *ejtag_info,
 		int new_instr);
 int mips_ejtag_enter_debug(struct mips_ejtag *ejtag_info);
+int mips_ejtag_enter_debug_multi(struct mips_ejtag **ejtag_infos, int count);
+int mips_ejtag_read_ctrl_multi(struct mips_ejtag **ejtag_infos, int count, uint32_t *ctrl);
 int mips_ejtag_exit_debug(struct mips_ejtag *ejtag_info);
 int mips_ejtag_get_idcode(struct mips_ejtag *ejtag_info, uint32_t *idcode);
 void mips_ejtag_add_scan_96(struct mips_ejtag *ejtag_info,
@@ -354,6 +354,10 @@ static int mips_m14k_assert_reset(struct target *target)
 
 	enum reset_types jtag_reset_config = jtag_get_reset_config();
 
+	ejtag_info->pcsample_enabled = false;
+	ejtag_info->tcb_controla = 0;
+	ejtag_info->tcb_controlb = 0;
+
 	/* some cores support connecting while srst is asserted
 	 * use that mode is it has been configured */
 
@@ -1626,8 +1630,11 @@ struct target_type mips_m14k_target = {
 	.write_memory = mips_m14k_write_memory,
 	.checksum_memory = mips32_checksum_memory,
 	.blank_check_memory = mips32_blank_check_memory,
+	.profiling = mips32_profiling,
 
 	.run_algorithm = mips32_run_algorithm,
+	.start_algorithm = mips32_start_algorithm,
+	.wait_algorithm = mips32_wait_algorithm,
 
 	.add_breakpoint = mips_m14k_add_breakpoint,
 	.remove_breakpoint = mips_m14k_remove_breakpoint,
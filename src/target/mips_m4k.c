@@ -35,6 +35,7 @@
 #include "mips32_dmaacc.h"
 #include "target_type.h"
 #include "register.h"
+#include <helper/metrics.h>
 
 static void mips_m4k_enable_breakpoints(struct target *target);
 static void mips_m4k_enable_watchpoints(struct target *target);
@@ -42,6 +43,7 @@ static int mips_m4k_set_breakpoint(struct target *target,
 		struct breakpoint *breakpoint);
 static int mips_m4k_unset_breakpoint(struct target *target,
 		struct breakpoint *breakpoint);
+static int mips_m4k_sync_comparators(struct target *target);
 static int mips_m4k_internal_restore(struct target *target, int current,
 		uint32_t address, int handle_breakpoints,
 		int debug_execution);
@@ -49,6 +51,8 @@ static int mips_m4k_halt(struct target *target);
 static int mips_m4k_bulk_write_memory(struct target *target, uint32_t address,
 		uint32_t count, const uint8_t *buffer);
 
+static struct metric fastdata_fallbacks = METRIC_COUNTER("mips32.fastdata_fallbacks");
+
 static int mips_m4k_examine_debug_reason(struct target *target)
 {
 	struct mips32_common *mips32 = target_to_mips32(target);
@@ -159,11 +163,53 @@ static struct target *get_mips_m4k(struct target *target, int32_t coreid)
 	return target;
 }
 
+/* Halt all running cores of the SMP group with a single JTAG flush, so
+ * they stop within the same scan instead of one after another. */
+static int mips_m4k_halt_smp_multi(struct target *target)
+{
+	struct mips_ejtag *ejtag_infos[32];
+	struct target *cores[32];
+	struct target_list *head;
+	int count = 0;
+
+	for (head = target->head; head; head = head->next) {
+		struct target *curr = head->target;
+		if (curr == target || curr->state == TARGET_HALTED)
+			continue;
+
+		/* anything unusual goes the regular way, one core at a time */
+		struct mips_ejtag *ejtag_info = &target_to_mips32(curr)->ejtag_info;
+		if (curr->state != TARGET_RUNNING || count == ARRAY_SIZE(cores)
+				|| ejtag_info->ejtag_version == EJTAG_VERSION_20
+				|| (count && ejtag_info->ejtag_ctrl != ejtag_infos[0]->ejtag_ctrl))
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+		ejtag_infos[count] = ejtag_info;
+		cores[count++] = curr;
+	}
+
+	if (count < 2)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	int retval = mips_ejtag_enter_debug_multi(ejtag_infos, count);
+
+	for (int i = 0; i < count; i++)
+		cores[i]->debug_reason = DBG_REASON_DBGRQ;
+
+	return retval;
+}
+
 static int mips_m4k_halt_smp(struct target *target)
 {
 	int retval = ERROR_OK;
 	struct target_list *head;
 	struct target *curr;
+
+	retval = mips_m4k_halt_smp_multi(target);
+	if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+		return retval;
+	retval = ERROR_OK;
+
 	head = target->head;
 	while (head != (struct target_list *)NULL) {
 		int ret = ERROR_OK;
@@ -191,6 +237,46 @@ static int update_halt_gdb(struct target *target)
 	return retval;
 }
 
+/* During a background poll pass, read the control registers of all
+ * mips_m4k cores due in that pass with a single scan: the first core
+ * polled pays for the others, which pick up their value from polled_ctrl.
+ */
+static void mips_m4k_poll_prefetch(struct target *target)
+{
+	static unsigned prefetch_pass;
+	unsigned pass = target_poll_pass();
+	struct mips_ejtag *ejtag_infos[32];
+	uint32_t ctrl[32];
+	int count = 0;
+
+	if (pass == 0 || pass == prefetch_pass)
+		return;
+	prefetch_pass = pass;
+
+	uint32_t ejtag_ctrl = target_to_mips32(target)->ejtag_info.ejtag_ctrl;
+	for (struct target *curr = all_targets; curr && count < 32; curr = curr->next) {
+		if (curr->type != target->type || (curr != target && !target_poll_due(curr)))
+			continue;
+
+		struct mips_ejtag *ejtag_info = &target_to_mips32(curr)->ejtag_info;
+		bool shared_tap = false;
+		for (int i = 0; i < count; i++)
+			shared_tap |= ejtag_infos[i]->tap == ejtag_info->tap;
+		if (shared_tap || ejtag_info->ejtag_ctrl != ejtag_ctrl)
+			continue;
+
+		ejtag_infos[count++] = ejtag_info;
+	}
+
+	if (count < 2 || mips_ejtag_read_ctrl_multi(ejtag_infos, count, ctrl) != ERROR_OK)
+		return;
+
+	for (int i = 0; i < count; i++) {
+		ejtag_infos[i]->polled_ctrl = ctrl[i];
+		ejtag_infos[i]->polled_pass = pass;
+	}
+}
+
 static int mips_m4k_poll(struct target *target)
 {
 	int retval = ERROR_OK;
@@ -212,12 +298,18 @@ static int mips_m4k_poll(struct target *target)
 		return retval;
 	}
 
-	/* read ejtag control reg */
-	mips_ejtag_set_instr(ejtag_info, EJTAG_INST_CONTROL);
-	retval = mips_ejtag_drscan_32(ejtag_info, &ejtag_ctrl);
-	if (retval != ERROR_OK) {
-		LOG_DEBUG ("mips_ejtag_drscan_32 failed: ejtag_ctrl = 0x%8.8x", ejtag_ctrl);
-		return retval;
+	/* read ejtag control reg, unless read along with other cores */
+	mips_m4k_poll_prefetch(target);
+	if (ejtag_info->polled_pass && ejtag_info->polled_pass == target_poll_pass()) {
+		ejtag_ctrl = ejtag_info->polled_ctrl;
+		ejtag_info->polled_pass = 0;
+	} else {
+		mips_ejtag_set_instr(ejtag_info, EJTAG_INST_CONTROL);
+		retval = mips_ejtag_drscan_32(ejtag_info, &ejtag_ctrl);
+		if (retval != ERROR_OK) {
+			LOG_DEBUG ("mips_ejtag_drscan_32 failed: ejtag_ctrl = 0x%8.8x", ejtag_ctrl);
+			return retval;
+		}
 	}
 
 	/* clear this bit before handling polling
@@ -350,6 +442,10 @@ static int mips_m4k_assert_reset(struct target *target)
 
 	enum reset_types jtag_reset_config = jtag_get_reset_config();
 
+	ejtag_info->pcsample_enabled = false;
+	ejtag_info->tcb_controla = 0;
+	ejtag_info->tcb_controlb = 0;
+
 	/* some cores support connecting while srst is asserted
 	 * use that mode is it has been configured */
 
@@ -491,6 +587,7 @@ static int mips_m4k_internal_restore(struct target *target, int current,
 		target_free_all_working_areas(target);
 		mips_m4k_enable_breakpoints(target);
 		mips_m4k_enable_watchpoints(target);
+		mips_m4k_sync_comparators(target);
 	}
 
 	/* current = 1: continue on current pc, otherwise continue at <address> */
@@ -633,6 +730,77 @@ static int mips_m4k_step(struct target *target, int current,
 	return ERROR_OK;
 }
 
+/* Write every comparator changed since the last call, all of them in
+ * one processor access program.  Address and mask go out before the
+ * control register enabling the comparator.
+ */
+static int mips_m4k_sync_comparators(struct target *target)
+{
+	struct mips32_common *mips32 = target_to_mips32(target);
+	struct mips_ejtag *ejtag_info = &mips32->ejtag_info;
+	struct mips32_comparator *comparator;
+	uint32_t addr[15 * 3 + 15 * 5];
+	uint32_t val[15 * 3 + 15 * 5];
+	int count = 0;
+	int i, retval;
+
+	for (i = 0; i < mips32->num_inst_bpoints; i++) {
+		comparator = &mips32->inst_break_list[i];
+		if (!comparator->dirty)
+			continue;
+		if (comparator->ctrl) {
+			addr[count] = comparator->reg_address;
+			val[count++] = comparator->reg_value;
+			addr[count] = comparator->reg_address + ejtag_info->ejtag_ibm_offs;
+			val[count++] = 0;
+		}
+		addr[count] = comparator->reg_address + ejtag_info->ejtag_ibc_offs;
+		val[count++] = comparator->ctrl;
+	}
+
+	for (i = 0; i < mips32->num_data_bpoints; i++) {
+		comparator = &mips32->data_break_list[i];
+		if (!comparator->dirty)
+			continue;
+		if (comparator->ctrl) {
+			/* there is no ASID register in EJTAG 2.0 */
+			if (ejtag_info->ejtag_version != EJTAG_VERSION_20) {
+				addr[count] = comparator->reg_address + ejtag_info->ejtag_dbasid_offs;
+				val[count++] = 0;
+			}
+			addr[count] = comparator->reg_address;
+			val[count++] = comparator->reg_value;
+			addr[count] = comparator->reg_address + ejtag_info->ejtag_dbm_offs;
+			val[count++] = 0;
+		}
+		addr[count] = comparator->reg_address + ejtag_info->ejtag_dbc_offs;
+		val[count++] = comparator->ctrl;
+		/* TODO: probably this value is ignored on 2.0 */
+		if (comparator->ctrl) {
+			addr[count] = comparator->reg_address + ejtag_info->ejtag_dbv_offs;
+			val[count++] = 0;
+		}
+	}
+
+	if (count == 0)
+		return ERROR_OK;
+
+	retval = mips32_pracc_write_u32_list(ejtag_info, count, addr, val);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (i = 0; i < mips32->num_inst_bpoints; i++)
+		mips32->inst_break_list[i].dirty = 0;
+	for (i = 0; i < mips32->num_data_bpoints; i++)
+		mips32->data_break_list[i].dirty = 0;
+
+	return ERROR_OK;
+}
+
+static int mips_m4k_arm_breakpoint(struct target *target,
+		struct breakpoint *breakpoint);
+
+/* arm pending breakpoints, the caller writes the comparators */
 static void mips_m4k_enable_breakpoints(struct target *target)
 {
 	struct breakpoint *breakpoint = target->breakpoints;
@@ -640,13 +808,23 @@ static void mips_m4k_enable_breakpoints(struct target *target)
 	/* set any pending breakpoints */
 	while (breakpoint) {
 		if (breakpoint->set == 0)
-			mips_m4k_set_breakpoint(target, breakpoint);
+			mips_m4k_arm_breakpoint(target, breakpoint);
 		breakpoint = breakpoint->next;
 	}
 }
 
 static int mips_m4k_set_breakpoint(struct target *target,
 		struct breakpoint *breakpoint)
+{
+	int retval = mips_m4k_arm_breakpoint(target, breakpoint);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return mips_m4k_sync_comparators(target);
+}
+
+static int mips_m4k_arm_breakpoint(struct target *target,
+		struct breakpoint *breakpoint)
 {
 	struct mips32_common *mips32 = target_to_mips32(target);
 	struct mips_ejtag *ejtag_info = &mips32->ejtag_info;
@@ -673,39 +851,22 @@ static int mips_m4k_set_breakpoint(struct target *target,
 
 		breakpoint->set = bp_num + 1;
 		comparator_list[bp_num].used = 1;
+		comparator_list[bp_num].bp_value = breakpoint->address;
+
+		/* Check for microMips and executing in MIPS16 ISA */
+		comparator_list[bp_num].reg_value = breakpoint->address;
+		if (mips32->mmips != MIPS32_ONLY &&
+				((breakpoint->length == 3) || (breakpoint->length == 5)))
+			comparator_list[bp_num].reg_value |= 1;
 
 		/* EJTAG 2.0 uses 30bit IBA. First 2 bits are reserved.
 		 * Warning: there is no IB ASID registers in 2.0.
 		 * Do not set it! :) */
 		if (ejtag_info->ejtag_version == EJTAG_VERSION_20)
-			comparator_list[bp_num].bp_value &= 0xFFFFFFFC;
+			comparator_list[bp_num].reg_value &= 0xFFFFFFFC;
 
-		/* Check for microMips and executing in MIPS16 ISA */
-		if (mips32->mmips != MIPS32_ONLY) {
-			if ((breakpoint->length == 3) || (breakpoint->length == 5)){
-				comparator_list[bp_num].bp_value = breakpoint->address | 1;
-				target_write_u32(target, comparator_list[bp_num].reg_address,
-								 comparator_list[bp_num].bp_value);
-			}
-			else {
-				comparator_list[bp_num].bp_value = breakpoint->address;
-				target_write_u32(target, comparator_list[bp_num].reg_address,
-								 comparator_list[bp_num].bp_value);
-			}
-		}
-		else {
-			comparator_list[bp_num].bp_value = breakpoint->address;
-				target_write_u32(target, comparator_list[bp_num].reg_address,
-								 comparator_list[bp_num].bp_value);
-		}
-		
-		comparator_list[bp_num].bp_value = breakpoint->address;
-
-		target_write_u32(target, comparator_list[bp_num].reg_address +
-				 ejtag_info->ejtag_ibm_offs, 0x00000000);
-
-		target_write_u32(target, comparator_list[bp_num].reg_address +
-				 ejtag_info->ejtag_ibc_offs, 1);
+		comparator_list[bp_num].ctrl = 1;
+		comparator_list[bp_num].dirty = 1;
 		LOG_DEBUG("bpid: %" PRIu32 ", bp_num %i bp_value 0x%" PRIx32 "",
 				  breakpoint->unique_id,
 				  bp_num, comparator_list[bp_num].bp_value);
@@ -815,7 +976,6 @@ static int mips_m4k_unset_breakpoint(struct target *target,
 {
 	/* get pointers to arch-specific information */
 	struct mips32_common *mips32 = target_to_mips32(target);
-	struct mips_ejtag *ejtag_info = &mips32->ejtag_info;
 	struct mips32_comparator *comparator_list = mips32->inst_break_list;
 	int retval;
 
@@ -838,9 +998,12 @@ static int mips_m4k_unset_breakpoint(struct target *target,
 
 		comparator_list[bp_num].used = 0;
 		comparator_list[bp_num].bp_value = 0;
+		comparator_list[bp_num].ctrl = 0;
+		comparator_list[bp_num].dirty = 1;
 
-		target_write_u32(target, comparator_list[bp_num].reg_address +
-				 ejtag_info->ejtag_ibc_offs, 0);
+		retval = mips_m4k_sync_comparators(target);
+		if (retval != ERROR_OK)
+			return retval;
 	} else {
 		/* restore original instruction (kept in target endianness) */
 		LOG_DEBUG("bpid: %" PRIu32, breakpoint->unique_id);
@@ -937,7 +1100,7 @@ static int mips_m4k_remove_breakpoint(struct target *target,
 	return ERROR_OK;
 }
 
-static int mips_m4k_set_watchpoint(struct target *target,
+static int mips_m4k_arm_watchpoint(struct target *target,
 		struct watchpoint *watchpoint)
 {
 	struct mips32_common *mips32 = target_to_mips32(target);
@@ -996,31 +1159,30 @@ static int mips_m4k_set_watchpoint(struct target *target,
 	 * There is as well no ASID register support. */
 	if (ejtag_info->ejtag_version == EJTAG_VERSION_20)
 		comparator_list[wp_num].bp_value &= 0xFFFFFFF8;
-	else
-		target_write_u32(target, comparator_list[wp_num].reg_address +
-			 ejtag_info->ejtag_dbasid_offs, 0x00000000);
-
-	target_write_u32(target, comparator_list[wp_num].reg_address,
-			 comparator_list[wp_num].bp_value);
-	target_write_u32(target, comparator_list[wp_num].reg_address +
-			 ejtag_info->ejtag_dbm_offs, 0x00000000);
-
-	target_write_u32(target, comparator_list[wp_num].reg_address +
-			 ejtag_info->ejtag_dbc_offs, enable);
-	/* TODO: probably this value is ignored on 2.0 */
-	target_write_u32(target, comparator_list[wp_num].reg_address +
-			 ejtag_info->ejtag_dbv_offs, 0);
+
+	comparator_list[wp_num].reg_value = comparator_list[wp_num].bp_value;
+	comparator_list[wp_num].ctrl = enable;
+	comparator_list[wp_num].dirty = 1;
 	LOG_DEBUG("wp_num %i bp_value 0x%" PRIx32 "", wp_num, comparator_list[wp_num].bp_value);
 
 	return ERROR_OK;
 }
 
+static int mips_m4k_set_watchpoint(struct target *target,
+		struct watchpoint *watchpoint)
+{
+	int retval = mips_m4k_arm_watchpoint(target, watchpoint);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return mips_m4k_sync_comparators(target);
+}
+
 static int mips_m4k_unset_watchpoint(struct target *target,
 		struct watchpoint *watchpoint)
 {
 	/* get pointers to arch-specific information */
 	struct mips32_common *mips32 = target_to_mips32(target);
-	struct mips_ejtag *ejtag_info = &mips32->ejtag_info;
 	struct mips32_comparator *comparator_list = mips32->data_break_list;
 
 	if (!watchpoint->set) {
@@ -1035,11 +1197,11 @@ static int mips_m4k_unset_watchpoint(struct target *target,
 	}
 	comparator_list[wp_num].used = 0;
 	comparator_list[wp_num].bp_value = 0;
-	target_write_u32(target, comparator_list[wp_num].reg_address +
-			 ejtag_info->ejtag_dbc_offs, 0);
+	comparator_list[wp_num].ctrl = 0;
+	comparator_list[wp_num].dirty = 1;
 	watchpoint->set = 0;
 
-	return ERROR_OK;
+	return mips_m4k_sync_comparators(target);
 }
 
 static int mips_m4k_add_watchpoint(struct target *target, struct watchpoint *watchpoint)
@@ -1076,6 +1238,7 @@ static int mips_m4k_remove_watchpoint(struct target *target,
 	return ERROR_OK;
 }
 
+/* arm pending watchpoints, the caller writes the comparators */
 static void mips_m4k_enable_watchpoints(struct target *target)
 {
 	struct watchpoint *watchpoint = target->watchpoints;
@@ -1083,7 +1246,7 @@ static void mips_m4k_enable_watchpoints(struct target *target)
 	/* set any pending watchpoints */
 	while (watchpoint) {
 		if (watchpoint->set == 0)
-			mips_m4k_set_watchpoint(target, watchpoint);
+			mips_m4k_arm_watchpoint(target, watchpoint);
 		watchpoint = watchpoint->next;
 	}
 }
@@ -1171,6 +1334,7 @@ static int mips_m4k_write_memory(struct target *target, uint32_t address,
 				(ejtag_info->scan_delay < MIPS32_SCAN_DELAY_LEGACY_MODE)) {
 				return retval;
 			}
+		metric_inc(&fastdata_fallbacks);
 		LOG_WARNING("Falling back to non-bulk write");
 	}
 
@@ -1622,8 +1786,11 @@ struct target_type mips_m4k_target = {
 	.write_memory = mips_m4k_write_memory,
 	.checksum_memory = mips32_checksum_memory,
 	.blank_check_memory = mips32_blank_check_memory,
+	.profiling = mips32_profiling,
 
 	.run_algorithm = mips32_run_algorithm,
+	.start_algorithm = mips32_start_algorithm,
+	.wait_algorithm = mips32_wait_algorithm,
 
 	.add_breakpoint = mips_m4k_add_breakpoint,
 	.remove_breakpoint = mips_m4k_remove_breakpoint,
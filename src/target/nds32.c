@@ -2489,6 +2489,11 @@ int nds32_profiling(struct target *target, uint32_t *samples,
 	struct aice_port_s *aice = target_to_aice(target);
 	struct nds32 *nds32 = target_to_nds32(target);
 
+	if (target->state != TARGET_HALTED) {
+		LOG_WARNING("target %s is not halted", target->cmd_name);
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
 	if (max_num_samples < iteration)
 		iteration = max_num_samples;
 
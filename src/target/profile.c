@@ -0,0 +1,117 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include "profile.h"
+
+#include <assert.h>
+
+/* Fibonacci hashing: the top bits of pc * 2^32/phi index the table */
+static uint32_t profile_hash(struct profile_histogram *hist, uint32_t pc)
+{
+	uint32_t h = pc * 2654435761u;
+	return (uint32_t)(((uint64_t)h << hist->bits) >> 32);
+}
+
+int profile_histogram_init(struct profile_histogram *hist, uint32_t max_samples)
+{
+	/* a power of two, at most three quarters full so probes stay short */
+	uint32_t size = max_samples + max_samples / 3 + 1;
+	uint32_t slots = 1;
+	unsigned bits = 0;
+	while (slots < size) {
+		slots <<= 1;
+		bits++;
+	}
+
+	hist->entries = calloc(slots, sizeof(*hist->entries));
+	if (hist->entries == NULL) {
+		LOG_ERROR("No memory for %" PRIu32 " profile entries", slots);
+		return ERROR_FAIL;
+	}
+
+	hist->size = slots;
+	hist->bits = bits;
+	hist->used = 0;
+	hist->total = 0;
+
+	return ERROR_OK;
+}
+
+void profile_histogram_free(struct profile_histogram *hist)
+{
+	free(hist->entries);
+	hist->entries = NULL;
+	hist->size = 0;
+	hist->bits = 0;
+}
+
+void profile_histogram_clear(struct profile_histogram *hist)
+{
+	memset(hist->entries, 0, hist->size * sizeof(*hist->entries));
+	hist->used = 0;
+	hist->total = 0;
+}
+
+void profile_histogram_add(struct profile_histogram *hist, uint32_t pc)
+{
+	uint32_t i = profile_hash(hist, pc);
+
+	hist->total++;
+
+	for (;;) {
+		struct profile_entry *e = &hist->entries[i];
+
+		if (e->count == 0) {
+			/* init left room for every sample, the table can't fill */
+			assert(hist->used < hist->size - 1);
+			e->pc = pc;
+			e->count = 1;
+			hist->used++;
+			return;
+		}
+
+		if (e->pc == pc) {
+			if (e->count != UINT32_MAX)
+				e->count++;
+			return;
+		}
+
+		i = (i + 1) & (hist->size - 1);
+	}
+}
+
+int profile_histogram_write_folded(struct profile_histogram *hist, FILE *f)
+{
+	for (uint32_t i = 0; i < hist->size; i++) {
+		struct profile_entry *e = &hist->entries[i];
+		if (e->count)
+			fprintf(f, "0x%8.8" PRIx32 " %" PRIu32 "\n", e->pc, e->count);
+	}
+
+	if (fflush(f) != 0) {
+		LOG_ERROR("couldn't write profile data");
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
@@ -0,0 +1,56 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+struct profile_entry {
+	uint32_t pc;
+	uint32_t count;	/**< zero marks a free slot */
+};
+
+/**
+ * A histogram of PC samples kept in a fixed size, open addressed hash
+ * table.  Memory never grows: the table is sized for the most samples
+ * added between two clears, which may all be distinct PCs.
+ */
+struct profile_histogram {
+	struct profile_entry *entries;
+	uint32_t size;		/**< number of slots, a power of two */
+	unsigned bits;		/**< log2(size) */
+	uint32_t used;		/**< number of distinct PCs */
+	uint64_t total;		/**< samples added since the last clear */
+};
+
+/** Set up for adding up to @a max_samples samples between clears. */
+int profile_histogram_init(struct profile_histogram *hist, uint32_t max_samples);
+void profile_histogram_free(struct profile_histogram *hist);
+void profile_histogram_clear(struct profile_histogram *hist);
+void profile_histogram_add(struct profile_histogram *hist, uint32_t pc);
+
+/**
+ * Append the histogram to @a f in "folded stack" format, one line of
+ * "0xPC count" per distinct PC, as read by flame graph tools.  Those
+ * tools sum repeated lines, so histograms written one after another
+ * into the same file add up.
+ */
+int profile_histogram_write_folded(struct profile_histogram *hist, FILE *f);
+
+#endif /* PROFILE_H */
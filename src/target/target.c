@@ -44,6 +44,7 @@
 #endif
 
 #include <helper/time_support.h>
+#include <helper/metrics.h>
 #include <jtag/jtag.h>
 #include <flash/nor/core.h>
 
@@ -54,6 +55,7 @@
 #include "register.h"
 #include "trace.h"
 #include "image.h"
+#include "profile.h"
 #include "rtos/rtos.h"
 
 /* default halt wait timeout (ms) */
@@ -72,8 +74,10 @@ static int target_get_gdb_fileio_info_default(struct target *target,
 		struct gdb_fileio_info *fileio_info);
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
 		int fileio_errno, bool ctrl_c);
-static int target_profiling_default(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
+static void target_forget_resident_code(struct target *target,
+		uint32_t address, uint32_t size);
+static void target_forget_all_resident_code(struct target *target);
+static void target_memory_written(struct target *target);
 
 /* targets */
 extern struct target_type arm7tdmi_target;
@@ -141,6 +145,13 @@ struct target *all_targets;
 static struct target_event_callback *target_event_callbacks;
 static struct target_timer_callback *target_timer_callbacks;
 static const int polling_interval = 100;
+/* right after a resume or step targets are polled every polling_fast ms,
+ * backing off to polling_interval while they run and up to polling_idle
+ * while they sit halted */
+static const int polling_fast = 10;
+static const int polling_idle = 1000;
+
+static void target_poll_fast(struct target *target);
 
 static const Jim_Nvp nvp_assert[] = {
 	{ .name = "assert", NVP_ASSERT },
@@ -586,6 +597,8 @@ int target_resume(struct target *target, int current, uint32_t address, int hand
 	if (retval != ERROR_OK)
 		return retval;
 
+	target_poll_fast(target);
+
 	target_call_event_callbacks(target, TARGET_EVENT_RESUME_END);
 
 	return retval;
@@ -760,6 +773,7 @@ int target_run_algorithm(struct target *target,
 		goto done;
 	}
 
+	target_memory_written(target);
 	target->running_alg = true;
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
@@ -800,6 +814,7 @@ int target_start_algorithm(struct target *target,
 		goto done;
 	}
 
+	target_memory_written(target);
 	target->running_alg = true;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
@@ -1015,6 +1030,9 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target not examined yet");
 		return ERROR_FAIL;
 	}
+	if (target->resident_code)
+		target_forget_resident_code(target, address, size * count);
+	target_memory_written(target);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1025,6 +1043,9 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target not examined yet");
 		return ERROR_FAIL;
 	}
+	/* we can't tell which working area memory this is */
+	target_forget_all_resident_code(target);
+	target_memory_written(target);
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1105,7 +1126,11 @@ int target_get_gdb_reg_list(struct target *target,
 int target_step(struct target *target,
 		int current, uint32_t address, int handle_breakpoints)
 {
-	return target->type->step(target, current, address, handle_breakpoints);
+	int retval = target->type->step(target, current, address, handle_breakpoints);
+	if (retval == ERROR_OK)
+		target_poll_fast(target);
+
+	return retval;
 }
 
 int target_get_gdb_fileio_info(struct target *target, struct gdb_fileio_info *fileio_info)
@@ -1129,8 +1154,9 @@ int target_gdb_fileio_end(struct target *target, int retcode, int fileio_errno,
 int target_profiling(struct target *target, uint32_t *samples,
 			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
 {
-	if (target->state != TARGET_HALTED) {
-		LOG_WARNING("target %s is not halted", target->cmd_name);
+	/* the profilers halt a running target themselves, if they must */
+	if (target->state != TARGET_HALTED && target->state != TARGET_RUNNING) {
+		LOG_WARNING("target %s is not halted or running", target->cmd_name);
 		return ERROR_TARGET_NOT_HALTED;
 	}
 	return target->type->profiling(target, samples, max_num_samples,
@@ -1438,6 +1464,9 @@ static int target_call_timer_callback(struct target_timer_callback *cb,
 	return target_unregister_timer_callback(cb->callback, cb->priv);
 }
 
+/* set while periodic callbacks run unconditionally, see handle_target() */
+static bool poll_force;
+
 static int target_call_timer_callbacks_check_time(int checktime)
 {
 	keep_alive();
@@ -1445,6 +1474,8 @@ static int target_call_timer_callbacks_check_time(int checktime)
 	struct timeval now;
 	gettimeofday(&now, NULL);
 
+	poll_force = !checktime;
+
 	struct target_timer_callback *callback = target_timer_callbacks;
 	while (callback) {
 		/* cleaning up may unregister and free this callback */
@@ -1458,13 +1489,16 @@ static int target_call_timer_callbacks_check_time(int checktime)
 
 		if (call_it) {
 			int retval = target_call_timer_callback(callback, &now);
-			if (retval != ERROR_OK)
+			if (retval != ERROR_OK) {
+				poll_force = false;
 				return retval;
+			}
 		}
 
 		callback = next_callback;
 	}
 
+	poll_force = false;
 	return ERROR_OK;
 }
 
@@ -1479,6 +1513,24 @@ int target_call_timer_callbacks_now(void)
 	return target_call_timer_callbacks_check_time(0);
 }
 
+int64_t target_timer_next_event(void)
+{
+	struct timeval now;
+	int64_t next = INT64_MAX;
+
+	gettimeofday(&now, NULL);
+
+	for (struct target_timer_callback *callback = target_timer_callbacks;
+			callback; callback = callback->next) {
+		int64_t ms = (callback->when.tv_sec - now.tv_sec) * 1000 +
+			(callback->when.tv_usec - now.tv_usec) / 1000;
+		if (ms < next)
+			next = ms;
+	}
+
+	return (next < 0) ? 0 : next;
+}
+
 /* Prints the working area layout for debug purposes */
 static void print_wa_layout(struct target *target)
 {
@@ -1556,6 +1608,47 @@ static void target_merge_working_areas(struct target *target)
 	}
 }
 
+/* Forget about resident algorithms overlapping [address, address + size),
+ * their memory is about to be reused or overwritten */
+static void target_forget_resident_code(struct target *target,
+		uint32_t address, uint32_t size)
+{
+	struct working_area_code **p = &target->resident_code;
+
+	while (*p) {
+		struct working_area_code *r = *p;
+
+		if (size && ((r->address - address) < size || (address - r->address) < r->size)) {
+			LOG_DEBUG("dropping resident algorithm at 0x%08" PRIx32, r->address);
+			*p = r->next;
+			free(r->code);
+			free(r);
+		} else
+			p = &r->next;
+	}
+}
+
+static void target_forget_all_resident_code(struct target *target)
+{
+	while (target->resident_code) {
+		struct working_area_code *r = target->resident_code;
+		target->resident_code = r->next;
+		free(r->code);
+		free(r);
+	}
+}
+
+/* Tell the GDB server that target memory changed under its halt snapshot,
+ * algorithms count as writes too, they usually program flash */
+static void target_memory_written(struct target *target)
+{
+	if (target->gdb_service)
+		target->gdb_service->write_count++;
+}
+
+static struct metric working_area_allocs = METRIC_COUNTER("target.working_area_allocs");
+static struct metric working_area_failures = METRIC_COUNTER("target.working_area_failures");
+
 int target_alloc_working_area_try(struct target *target, uint32_t size, struct working_area **area)
 {
 	/* Reevaluate working area address based on MMU state*/
@@ -1618,14 +1711,21 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 		c = c->next;
 	}
 
-	if (c == NULL)
+	if (c == NULL) {
+		metric_inc(&working_area_failures);
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+
+	metric_inc(&working_area_allocs);
 
 	/* Split the working area into the requested size */
 	target_split_working_area(c, size);
 
 	LOG_DEBUG("allocated new working area of %"PRIu32" bytes at address 0x%08"PRIx32, size, c->address);
 
+	/* the new owner is going to overwrite whatever code was left there */
+	target_forget_resident_code(target, c->address, c->size);
+
 	if (target->backup_working_area) {
 		if (c->backup == NULL) {
 			c->backup = malloc(c->size);
@@ -1661,6 +1761,93 @@ int target_alloc_working_area(struct target *target, uint32_t size, struct worki
 
 }
 
+/* Allocate the working area at @a address, which must lie inside a free
+ * area; used to get a resident algorithm back where it was left. */
+static int target_alloc_working_area_at(struct target *target, uint32_t address,
+		uint32_t size, struct working_area **area)
+{
+	struct working_area *c = target->working_areas;
+
+	while (c) {
+		if (c->free && address >= c->address
+				&& address - c->address + size <= c->size)
+			break;
+		c = c->next;
+	}
+
+	if (c == NULL)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	/* split off the free space in front of it, then the tail */
+	if (address > c->address) {
+		target_split_working_area(c, address - c->address);
+		c = c->next;
+		if (c == NULL || c->address != address)
+			return ERROR_FAIL;
+	}
+	target_split_working_area(c, size);
+	if (c->size != size)
+		return ERROR_FAIL;
+
+	LOG_DEBUG("reusing resident algorithm of %"PRIu32" bytes at address 0x%08"PRIx32, size, c->address);
+
+	c->free = false;
+	*area = c;
+	c->user = area;
+
+	print_wa_layout(target);
+
+	return ERROR_OK;
+}
+
+int target_alloc_working_area_code(struct target *target,
+		const uint8_t *code, uint32_t size, struct working_area **area)
+{
+	struct working_area_code *r;
+	int retval;
+
+	/* with backups enabled, freeing the area restores the old contents */
+	if (!target->backup_working_area) {
+		for (r = target->resident_code; r; r = r->next) {
+			if (r->size == size && memcmp(r->code, code, size) == 0) {
+				/* only allocate multiples of 4 byte */
+				if (target_alloc_working_area_at(target, r->address,
+						(size + 3) & (~3UL), area) == ERROR_OK)
+					return ERROR_OK;
+				break;
+			}
+		}
+	}
+
+	retval = target_alloc_working_area(target, size, area);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = target_write_buffer(target, (*area)->address, size, code);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, *area);
+		return retval;
+	}
+
+	if (!target->backup_working_area) {
+		r = malloc(sizeof(*r));
+		if (r) {
+			r->code = malloc(size);
+			if (r->code == NULL) {
+				free(r);
+				return ERROR_OK;
+			}
+			memcpy(r->code, code, size);
+			r->address = (*area)->address;
+			r->size = size;
+			r->next = target->resident_code;
+			target->resident_code = r;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int target_restore_working_area(struct target *target, struct working_area *area)
 {
 	int retval = ERROR_OK;
@@ -1723,6 +1910,9 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 
 	LOG_DEBUG("freeing all working areas");
 
+	/* the application may use this memory from now on */
+	target_forget_all_resident_code(target);
+
 	/* Loop through all areas, restoring the allocated ones and marking them as free */
 	while (c) {
 		if (!c->free) {
@@ -1798,7 +1988,7 @@ static int target_gdb_fileio_end_default(struct target *target,
 	return ERROR_OK;
 }
 
-static int target_profiling_default(struct target *target, uint32_t *samples,
+int target_profiling_default(struct target *target, uint32_t *samples,
 		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
 {
 	struct timeval timeout, now;
@@ -1872,6 +2062,9 @@ int target_write_buffer(struct target *target, uint32_t address, uint32_t size,
 		return ERROR_FAIL;
 	}
 
+	if (target->resident_code)
+		target_forget_resident_code(target, address, size);
+	target_memory_written(target);
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -2324,20 +2517,106 @@ static int sense_handler(void)
 	return ERROR_OK;
 }
 
+/* id of the background polling pass in progress and when it started */
+static unsigned poll_pass, poll_pass_active;
+static int64_t poll_pass_now;
+
+unsigned target_poll_pass(void)
+{
+	return poll_pass_active;
+}
+
+static int target_poll_interval(struct target *target)
+{
+	int interval = target->poll_sched.interval;
+
+	if (interval <= 0)
+		interval = polling_interval;
+	/* e.g. SMP siblings resumed along with another core */
+	if (target->state != TARGET_HALTED && interval > polling_interval)
+		interval = polling_interval;
+
+	return interval;
+}
+
+bool target_poll_due(struct target *target)
+{
+	if (!poll_pass_active || !target_was_examined(target) || !target->tap->enabled)
+		return false;
+
+	return poll_force ||
+		poll_pass_now - target->poll_sched.last >= target_poll_interval(target);
+}
+
+/* adjust the interval after a background poll that saw prev_state before */
+static void target_poll_reschedule(struct target *target, enum target_state prev_state)
+{
+	int interval = target_poll_interval(target);
+
+	if (target->state != prev_state)
+		interval = (target->state == TARGET_RUNNING) ? polling_fast : polling_interval;
+	else if (target->state == TARGET_HALTED)
+		interval = (2 * interval < polling_idle) ? 2 * interval : polling_idle;
+	else
+		interval = (2 * interval < polling_interval) ? 2 * interval : polling_interval;
+
+	target->poll_sched.interval = interval;
+}
+
+/* make the background poller run again in ms from now, and every ms */
+static void target_poll_timer_rearm(int ms)
+{
+	struct target_timer_callback *callback = target_timer_callbacks;
+
+	while (callback && callback->callback != handle_target)
+		callback = callback->next;
+	if (callback == NULL)
+		return;
+
+	callback->time_ms = ms;
+
+	struct timeval when;
+	gettimeofday(&when, NULL);
+	timeval_add_time(&when, 0, ms * 1000);
+	if (timercmp(&when, &callback->when, <))
+		callback->when = when;
+}
+
+/* the target was just resumed or stepped, look for it to halt soon */
+static void target_poll_fast(struct target *target)
+{
+	if (target->smp) {
+		for (struct target_list *head = target->head; head; head = head->next) {
+			head->target->poll_sched.interval = polling_fast;
+			head->target->poll_sched.last = timeval_ms();
+		}
+	} else {
+		target->poll_sched.interval = polling_fast;
+		target->poll_sched.last = timeval_ms();
+	}
+
+	target_poll_timer_rearm(polling_fast);
+}
+
 /* process target state changes */
 static int handle_target(void *priv)
 {
 	Jim_Interp *interp = (Jim_Interp *)priv;
 	int retval = ERROR_OK;
+	int next_ms = polling_interval;
+	static int64_t last_sense;
 
 	if (!is_jtag_poll_safe()) {
 		/* polling is disabled currently */
 		return ERROR_OK;
 	}
 
+	poll_pass_now = timeval_ms();
+
 	/* we do not want to recurse here... */
 	static int recursive;
-	if (!recursive) {
+	if (!recursive && (poll_force || poll_pass_now - last_sense >= polling_interval)) {
+		last_sense = poll_pass_now;
 		recursive = 1;
 		sense_handler();
 		/* danger! running these procedures can trigger srst assertions and power dropouts.
@@ -2380,8 +2659,12 @@ static int handle_target(void *priv)
 	}
 
 	/* Poll targets for state changes unless that's globally disabled.
-	 * Skip targets that are currently disabled.
+	 * Skip targets that are currently disabled, and those not due yet.
 	 */
+	if (++poll_pass == 0)
+		poll_pass++;
+	poll_pass_active = poll_pass;
+
 	for (struct target *target = all_targets;
 			is_jtag_poll_safe() && target;
 			target = target->next) {
@@ -2392,6 +2675,15 @@ static int handle_target(void *priv)
 		if (!target->tap->enabled)
 			continue;
 
+		if (!target_poll_due(target)) {
+			int wait = target_poll_interval(target) -
+				(poll_pass_now - target->poll_sched.last);
+			if (wait < next_ms)
+				next_ms = wait;
+			continue;
+		}
+		target->poll_sched.last = poll_pass_now;
+
 		if (target->backoff.times > target->backoff.count) {
 			/* do not poll this time as we failed previously */
 			target->backoff.count++;
@@ -2401,8 +2693,20 @@ static int handle_target(void *priv)
 
 		/* only poll target if we've got power and srst isn't asserted */
 		if (!powerDropout && !srstAsserted) {
+			enum target_state prev_state = target->state;
+			struct duration poll_time;
+
 			/* polling may fail silently until the target has been examined */
+			duration_start(&poll_time);
 			retval = target_poll(target);
+			duration_measure(&poll_time);
+
+			int64_t us = duration_elapsed(&poll_time) * 1000000;
+			target->poll_sched.count++;
+			target->poll_sched.total_us += us;
+			if (us > target->poll_sched.max_us)
+				target->poll_sched.max_us = us;
+
 			if (retval != ERROR_OK) {
 				/* 100ms polling interval. Increase interval between polling up to 5000ms */
 				if (target->backoff.times * polling_interval < 5000) {
@@ -2417,6 +2721,7 @@ static int handle_target(void *priv)
 				 * run monitor commands to handle the situation.
 				 */
 				target_call_event_callbacks(target, TARGET_EVENT_GDB_HALT);
+				poll_pass_active = 0;
 				return retval;
 			}
 			/* Since we succeeded, we reset backoff count */
@@ -2427,8 +2732,15 @@ static int handle_target(void *priv)
 			}
 
 			target->backoff.times = 0;
+			target_poll_reschedule(target, prev_state);
 		}
+
+		if (target_poll_interval(target) < next_ms)
+			next_ms = target_poll_interval(target);
 	}
+	poll_pass_active = 0;
+
+	target_poll_timer_rearm((next_ms < polling_fast) ? polling_fast : next_ms);
 
 	return retval;
 }
@@ -2564,6 +2876,12 @@ COMMAND_HANDLER(handle_poll_command)
 		command_print(CMD_CTX, "TAP: %s (%s)",
 				target->tap->dotted_name,
 				target->tap->enabled ? "enabled" : "disabled");
+		if (target->poll_sched.count)
+			command_print(CMD_CTX, "polled every %d ms, %" PRIu64 " polls, "
+					"%" PRId64 " us avg, %" PRId64 " us max",
+					target_poll_interval(target), target->poll_sched.count,
+					target->poll_sched.total_us / (int64_t)target->poll_sched.count,
+					target->poll_sched.max_us);
 		if (!target->tap->enabled)
 			return ERROR_OK;
 		retval = target_poll(target);
@@ -2975,6 +3293,7 @@ static COMMAND_HELPER(parse_load_image_command_CMD_ARGV, struct image *image,
 COMMAND_HANDLER(handle_load_image_command)
 {
 	uint8_t *buffer;
+	const uint8_t *data;
 	size_t buf_cnt;
 	uint32_t image_size;
 	uint32_t min_address = 0;
@@ -2998,18 +3317,24 @@ COMMAND_HANDLER(handle_load_image_command)
 	image_size = 0x0;
 	retval = ERROR_OK;
 	for (i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD_CTX,
-						  "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
-			break;
-		}
+		buffer = NULL;
+		if (image_section_data(&image, i, &data) == ERROR_OK)
+			buf_cnt = image.sections[i].size;
+		else {
+			buffer = malloc(image.sections[i].size);
+			if (buffer == NULL) {
+				command_print(CMD_CTX,
+							  "error allocating buffer for section (%d bytes)",
+							  (int)(image.sections[i].size));
+				break;
+			}
 
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
+			if (retval != ERROR_OK) {
+				free(buffer);
+				break;
+			}
+			data = buffer;
 		}
 
 		uint32_t offset = 0;
@@ -3030,7 +3355,7 @@ COMMAND_HANDLER(handle_load_image_command)
 				length -= (image.sections[i].base_address + buf_cnt)-max_address;
 
 			retval = target_write_buffer(target,
-					image.sections[i].base_address + offset, length, buffer + offset);
+					image.sections[i].base_address + offset, length, data + offset);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3121,6 +3446,7 @@ COMMAND_HANDLER(handle_dump_image_command)
 static COMMAND_HELPER(handle_verify_image_command_internal, int verify)
 {
 	uint8_t *buffer;
+	const uint8_t *image_data;
 	size_t buf_cnt;
 	uint32_t image_size;
 	int i;
@@ -3163,22 +3489,28 @@ static COMMAND_HELPER(handle_verify_image_command_internal, int verify)
 	int diffs = 0;
 	retval = ERROR_OK;
 	for (i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD_CTX,
-					"error allocating buffer for section (%d bytes)",
-					(int)(image.sections[i].size));
-			break;
-		}
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
+		buffer = NULL;
+		if (image_section_data(&image, i, &image_data) == ERROR_OK)
+			buf_cnt = image.sections[i].size;
+		else {
+			buffer = malloc(image.sections[i].size);
+			if (buffer == NULL) {
+				command_print(CMD_CTX,
+						"error allocating buffer for section (%d bytes)",
+						(int)(image.sections[i].size));
+				break;
+			}
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
+			if (retval != ERROR_OK) {
+				free(buffer);
+				break;
+			}
+			image_data = buffer;
 		}
 
 		if (verify) {
 			/* calculate checksum of image */
-			retval = image_calculate_checksum(buffer, buf_cnt, &checksum);
+			retval = image_calculate_checksum(image_data, buf_cnt, &checksum);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3210,13 +3542,13 @@ static COMMAND_HELPER(handle_verify_image_command_internal, int verify)
 				if (retval == ERROR_OK) {
 					uint32_t t;
 					for (t = 0; t < buf_cnt; t++) {
-						if (data[t] != buffer[t]) {
+						if (data[t] != image_data[t]) {
 							command_print(CMD_CTX,
 										  "diff %d address 0x%08x. Was 0x%02x instead of 0x%02x",
 										  diffs,
 										  (unsigned)(t + image.sections[i].base_address),
 										  data[t],
-										  buffer[t]);
+										  image_data[t]);
 							if (diffs++ >= 127) {
 								command_print(CMD_CTX, "More than 128 errors, the rest are not printed.");
 								free(data);
@@ -3690,6 +4022,78 @@ COMMAND_HANDLER(handle_profile_command)
 	return retval;
 }
 
+/* profile_folded keeps sampling for as long as asked, appending each
+ * interval's histogram to the output file, so memory stays bounded and
+ * the file can be turned into a flame graph while capture goes on */
+COMMAND_HANDLER(handle_profile_folded_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC != 2 && CMD_ARGC != 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	const uint32_t MAX_PROFILE_SAMPLE_NUM = 10000;
+	uint32_t seconds, interval = 10;
+	int retval;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], seconds);
+	if (CMD_ARGC == 3)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], interval);
+	if (interval == 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct profile_histogram hist;
+	/* one histogram per call of the profiler, never more samples */
+	retval = profile_histogram_init(&hist, MAX_PROFILE_SAMPLE_NUM);
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint32_t *samples = malloc(sizeof(uint32_t) * MAX_PROFILE_SAMPLE_NUM);
+	FILE *f = fopen(CMD_ARGV[1], "w");
+	if (samples == NULL || f == NULL) {
+		LOG_ERROR("couldn't set up profiling to '%s'", CMD_ARGV[1]);
+		retval = ERROR_FAIL;
+		goto done;
+	}
+
+	uint64_t total = 0;
+	int64_t end = timeval_ms() + (int64_t)seconds * 1000;
+	while (timeval_ms() < end) {
+		uint32_t num_of_samples;
+
+		/* the target keeps running from one interval to the next, only
+		 * profilers without a way to sample it running stop it */
+		retval = target_poll(target);
+		if (retval != ERROR_OK)
+			break;
+
+		uint32_t chunk = MIN(interval, (end - timeval_ms() + 999) / 1000);
+		retval = target_profiling(target, samples, MAX_PROFILE_SAMPLE_NUM,
+				&num_of_samples, chunk);
+		if (retval != ERROR_OK)
+			break;
+
+		for (uint32_t i = 0; i < num_of_samples; i++)
+			profile_histogram_add(&hist, samples[i]);
+
+		total += hist.total;
+		retval = profile_histogram_write_folded(&hist, f);
+		if (retval != ERROR_OK)
+			break;
+		profile_histogram_clear(&hist);
+	}
+
+	if (retval == ERROR_OK)
+		command_print(CMD_CTX, "Wrote %" PRIu64 " samples to %s", total, CMD_ARGV[1]);
+
+done:
+	if (f)
+		fclose(f);
+	free(samples);
+	profile_histogram_free(&hist);
+	return retval;
+}
+
 static int new_int_array_element(Jim_Interp *interp, const char *varname, int idx, uint32_t val)
 {
 	char *namebuf;
@@ -4068,6 +4472,355 @@ static int target_array2mem(Jim_Interp *interp, struct target *target,
 	return e;
 }
 
+/* read_memory and write_memory options, before the positional arguments */
+enum memory_opt {
+	MEMORY_OPT_PHYS,
+	MEMORY_OPT_BINARY,
+	MEMORY_OPT_ENDIAN,
+};
+
+static const Jim_Nvp nvp_memory_opts[] = {
+	{ .name = "phys",    .value = MEMORY_OPT_PHYS },
+	{ .name = "-binary", .value = MEMORY_OPT_BINARY },
+	{ .name = "-endian", .value = MEMORY_OPT_ENDIAN },
+	{ .name = NULL,      .value = -1 },
+};
+
+struct memory_opts {
+	bool phys;
+	bool binary;
+	enum target_endianness endianness;
+};
+
+static int jim_memory_opts(Jim_GetOptInfo *goi, struct target *target,
+		struct memory_opts *opts)
+{
+	opts->phys = false;
+	opts->binary = false;
+	opts->endianness = target->endianness;
+
+	bool endian_set = false;
+	while (goi->argc > 0) {
+		const char *arg = Jim_String(goi->argv[0]);
+		if (arg[0] != '-' && strcmp(arg, "phys") != 0)
+			break;
+
+		Jim_Nvp *n;
+		int e = Jim_GetOpt_Nvp(goi, nvp_memory_opts, &n);
+		if (e != JIM_OK) {
+			Jim_GetOpt_NvpUnknown(goi, nvp_memory_opts, 0);
+			return e;
+		}
+
+		switch (n->value) {
+			case MEMORY_OPT_PHYS:
+				opts->phys = true;
+				break;
+			case MEMORY_OPT_BINARY:
+				opts->binary = true;
+				break;
+			case MEMORY_OPT_ENDIAN:
+				e = Jim_GetOpt_Nvp(goi, nvp_target_endian, &n);
+				if (e != JIM_OK) {
+					Jim_GetOpt_NvpUnknown(goi, nvp_target_endian, 1);
+					return e;
+				}
+				opts->endianness = n->value;
+				endian_set = true;
+				break;
+		}
+	}
+
+	if (opts->binary && endian_set) {
+		Jim_SetResultFormatted(goi->interp, "-endian does not apply to -binary data");
+		return JIM_ERR;
+	}
+	return JIM_OK;
+}
+
+static int jim_memory_width(Jim_GetOptInfo *goi, unsigned *width)
+{
+	jim_wide w;
+	int e = Jim_GetOpt_Wide(goi, &w);
+	if (e != JIM_OK)
+		return e;
+
+	if (w != 8 && w != 16 && w != 32) {
+		Jim_SetResultFormatted(goi->interp, "Invalid width param, must be 8/16/32");
+		return JIM_ERR;
+	}
+	*width = w / 8;
+	return JIM_OK;
+}
+
+/* Whole transfers go to the target in one call; the Tcl side gets a
+ * list of integers or, with -binary, a string holding the raw bytes. */
+static int target_read_memory_jim(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	Jim_GetOptInfo goi;
+	Jim_GetOpt_Setup(&goi, interp, argc, argv);
+
+	struct memory_opts opts;
+	int e = jim_memory_opts(&goi, target, &opts);
+	if (e != JIM_OK)
+		return e;
+
+	if (goi.argc != (opts.binary ? 2 : 3)) {
+		Jim_SetResultFormatted(interp, "usage: read_memory [phys] "
+				"[-endian big|little] address width count | "
+				"[phys] -binary address count");
+		return JIM_ERR;
+	}
+
+	jim_wide addr;
+	e = Jim_GetOpt_Wide(&goi, &addr);
+	if (e != JIM_OK)
+		return e;
+
+	unsigned width = 1;
+	if (!opts.binary) {
+		e = jim_memory_width(&goi, &width);
+		if (e != JIM_OK)
+			return e;
+	}
+
+	jim_wide count;
+	e = Jim_GetOpt_Wide(&goi, &count);
+	if (e != JIM_OK)
+		return e;
+
+	if (addr < 0 || addr > UINT32_MAX || count < 0 || count > UINT32_MAX ||
+			addr + count * width - 1 > UINT32_MAX) {
+		Jim_SetResultFormatted(interp, "read_memory: address range exceeds 32 bits");
+		return JIM_ERR;
+	}
+	if (addr % width) {
+		char buf[80];
+		snprintf(buf, sizeof(buf), "read_memory: address 0x%08" PRIx32
+				" is not aligned for %u byte reads", (uint32_t)addr, width);
+		Jim_SetResultString(interp, buf, -1);
+		return JIM_ERR;
+	}
+	if (count == 0) {
+		Jim_SetEmptyResult(interp);
+		return JIM_OK;
+	}
+
+	uint8_t *buffer = malloc(count * width);
+	if (buffer == NULL) {
+		Jim_SetResultFormatted(interp, "read_memory: out of memory");
+		return JIM_ERR;
+	}
+
+	int retval;
+	if (opts.phys)
+		retval = target_read_phys_memory(target, addr, width, count, buffer);
+	else if (opts.binary)
+		retval = target_read_buffer(target, addr, count, buffer);
+	else
+		retval = target_read_memory(target, addr, width, count, buffer);
+	if (retval != ERROR_OK) {
+		free(buffer);
+		char buf[80];
+		snprintf(buf, sizeof(buf), "read_memory: cannot read memory at 0x%08" PRIx32,
+				(uint32_t)addr);
+		Jim_SetResultString(interp, buf, -1);
+		return JIM_ERR;
+	}
+
+	if (opts.binary) {
+		Jim_SetResult(interp, Jim_NewStringObj(interp, (char *)buffer, count));
+		free(buffer);
+		return JIM_OK;
+	}
+
+	Jim_Obj **values = malloc(count * sizeof(*values));
+	if (values == NULL) {
+		free(buffer);
+		Jim_SetResultFormatted(interp, "read_memory: out of memory");
+		return JIM_ERR;
+	}
+
+	bool little = opts.endianness == TARGET_LITTLE_ENDIAN;
+	for (jim_wide i = 0; i < count; i++) {
+		const uint8_t *p = buffer + i * width;
+		uint32_t v;
+		switch (width) {
+			case 4:
+				v = little ? le_to_h_u32(p) : be_to_h_u32(p);
+				break;
+			case 2:
+				v = little ? le_to_h_u16(p) : be_to_h_u16(p);
+				break;
+			default:
+				v = *p;
+				break;
+		}
+		values[i] = Jim_NewIntObj(interp, v);
+	}
+	Jim_SetResult(interp, Jim_NewListObj(interp, values, count));
+
+	free(values);
+	free(buffer);
+	return JIM_OK;
+}
+
+static int target_write_memory_jim(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	Jim_GetOptInfo goi;
+	Jim_GetOpt_Setup(&goi, interp, argc, argv);
+
+	struct memory_opts opts;
+	int e = jim_memory_opts(&goi, target, &opts);
+	if (e != JIM_OK)
+		return e;
+
+	if (goi.argc != (opts.binary ? 2 : 3)) {
+		Jim_SetResultFormatted(interp, "usage: write_memory [phys] "
+				"[-endian big|little] address width {values} | "
+				"[phys] -binary address data");
+		return JIM_ERR;
+	}
+
+	jim_wide addr;
+	e = Jim_GetOpt_Wide(&goi, &addr);
+	if (e != JIM_OK)
+		return e;
+
+	unsigned width = 1;
+	if (!opts.binary) {
+		e = jim_memory_width(&goi, &width);
+		if (e != JIM_OK)
+			return e;
+	}
+
+	Jim_Obj *data;
+	e = Jim_GetOpt_Obj(&goi, &data);
+	if (e != JIM_OK)
+		return e;
+
+	int len;
+	const char *bytes = NULL;
+	if (opts.binary)
+		bytes = Jim_GetString(data, &len);
+	else
+		len = Jim_ListLength(interp, data);
+	jim_wide count = len;
+
+	if (addr < 0 || addr > UINT32_MAX ||
+			addr + count * width - 1 > UINT32_MAX) {
+		Jim_SetResultFormatted(interp, "write_memory: address range exceeds 32 bits");
+		return JIM_ERR;
+	}
+	if (addr % width) {
+		char buf[80];
+		snprintf(buf, sizeof(buf), "write_memory: address 0x%08" PRIx32
+				" is not aligned for %u byte writes", (uint32_t)addr, width);
+		Jim_SetResultString(interp, buf, -1);
+		return JIM_ERR;
+	}
+	if (count == 0)
+		return JIM_OK;
+
+	int retval;
+	if (opts.binary) {
+		if (opts.phys)
+			retval = target_write_phys_memory(target, addr, 1, count,
+					(const uint8_t *)bytes);
+		else
+			retval = target_write_buffer(target, addr, count,
+					(const uint8_t *)bytes);
+	} else {
+		uint8_t *buffer = malloc(count * width);
+		if (buffer == NULL) {
+			Jim_SetResultFormatted(interp, "write_memory: out of memory");
+			return JIM_ERR;
+		}
+
+		bool little = opts.endianness == TARGET_LITTLE_ENDIAN;
+		jim_wide max = ((jim_wide)1 << (width * 8)) - 1;
+		for (jim_wide i = 0; i < count; i++) {
+			jim_wide v;
+			e = Jim_GetWide(interp, Jim_ListGetIndex(interp, data, i), &v);
+			if (e != JIM_OK) {
+				free(buffer);
+				return e;
+			}
+			/* negative values are written in two's complement */
+			if (v > max || v < -(max / 2) - 1) {
+				free(buffer);
+				Jim_SetResultFormatted(interp, "write_memory: value %#s does not fit in the width",
+						Jim_ListGetIndex(interp, data, i));
+				return JIM_ERR;
+			}
+
+			uint8_t *p = buffer + i * width;
+			switch (width) {
+				case 4:
+					if (little)
+						h_u32_to_le(p, v);
+					else
+						h_u32_to_be(p, v);
+					break;
+				case 2:
+					if (little)
+						h_u16_to_le(p, v);
+					else
+						h_u16_to_be(p, v);
+					break;
+				default:
+					*p = v;
+					break;
+			}
+		}
+
+		if (opts.phys)
+			retval = target_write_phys_memory(target, addr, width, count, buffer);
+		else
+			retval = target_write_memory(target, addr, width, count, buffer);
+		free(buffer);
+	}
+
+	if (retval != ERROR_OK) {
+		char buf[80];
+		snprintf(buf, sizeof(buf), "write_memory: cannot write memory at 0x%08" PRIx32,
+				(uint32_t)addr);
+		Jim_SetResultString(interp, buf, -1);
+		return JIM_ERR;
+	}
+	return JIM_OK;
+}
+
+static int jim_read_memory(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	struct command_context *context = current_command_context(interp);
+	assert(context != NULL);
+
+	struct target *target = get_current_target(context);
+	if (target == NULL) {
+		LOG_ERROR("read_memory: no current target");
+		return JIM_ERR;
+	}
+
+	return target_read_memory_jim(interp, target, argc - 1, argv + 1);
+}
+
+static int jim_write_memory(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	struct command_context *context = current_command_context(interp);
+	assert(context != NULL);
+
+	struct target *target = get_current_target(context);
+	if (target == NULL) {
+		LOG_ERROR("write_memory: no current target");
+		return JIM_ERR;
+	}
+
+	return target_write_memory_jim(interp, target, argc - 1, argv + 1);
+}
+
 /* FIX? should we propagate errors here rather than printing them
  * and continuing?
  */
@@ -4692,6 +5445,20 @@ static int jim_target_array2mem(Jim_Interp *interp,
 	return target_array2mem(interp, target, argc - 1, argv + 1);
 }
 
+static int jim_target_read_memory(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_read_memory_jim(interp, target, argc - 1, argv + 1);
+}
+
+static int jim_target_write_memory(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_write_memory_jim(interp, target, argc - 1, argv + 1);
+}
+
 static int jim_target_tap_disabled(Jim_Interp *interp)
 {
 	Jim_SetResultFormatted(interp, "[TAP is disabled]");
@@ -4977,6 +5744,24 @@ static const struct command_registration target_instance_command_handlers[] = {
 			"from target memory",
 		.usage = "arrayname bitwidth address count",
 	},
+	{
+		.name = "read_memory",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_read_memory,
+		.help = "Returns a list of 8/16/32 bit numbers, or the raw "
+			"bytes, read from target memory",
+		.usage = "['phys'] ['-endian' ('big'|'little')] address bitwidth count | "
+			"['phys'] '-binary' address count",
+	},
+	{
+		.name = "write_memory",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_write_memory,
+		.help = "Writes a list of 8/16/32 bit numbers, or raw bytes, "
+			"to target memory",
+		.usage = "['phys'] ['-endian' ('big'|'little')] address bitwidth {values} | "
+			"['phys'] '-binary' address data",
+	},
 	{
 		.name = "eventlist",
 		.mode = COMMAND_EXEC,
@@ -5123,6 +5908,7 @@ static int target_create(Jim_GetOptInfo *goi)
 	target->working_area        = 0x0;
 	target->working_area_size   = 0x0;
 	target->working_areas       = NULL;
+	target->resident_code       = NULL;
 	target->backup_working_area = 0;
 
 	target->state               = TARGET_UNKNOWN;
@@ -5878,6 +6664,14 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.usage = "seconds filename [start end]",
 		.help = "profiling samples the CPU PC",
 	},
+	{
+		.name = "profile_folded",
+		.handler = handle_profile_folded_command,
+		.mode = COMMAND_EXEC,
+		.usage = "seconds filename [interval]",
+		.help = "sample the CPU PC for a long time, appending a "
+			"folded histogram to the file every interval seconds",
+	},
 	/** @todo don't register virt2phys() unless target supports it */
 	{
 		.name = "virt2phys",
@@ -6057,6 +6851,24 @@ static const struct command_registration target_exec_command_handlers[] = {
 			"and write the 8/16/32 bit values",
 		.usage = "arrayname bitwidth address count",
 	},
+	{
+		.name = "read_memory",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_read_memory,
+		.help = "read 8/16/32 bit memory or raw bytes and return them "
+			"as a TCL list or byte string",
+		.usage = "['phys'] ['-endian' ('big'|'little')] address bitwidth count | "
+			"['phys'] '-binary' address count",
+	},
+	{
+		.name = "write_memory",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_write_memory,
+		.help = "write a TCL list of 8/16/32 bit values or a byte "
+			"string to memory",
+		.usage = "['phys'] ['-endian' ('big'|'little')] address bitwidth {values} | "
+			"['phys'] '-binary' address data",
+	},
 	{
 		.name = "reset_nag",
 		.handler = handle_target_reset_nag,
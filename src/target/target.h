@@ -101,6 +101,16 @@ struct working_area {
 	struct working_area *next;
 };
 
+/* algorithm code still present in working area memory after it was freed,
+ * so target_alloc_working_area_code() can hand it out again without
+ * uploading it */
+struct working_area_code {
+	uint32_t address;
+	uint32_t size;
+	uint8_t *code;
+	struct working_area_code *next;
+};
+
 struct gdb_service {
 	struct target *target;
 	/*  field for smp display  */
@@ -108,6 +118,14 @@ struct gdb_service {
 	/*  element 1 coreid to be displayed at next resume 1 till n 0 means resume
 	 *  all cores core displayed  */
 	int32_t core[2];
+	/*  number of GDB connections attached to this service, the first one
+	 *  owns the target, the others are read-mostly observers */
+	int connection_count;
+	bool has_owner;
+	/*  state captured once per halt and shared by all connections */
+	struct gdb_halt_snapshot *snapshot;
+	/*  bumped on every write to target memory, from any client */
+	uint32_t write_count;
 };
 
 /* target back off timer */
@@ -116,6 +134,15 @@ struct backoff_timer {
 	int count;
 };
 
+/* adaptive background polling */
+struct poll_schedule {
+	int interval;		/* ms until the next background poll, 0 for default */
+	int64_t last;		/* timeval_ms() of the last background poll */
+	uint64_t count;		/* background polls done */
+	int64_t total_us;	/* time spent in them */
+	int64_t max_us;		/* longest one */
+};
+
 /* split target registers into multiple class */
 enum target_register_class {
 	REG_CLASS_ALL,
@@ -160,6 +187,7 @@ struct target {
 	uint32_t working_area_size;			/* size in bytes */
 	uint32_t backup_working_area;		/* whether the content of the working area has to be preserved */
 	struct working_area *working_areas;/* list of allocated working areas */
+	struct working_area_code *resident_code;	/* algorithms left in working area memory */
 	enum target_debug_reason debug_reason;/* reason why the target entered debug state */
 	enum target_endianness endianness;	/* target endianness */
 	/* also see: target_state_name() */
@@ -167,6 +195,7 @@ struct target {
 	struct reg_cache *reg_cache;		/* the first register cache of the target (core regs) */
 	struct breakpoint *breakpoints;		/* list of breakpoints */
 	struct watchpoint *watchpoints;		/* list of watchpoints */
+	struct breakpoint_index *bp_index;	/* address hash over both lists */
 	struct trace *trace_info;			/* generic trace information */
 	struct debug_msg_receiver *dbgmsg;	/* list of debug message receivers */
 	uint32_t dbg_msg_enabled;			/* debug message status */
@@ -186,6 +215,7 @@ struct target {
 	bool rtos_auto_detect;				/* A flag that indicates that the RTOS has been specified as "auto"
 										 * and must be detected when symbols are offered */
 	struct backoff_timer backoff;
+	struct poll_schedule poll_sched;
 	int smp;							/* add some target attributes for smp support */
 	struct target_list *head;
 	/* the gdb service is there in case of smp, we have only one gdb server
@@ -335,6 +365,16 @@ int target_call_timer_callbacks(void);
  * a synchronous command completes.
  */
 int target_call_timer_callbacks_now(void);
+/** @returns milliseconds until the next timer callback is due */
+int64_t target_timer_next_event(void);
+
+/**
+ * While the background poller runs, returns a non-zero id of the current
+ * pass, else 0.  Together with target_poll_due() this lets a target read
+ * the state of all its siblings due in the same pass at once.
+ */
+unsigned target_poll_pass(void);
+bool target_poll_due(struct target *target);
 
 struct target *get_current_target(struct command_context *cmd_ctx);
 struct target *get_target(const char *id);
@@ -561,6 +601,15 @@ int target_get_gdb_fileio_info(struct target *target, struct gdb_fileio_info *fi
  */
 int target_gdb_fileio_end(struct target *target, int retcode, int fileio_errno, bool ctrl_c);
 
+/**
+ * Sample the PC by halting and resuming the target as often as possible.
+ *
+ * This is the profiling method used by targets that provide nothing
+ * better; targets with hardware PC sampling may fall back to it.
+ */
+int target_profiling_default(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
+
 
 
 /** Return the *name* of this targets current state */
@@ -587,6 +636,14 @@ int target_alloc_working_area(struct target *target,
  */
 int target_alloc_working_area_try(struct target *target,
 		uint32_t size, struct working_area **area);
+/* Allocate a working area holding @a code, e.g. a flash or checksum
+ * algorithm.  If the same code was uploaded before and that memory hasn't
+ * been reused, written to or given back to the application since, the
+ * area is handed out at the old address and nothing is uploaded.  Free it
+ * with target_free_working_area() as usual.
+ */
+int target_alloc_working_area_code(struct target *target,
+		const uint8_t *code, uint32_t size, struct working_area **area);
 int target_free_working_area(struct target *target, struct working_area *area);
 void target_free_all_working_areas(struct target *target);
 uint32_t target_get_working_area_avail(struct target *target);
@@ -46,6 +46,29 @@ int trace_point(struct target *target, uint32_t number)
 	return ERROR_OK;
 }
 
+/**
+ * Count a PC seen by hardware trace or PC sampling.  Trace point
+ * addresses are taken as function entry points: the PC is charged to
+ * the trace point with the highest address not above it.
+ */
+int trace_record_pc(struct target *target, uint32_t pc)
+{
+	struct trace *trace = target->trace_info;
+	uint32_t i, best = trace->num_trace_points;
+
+	for (i = 0; i < trace->num_trace_points; i++) {
+		uint32_t address = trace->trace_points[i].address;
+		if (address <= pc && (best == trace->num_trace_points
+				|| address > trace->trace_points[best].address))
+			best = i;
+	}
+
+	if (best == trace->num_trace_points)
+		return ERROR_OK;
+
+	return trace_point(target, best);
+}
+
 COMMAND_HANDLER(handle_trace_point_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
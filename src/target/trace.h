@@ -53,6 +53,7 @@ typedef enum trace_status {
 } trace_status_t;
 
 int trace_point(struct target *target, uint32_t number);
+int trace_record_pc(struct target *target, uint32_t pc);
 int trace_register_commands(struct command_context *cmd_ctx);
 
 #define ERROR_TRACE_IMAGE_UNAVAILABLE		(-1500)
@@ -0,0 +1,43 @@
+# Micro-benchmark of the command dispatch: how long one call of some
+# cheap commands takes from a script, as in register or memory polling
+# loops.  Works with any adapter, including "interface dummy":
+#
+#   openocd -f <config> -f tools/cmdbench.tcl -c "init; cmdbench; shutdown"
+#
+# Pass an address in target RAM to time memory accesses of the current
+# target too; the target has to be halted:
+#
+#   cmdbench 10000 0x20000000
+
+proc cmdbench_run { name count script } {
+	set start [clock microseconds]
+	uplevel 1 [list for {set i 0} "\$i < $count" {incr i} $script]
+	set t [expr {double([clock microseconds] - $start) / $count}]
+	echo [format "%-40s %8.2f us/call" $name $t]
+}
+
+proc cmdbench { {count 10000} {address ""} } {
+	echo "$count calls each"
+
+	cmdbench_run "ocd_command type (builtin)" $count {ocd_command type jtag}
+	cmdbench_run "jtag names (native subcommand)" $count {jtag names}
+	cmdbench_run "jtag_flush_queue_sleep (handler)" $count {jtag_flush_queue_sleep 0}
+
+	if {[llength [target names]] == 0} {
+		return
+	}
+	set t [target current]
+	cmdbench_run "\$target curstate" $count {$t curstate}
+	cmdbench_run "\$target cget -type" $count {$t cget -type}
+
+	if {$address == ""} {
+		return
+	}
+	cmdbench_run "mem2array" $count {mem2array v 32 $address 1}
+	cmdbench_run "\$target mem2array" $count {$t mem2array v 32 $address 1}
+	cmdbench_run "read_memory" $count {read_memory $address 32 1}
+	cmdbench_run "\$target read_memory" $count {$t read_memory $address 32 1}
+	cmdbench_run "mww" $count {mww $address 0}
+	cmdbench_run "capture mdw" $count {capture {mdw $address}}
+}
+add_help_text cmdbench "time the dispatch of some commands <count> <RAM address>"